@@ -39,6 +39,7 @@ class QString;
 enum class ScanFlag : uint8_t {
     includeReadOnly = 0x1, /**< devices that are read-only according to the kernel */
     includeLoopback = 0x2,
+    deferUsedCapacity = 0x4, /**< leave the usage of unmounted file systems unknown, see UsedCapacityReader */
 };
 Q_DECLARE_FLAGS(ScanFlags, ScanFlag)
 Q_DECLARE_OPERATORS_FOR_FLAGS(ScanFlags)
@@ -34,6 +34,7 @@ class QString;
 class CopyTarget
 {
     Q_DISABLE_COPY(CopyTarget)
+    friend class ExternalCommand;
 
 protected:
     CopyTarget() : m_BytesWritten(0) {}
@@ -0,0 +1,516 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "core/devicepropertycache.h"
+
+#include "util/externalcommand.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QStringList>
+#include <QThreadStorage>
+#include <QWaitCondition>
+
+#if defined(Q_OS_LINUX)
+    #include <blkid/blkid.h>
+#endif
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+typedef QHash<QString, QString> MapperNames;
+
+/** Mount points and active swap areas, keyed by device number and by canonical source path */
+struct MountIndex
+{
+    QHash<QString, QStringList> byDeviceNumber;
+    QHash<QString, QStringList> bySource;
+    QSet<QString> swaps;
+};
+
+/** The scan a thread takes part in, either started by the thread or joined by a task of it */
+struct ThreadScan
+{
+    int depth = 0;
+    quint64 generation = 0;
+    bool owner = false;
+};
+
+static QThreadStorage<ThreadScan> threadScans;
+
+static QMutex cacheMutex;
+static quint64 lastScanGeneration = 0;
+static quint64 cacheGeneration = 0; // the scan the cache belongs to, 0 if none
+static QHash<QString, QMap<QString, QString>> udevCache;
+static QHash<QString, QMap<QString, QString>> fileSystemCache;
+static MapperNames mapperNamesCache;
+static bool mapperNamesLoaded = false;
+static MountIndex mountIndexCache;
+static bool mountIndexLoaded = false;
+
+/** @return the scan of the calling thread or 0 if there is none */
+static quint64 currentScan()
+{
+    return threadScans.hasLocalData() && threadScans.localData().depth > 0 ? threadScans.localData().generation : 0;
+}
+
+/** @return if the cache can be used for the given scan. Call with cacheMutex locked. */
+static bool isCaching(quint64 generation)
+{
+    return generation != 0 && generation == cacheGeneration;
+}
+
+static void clearCache()
+{
+    udevCache.clear();
+    fileSystemCache.clear();
+    mapperNamesCache.clear();
+    mapperNamesLoaded = false;
+    mountIndexCache = MountIndex();
+    mountIndexLoaded = false;
+}
+
+/** @return major:minor of a block device or an empty string if deviceNode is none */
+static QString deviceNumber(const QString& deviceNode)
+{
+    struct stat info;
+    if (::stat(QFile::encodeName(deviceNode).constData(), &info) != 0 || !S_ISBLK(info.st_mode))
+        return QString();
+
+    return QStringLiteral("%1:%2").arg(major(info.st_rdev)).arg(minor(info.st_rdev));
+}
+
+/** Reads the properties udev stored for a block device without running anything.
+    @param deviceNode the device node
+    @param properties the E: entries of the device's udev database file
+    @return false if the database cannot be used for this device
+*/
+static bool readUdevDatabase(const QString& deviceNode, QMap<QString, QString>& properties)
+{
+    const QString number = deviceNumber(deviceNode);
+    if (number.isEmpty())
+        return false;
+
+    QFile database(QStringLiteral("/run/udev/data/b") + number);
+    if (!database.open(QIODevice::ReadOnly))
+        return false;
+
+    const QList<QByteArray> lines = database.readAll().split('\n');
+    for (const auto &line : lines) {
+        const int separator = line.indexOf('=');
+        if (!line.startsWith("E:") || separator < 0)
+            continue;
+
+        properties.insert(QString::fromUtf8(line.mid(2, separator - 2)), QString::fromUtf8(line.mid(separator + 1)));
+    }
+
+    return true;
+}
+
+static QMap<QString, QString> queryUdevProperties(const QString& deviceNode)
+{
+    QMap<QString, QString> properties;
+    if (readUdevDatabase(deviceNode, properties))
+        return properties;
+
+    ExternalCommand udevCommand(QStringLiteral("udevadm"), {
+                                 QStringLiteral("info"),
+                                 QStringLiteral("--query=property"),
+                                 deviceNode });
+
+    if (udevCommand.run(-1) && udevCommand.exitCode() == 0) {
+        const QStringList lines = udevCommand.output().split(QLatin1Char('\n'));
+        for (const auto &line : lines) {
+            const int separator = line.indexOf(QLatin1Char('='));
+            if (separator > 0)
+                properties.insert(line.left(separator), line.mid(separator + 1));
+        }
+    }
+
+    return properties;
+}
+
+/** Probes the superblock of a device with libblkid on a descriptor opened by the helper.
+
+    Unlike the udev database this is never stale, e.g. right after a new partition table was written.
+    @param properties set to ID_FS_TYPE, ID_FS_VERSION, ID_FS_LABEL and ID_FS_UUID as far as found
+    @return false if the device could not be probed at all
+*/
+static bool probeFileSystem(const QString& deviceNode, QMap<QString, QString>& properties)
+{
+#if defined(Q_OS_LINUX)
+    const int fd = ExternalCommand::openDevice(deviceNode, false);
+    if (fd < 0)
+        return false;
+
+    blkid_probe probe = blkid_new_probe();
+    bool rval = probe && blkid_probe_set_device(probe, fd, 0, 0) == 0;
+
+    if (rval) {
+        blkid_probe_enable_superblocks(probe, 1);
+        blkid_probe_set_superblocks_flags(probe, BLKID_SUBLKS_TYPE | BLKID_SUBLKS_VERSION | BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID);
+
+        // 1 means nothing was found and -2 that several file systems were found, blkid and udev report nothing then
+        const int result = blkid_do_safeprobe(probe);
+        rval = result != -1;
+
+        for (const char* name : { "TYPE", "VERSION", "LABEL", "UUID" }) {
+            const char* value = nullptr;
+            if (result == 0 && blkid_probe_lookup_value(probe, name, &value, nullptr) == 0)
+                properties.insert(QStringLiteral("ID_FS_") + QLatin1String(name), QString::fromUtf8(value));
+        }
+    }
+
+    blkid_free_probe(probe);
+    ::close(fd);
+
+    return rval;
+#else
+    Q_UNUSED(deviceNode)
+    Q_UNUSED(properties)
+    return false;
+#endif
+}
+
+/** @return the canonical path of a device node, or the node itself if it does not exist */
+static QString canonicalNode(const QString& deviceNode)
+{
+    const QString canonical = QFileInfo(deviceNode).canonicalFilePath();
+    return canonical.isEmpty() ? deviceNode : canonical;
+}
+
+/** Lists the mappers of open LUKS containers.
+
+    lsblk names the encrypted device by its kernel or mapper path, e.g.
+    /dev/dm-3 or /dev/mapper/vg-lv, while callers use paths like /dev/vg/lv or
+    /dev/disk/by-uuid links. Both sides are therefore compared by canonical path.
+
+    @param deviceNode the device to list together with its children or an empty string for all devices
+    @return the mapper nodes keyed by the canonical path of the encrypted device
+*/
+static MapperNames queryMapperNames(const QString& deviceNode = QString())
+{
+    QStringList args = { QStringLiteral("--list"),
+                         QStringLiteral("--paths"),
+                         QStringLiteral("--json"),
+                         QStringLiteral("--output"),
+                         QStringLiteral("name,type,pkname") };
+    if (!deviceNode.isEmpty())
+        args << deviceNode;
+
+    MapperNames mapperNames;
+    ExternalCommand cmd(QStringLiteral("lsblk"), args);
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return mapperNames;
+
+    const QJsonDocument jsonDocument = QJsonDocument::fromJson(cmd.rawOutput());
+    const QJsonArray jsonArray = jsonDocument.object()[QLatin1String("blockdevices")].toArray();
+    for (const auto &deviceLine : jsonArray) {
+        const QJsonObject deviceObject = deviceLine.toObject();
+        const QString name = deviceObject[QLatin1String("name")].toString();
+        const QString parent = deviceObject[QLatin1String("pkname")].toString();
+
+        if (deviceObject[QLatin1String("type")].toString() == QLatin1String("crypt") && !parent.isEmpty()
+                && !mapperNames.contains(canonicalNode(parent)))
+            mapperNames.insert(canonicalNode(parent), name);
+    }
+
+    return mapperNames;
+}
+
+/** Undoes the octal escaping of spaces, tabs, newlines and backslashes in /proc/self/mountinfo */
+static QString unescapeMountInfo(const QByteArray& field)
+{
+    QByteArray result;
+    result.reserve(field.size());
+    for (int i = 0; i < field.size(); ++i) {
+        if (field[i] == '\\' && i + 3 < field.size()) {
+            bool ok;
+            const int c = field.mid(i + 1, 3).toInt(&ok, 8);
+            if (ok) {
+                result.append(static_cast<char>(c));
+                i += 3;
+                continue;
+            }
+        }
+        result.append(field[i]);
+    }
+
+    return QString::fromLocal8Bit(result);
+}
+
+/** Reads all mounts and active swap areas of the system, without running anything.
+
+    The device number catches mounts through any device path, e.g. /dev/root.
+    Btrfs reports anonymous device numbers, so mounts are also indexed by their
+    canonical source path.
+*/
+static MountIndex readMountIndex()
+{
+    MountIndex index;
+
+    QFile mountInfo(QStringLiteral("/proc/self/mountinfo"));
+    if (mountInfo.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> lines = mountInfo.readAll().split('\n');
+        for (const auto &line : lines) {
+            // 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+            const QList<QByteArray> fields = line.split(' ');
+            const int separator = fields.indexOf("-");
+            if (fields.size() < 5 || separator < 0 || separator + 2 >= fields.size())
+                continue;
+
+            const QString mountPoint = unescapeMountInfo(fields[4]);
+            index.byDeviceNumber[QString::fromLatin1(fields[2])].append(mountPoint);
+
+            const QString source = unescapeMountInfo(fields[separator + 2]);
+            if (source.startsWith(QLatin1Char('/'))) {
+                const QString canonicalSource = QFileInfo(source).canonicalFilePath();
+                index.bySource[canonicalSource.isEmpty() ? source : canonicalSource].append(mountPoint);
+            }
+        }
+    }
+
+    QFile swaps(QStringLiteral("/proc/swaps"));
+    if (swaps.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> lines = swaps.readAll().split('\n');
+        for (int i = 1; i < lines.size(); ++i) {
+            const QByteArray fileName = lines[i].left(lines[i].indexOf(' '));
+            if (fileName.isEmpty())
+                continue;
+
+            const QString source = unescapeMountInfo(fileName);
+            const QString number = deviceNumber(source);
+            index.swaps.insert(number.isEmpty() ? QFileInfo(source).canonicalFilePath() : number);
+        }
+    }
+
+    return index;
+}
+
+static MountIndex mountIndex()
+{
+    const quint64 generation = currentScan();
+
+    QMutexLocker locker(&cacheMutex);
+    if (!isCaching(generation)) {
+        locker.unlock();
+        return readMountIndex();
+    }
+
+    if (!mountIndexLoaded) {
+        mountIndexCache = readMountIndex();
+        mountIndexLoaded = true;
+    }
+
+    return mountIndexCache;
+}
+
+/** lsblk runs without cacheMutex held, other threads that need the listing wait for it */
+static QWaitCondition mapperNamesCondition;
+static bool mapperNamesLoading = false;
+
+static QString mapperNameOf(const QString& deviceNode)
+{
+    const QString node = canonicalNode(deviceNode);
+
+    const quint64 generation = currentScan();
+
+    QMutexLocker locker(&cacheMutex);
+    while (isCaching(generation) && mapperNamesLoading)
+        mapperNamesCondition.wait(&cacheMutex);
+
+    if (!isCaching(generation)) {
+        locker.unlock();
+        return queryMapperNames(deviceNode).value(node);
+    }
+
+    if (!mapperNamesLoaded) {
+        mapperNamesLoading = true;
+        locker.unlock();
+
+        const MapperNames mapperNames = queryMapperNames();
+
+        locker.relock();
+        mapperNamesLoading = false;
+        mapperNamesCondition.wakeAll();
+
+        // The scan ended or another one started while lsblk was running
+        if (!isCaching(generation))
+            return mapperNames.value(node);
+
+        mapperNamesCache = mapperNames;
+        mapperNamesLoaded = true;
+    }
+
+    return mapperNamesCache.value(node);
+}
+
+/** Starts a scan on the calling thread unless it already takes part in one.
+    The cache is emptied and belongs to the new scan from now on, a scan that is
+    still running on another thread continues without it.
+*/
+void DevicePropertyCache::beginScan()
+{
+    ThreadScan& scan = threadScans.localData();
+    if (scan.depth++ > 0)
+        return;
+
+    QMutexLocker locker(&cacheMutex);
+    clearCache();
+    scan.generation = ++lastScanGeneration;
+    scan.owner = true;
+    cacheGeneration = scan.generation;
+}
+
+/** Lets the calling thread take part in a scan started by another thread,
+    typically a pool task started by the scanning thread.
+    @param generation the scanGeneration() of the scanning thread
+*/
+void DevicePropertyCache::joinScan(quint64 generation)
+{
+    ThreadScan& scan = threadScans.localData();
+    if (scan.depth++ > 0)
+        return;
+
+    scan.generation = generation;
+    scan.owner = false;
+}
+
+/** Ends the scan of the calling thread. The cache is dropped when the thread that started it ends it. */
+void DevicePropertyCache::endScan()
+{
+    ThreadScan& scan = threadScans.localData();
+    Q_ASSERT(scan.depth > 0);
+    if (--scan.depth > 0)
+        return;
+
+    QMutexLocker locker(&cacheMutex);
+    if (scan.owner && isCaching(scan.generation)) {
+        clearCache();
+        cacheGeneration = 0;
+    }
+    scan = ThreadScan();
+}
+
+/** Lets other caches live exactly as long as a scan.
+    @return a number identifying the scan of the calling thread or 0 if there is none
+*/
+quint64 DevicePropertyCache::scanGeneration()
+{
+    return currentScan();
+}
+
+/** @return all udev properties of the device, e.g. ID_FS_TYPE and ID_FS_LABEL */
+QMap<QString, QString> DevicePropertyCache::udevProperties(const QString& deviceNode)
+{
+    const quint64 generation = currentScan();
+
+    QMutexLocker locker(&cacheMutex);
+    if (isCaching(generation) && udevCache.contains(deviceNode))
+        return udevCache.value(deviceNode);
+
+    locker.unlock();
+    const QMap<QString, QString> properties = queryUdevProperties(deviceNode);
+    locker.relock();
+
+    if (isCaching(generation))
+        udevCache.insert(deviceNode, properties);
+
+    return properties;
+}
+
+/** @return a single udev property of the device or an empty string */
+QString DevicePropertyCache::udevProperty(const QString& deviceNode, const QString& name)
+{
+    return udevProperties(deviceNode).value(name);
+}
+
+/** Returns the file system properties of a device in udev naming.
+
+    The superblock is probed directly with libblkid, the udev properties are only
+    used if the device cannot be opened.
+    @return ID_FS_TYPE, ID_FS_VERSION, ID_FS_LABEL and ID_FS_UUID as far as found
+*/
+QMap<QString, QString> DevicePropertyCache::fileSystemProperties(const QString& deviceNode)
+{
+    const quint64 generation = currentScan();
+
+    QMutexLocker locker(&cacheMutex);
+    if (isCaching(generation) && fileSystemCache.contains(deviceNode))
+        return fileSystemCache.value(deviceNode);
+
+    locker.unlock();
+    QMap<QString, QString> properties;
+    if (!probeFileSystem(deviceNode, properties))
+        properties = udevProperties(deviceNode);
+    locker.relock();
+
+    if (isCaching(generation))
+        fileSystemCache.insert(deviceNode, properties);
+
+    return properties;
+}
+
+/** @return a single file system property of the device or an empty string */
+QString DevicePropertyCache::fileSystemProperty(const QString& deviceNode, const QString& name)
+{
+    return fileSystemProperties(deviceNode).value(name);
+}
+
+/** @return all mount points of the device, in the order they were mounted */
+QStringList DevicePropertyCache::mountPoints(const QString& deviceNode)
+{
+    const MountIndex index = mountIndex();
+
+    const QString number = deviceNumber(deviceNode);
+    if (index.byDeviceNumber.contains(number))
+        return index.byDeviceNumber.value(number);
+
+    const QString canonicalPath = QFileInfo(deviceNode).canonicalFilePath();
+    return canonicalPath.isEmpty() ? QStringList() : index.bySource.value(canonicalPath);
+}
+
+/** @return where the device was mounted first or an empty string */
+QString DevicePropertyCache::mountPoint(const QString& deviceNode)
+{
+    const QStringList points = mountPoints(deviceNode);
+    return points.isEmpty() ? QString() : points.first();
+}
+
+/** @return true if the device is mounted or used as active swap area */
+bool DevicePropertyCache::isMounted(const QString& deviceNode)
+{
+    if (!mountPoints(deviceNode).isEmpty())
+        return true;
+
+    const QString number = deviceNumber(deviceNode);
+    return mountIndex().swaps.contains(number.isEmpty() ? QFileInfo(deviceNode).canonicalFilePath() : number);
+}
+
+/** @return the device mapper node of an open LUKS container or an empty string */
+QString DevicePropertyCache::mapperName(const QString& deviceNode)
+{
+    return mapperNameOf(deviceNode);
+}
@@ -0,0 +1,84 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_DEVICEPROPERTYCACHE_H
+#define KPMCORE_DEVICEPROPERTYCACHE_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+/** Properties of block devices, memoized for the duration of a scan.
+
+    Outside of a scan every call queries the system. While a scan is in
+    progress udev properties are fetched once per device, preferably straight
+    from the udev database in /run/udev/data, file systems are probed once
+    per device with libblkid, mounts and swap areas are indexed once from
+    /proc/self/mountinfo and /proc/swaps, and LUKS mappers of all block
+    devices come from a single lsblk call.
+
+    Scans are delimited by Scope objects and may be nested. A scan belongs to
+    the thread that started it, other threads only use the cache if they
+    joined the scan, e.g. pool tasks of the scanning thread. The cache is
+    dropped when the outermost scope begins and when it ends, so the next
+    scan always sees fresh data.
+*/
+class LIBKPMCORE_EXPORT DevicePropertyCache
+{
+    DevicePropertyCache() = delete;
+
+public:
+    /** Keeps the cache alive while it exists. */
+    class LIBKPMCORE_EXPORT Scope
+    {
+        Q_DISABLE_COPY(Scope)
+
+    public:
+        Scope() {
+            DevicePropertyCache::beginScan();
+        }
+        /** Joins the scan with the given generation, 0 joins none. */
+        explicit Scope(quint64 generation) {
+            DevicePropertyCache::joinScan(generation);
+        }
+        ~Scope() {
+            DevicePropertyCache::endScan();
+        }
+    };
+
+public:
+    static void beginScan();
+    static void joinScan(quint64 generation);
+    static void endScan();
+    static quint64 scanGeneration();
+
+    static QMap<QString, QString> udevProperties(const QString& deviceNode);
+    static QString udevProperty(const QString& deviceNode, const QString& name);
+
+    static QMap<QString, QString> fileSystemProperties(const QString& deviceNode);
+    static QString fileSystemProperty(const QString& deviceNode, const QString& name);
+
+    static QStringList mountPoints(const QString& deviceNode);
+    static QString mountPoint(const QString& deviceNode);
+    static bool isMounted(const QString& deviceNode);
+    static QString mapperName(const QString& deviceNode);
+};
+
+#endif
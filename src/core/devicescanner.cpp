@@ -24,23 +24,73 @@
 #include "core/operationstack.h"
 #include "core/device.h"
 #include "core/diskdevice.h"
+#include "core/uevent.h"
+#include "core/usedcapacityreader.h"
 
 #include "fs/lvm2_pv.h"
 
 #include "util/externalcommand.h"
 
+#include <QMap>
 #include <QRegularExpression>
+#include <QSet>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QTimer>
+
+#if defined(Q_OS_LINUX)
+    #include <linux/netlink.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+
+    #include <cstring>
+#endif
+
+/** Multicast group of the uevents udev sends after processing the kernel's events */
+static const int udevMonitorGroup = 2;
+
+/** Bursts of uevents, e.g. a disk and all its partitions appearing, are collected for this long */
+static const int rescanDelay = 500;
+
+struct DeviceScannerPrivate
+{
+    int m_Socket = -1;
+    QSocketNotifier* m_Notifier = nullptr;
+    QTimer m_RescanTimer;
+    QSet<QString> m_PendingNodes;
+    QStringList m_RescanNodes;
+    UsedCapacityReader m_UsedCapacityReader;
+    bool m_DeferUsedCapacity = false;
+};
 
 /** Constructs a DeviceScanner
     @param ostack the OperationStack where the devices will be created
 */
 DeviceScanner::DeviceScanner(QObject* parent, OperationStack& ostack) :
     QThread(parent),
-    m_OperationStack(ostack)
+    m_OperationStack(ostack),
+    d(std::make_unique<DeviceScannerPrivate>())
 {
+    d->m_UsedCapacityReader.setOperationStack(&ostack);
+
+    d->m_RescanTimer.setSingleShot(true);
+    d->m_RescanTimer.setInterval(rescanDelay);
+    connect(&d->m_RescanTimer, &QTimer::timeout, this, &DeviceScanner::rescanPending);
+
+    // Events that arrived during a scan are handled when it is done
+    connect(this, &QThread::finished, this, [this] {
+        if (!d->m_PendingNodes.isEmpty())
+            d->m_RescanTimer.start();
+    });
+
     setupConnections();
 }
 
+DeviceScanner::~DeviceScanner()
+{
+    stopWatching();
+}
+
 void DeviceScanner::setupConnections()
 {
     connect(CoreBackendManager::self()->backend(), &CoreBackend::scanProgress, this, &DeviceScanner::progress);
@@ -48,13 +98,21 @@ void DeviceScanner::setupConnections()
 
 void DeviceScanner::clear()
 {
+    d->m_UsedCapacityReader.clear();
     operationStack().clearOperations();
     operationStack().clearDevices();
 }
 
 void DeviceScanner::run()
 {
-    scan();
+    if (d->m_RescanNodes.isEmpty()) {
+        scan();
+        return;
+    }
+
+    const QStringList deviceNodes = d->m_RescanNodes;
+    d->m_RescanNodes.clear();
+    rescan(deviceNodes);
 }
 
 void DeviceScanner::scan()
@@ -63,11 +121,143 @@ void DeviceScanner::scan()
 
     clear();
 
-    const QList<Device*> deviceList = CoreBackendManager::self()->backend()->scanDevices(ScanFlag::includeLoopback);
+    ScanFlags scanFlags = ScanFlag::includeLoopback;
+    if (d->m_DeferUsedCapacity)
+        scanFlags |= ScanFlag::deferUsedCapacity;
+
+    const QList<Device*> deviceList = CoreBackendManager::self()->backend()->scanDevices(scanFlags);
 
-    for (const auto &d : deviceList)
-        operationStack().addDevice(d);
+    for (const auto &device : deviceList)
+        operationStack().addDevice(device);
 
     operationStack().sortDevices();
+
+    if (d->m_DeferUsedCapacity)
+        d->m_UsedCapacityReader.enqueue(deviceList);
+}
+
+/** Makes full scans skip reading the usage of unmounted file systems.
+
+    The device list is available much sooner then. The usage is read in the background
+    afterwards, connect to UsedCapacityReader::usedCapacityRead() to be notified.
+    @param defer true to defer reading the usage
+*/
+void DeviceScanner::setDeferUsedCapacity(bool defer)
+{
+    d->m_DeferUsedCapacity = defer;
+}
+
+/** @return true if full scans defer reading the usage of unmounted file systems */
+bool DeviceScanner::deferUsedCapacity() const
+{
+    return d->m_DeferUsedCapacity;
+}
+
+/** @return the reader filling in the usage after deferred scans, also usable to request it for specific partitions */
+UsedCapacityReader& DeviceScanner::usedCapacityReader()
+{
+    return d->m_UsedCapacityReader;
+}
+
+/** Rescans the given disks and updates them in the OperationStack.
+
+    Disks that no longer exist are removed, new ones are added. Disks with pending operations are left alone.
+    @param deviceNodes the disks to rescan
+*/
+void DeviceScanner::rescan(const QStringList& deviceNodes)
+{
+    for (int i = 0; i < deviceNodes.size(); ++i) {
+        emit progress(deviceNodes.at(i), i * 100 / deviceNodes.size());
+        operationStack().updateDevice(deviceNodes.at(i), CoreBackendManager::self()->backend()->scanDevice(deviceNodes.at(i)));
+    }
+}
+
+/** Starts listening to block device uevents from udev.
+
+    Each added, removed or changed disk is rescanned on its own in this thread, the event loop
+    of the thread this object lives in must be running.
+    @return true if the scanner is watching for uevents
+*/
+bool DeviceScanner::startWatching()
+{
+    if (isWatching())
+        return true;
+
+#if defined(Q_OS_LINUX)
+    d->m_Socket = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (d->m_Socket < 0)
+        return false;
+
+    struct sockaddr_nl address;
+    std::memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = udevMonitorGroup;
+
+    if (::bind(d->m_Socket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(d->m_Socket);
+        d->m_Socket = -1;
+        return false;
+    }
+
+    d->m_Notifier = new QSocketNotifier(d->m_Socket, QSocketNotifier::Read, this);
+    connect(d->m_Notifier, &QSocketNotifier::activated, this, &DeviceScanner::readUevents);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/** Stops listening to uevents. Rescans that are already pending are dropped. */
+void DeviceScanner::stopWatching()
+{
+    if (!isWatching())
+        return;
+
+    delete d->m_Notifier;
+    d->m_Notifier = nullptr;
+#if defined(Q_OS_LINUX)
+    ::close(d->m_Socket);
+#endif
+    d->m_Socket = -1;
+
+    d->m_RescanTimer.stop();
+    d->m_PendingNodes.clear();
+}
+
+/** @return true if uevents are being watched */
+bool DeviceScanner::isWatching() const
+{
+    return d->m_Socket >= 0;
 }
 
+void DeviceScanner::readUevents()
+{
+#if defined(Q_OS_LINUX)
+    QByteArray message(8192, 0);
+    ssize_t size;
+    while ((size = ::recv(d->m_Socket, message.data(), message.size(), 0)) > 0) {
+        QMap<QString, QString> properties;
+        if (!Uevent::parse(message.left(size), properties))
+            continue;
+
+        const QString deviceNode = Uevent::diskNode(properties);
+        if (!deviceNode.isEmpty()) {
+            d->m_PendingNodes.insert(deviceNode);
+            d->m_RescanTimer.start();
+        }
+    }
+#endif
+}
+
+void DeviceScanner::rescanPending()
+{
+    // A running scan picks up pending nodes when it is finished
+    if (isRunning() || d->m_PendingNodes.isEmpty())
+        return;
+
+    d->m_RescanNodes = d->m_PendingNodes.toList();
+    d->m_RescanNodes.sort();
+    d->m_PendingNodes.clear();
+    start();
+}
@@ -20,14 +20,25 @@
 
 #include "util/libpartitionmanagerexport.h"
 
+#include <QStringList>
 #include <QThread>
 
+#include <memory>
+
 class OperationStack;
+class UsedCapacityReader;
+struct DeviceScannerPrivate;
 
 /** Thread to scan for all available Devices on this computer.
 
     This class is used to find all Devices on the computer and to create new Device instances for each of them. It's subclassing QThread to run asynchronously.
 
+    With startWatching() the scanner additionally listens to block device uevents from udev and
+    rescans only the disks that were added, removed or changed. The OperationStack is updated in place.
+
+    With setDeferUsedCapacity() full scans return before the usage of unmounted file systems is known,
+    it is filled in afterwards by usedCapacityReader().
+
     @author Volker Lanz <vl@fidra.de>
 */
 class LIBKPMCORE_EXPORT DeviceScanner : public QThread
@@ -36,17 +47,27 @@ class LIBKPMCORE_EXPORT DeviceScanner : public QThread
 
 public:
     DeviceScanner(QObject* parent, OperationStack& ostack);
+    ~DeviceScanner();
 
 public:
     void clear(); /**< clear Devices and the OperationStack */
     void scan(); /**< do the actual scanning; blocks if called directly */
     void setupConnections();
 
+    bool startWatching();
+    void stopWatching();
+    bool isWatching() const;
+
+    void setDeferUsedCapacity(bool defer);
+    bool deferUsedCapacity() const;
+    UsedCapacityReader& usedCapacityReader();
+
 Q_SIGNALS:
     void progress(const QString& deviceNode, int progress);
 
 protected:
     void run() override;
+    void rescan(const QStringList& deviceNodes);
     OperationStack& operationStack() {
         return m_OperationStack;
     }
@@ -54,8 +75,13 @@ protected:
         return m_OperationStack;
     }
 
+private:
+    void readUevents();
+    void rescanPending();
+
 private:
     OperationStack& m_OperationStack;
+    std::unique_ptr<DeviceScannerPrivate> d;
 };
 
 #endif
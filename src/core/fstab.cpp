@@ -18,6 +18,7 @@
  *************************************************************************/
 
 #include "core/fstab.h"
+#include "core/devicepropertycache.h"
 #include "util/externalcommand.h"
 #include "util/report.h"
 
@@ -27,18 +28,28 @@
 
 #include <QChar>
 #include <QDebug>
+#include <QDateTime>
 #include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
 #include <QRegularExpression>
 #include <QTemporaryFile>
 #include <QTextStream>
 
-static void parseFsSpec(const QString& m_fsSpec, FstabEntry::Type& m_entryType, QString& m_deviceNode);
-static QString findBlkIdDevice(const char *token, const QString& value);
+#include <algorithm>
+
+static void parseFsSpec(const QString& m_fsSpec, FstabEntry::Type& m_entryType, QString& m_tagName, QString& m_tagValue);
+static QString findBlkIdDevice(const QString& token, const QString& value);
 
 struct FstabEntryPrivate
 {
     QString m_fsSpec;
+    QString m_tagName;
+    QString m_tagValue;
     QString m_deviceNode;
+    bool m_deviceNodeResolved;
     QString m_mountPoint;
     QString m_type;
     QStringList m_options;
@@ -59,10 +70,86 @@ FstabEntry::FstabEntry(const QString& fsSpec, const QString& mountPoint, const Q
     d->m_comment = comment;
 
     d->m_options = options.split(QLatin1Char(','));
-    parseFsSpec(d->m_fsSpec, d->m_entryType, d->m_deviceNode);
+    d->m_deviceNodeResolved = false;
+    parseFsSpec(d->m_fsSpec, d->m_entryType, d->m_tagName, d->m_tagValue);
+}
+
+/** Parsed contents of one fstab file, valid as long as the file is not modified. */
+struct FstabModel
+{
+    QDateTime lastModified;
+    qint64 size = -1;
+    FstabEntryList entries;
+    QHash<QString, QList<int>> byDeviceNode; /**< entries with a device path, keyed by its canonical path */
+    QHash<QString, QList<int>> byTag;        /**< entries with UUID=, LABEL=, PARTUUID= or PARTLABEL= */
+};
+
+static QMutex fstabMutex;
+static QHash<QString, FstabModel> fstabModels;
+
+/** @return the key of a fs_spec tag in FstabModel::byTag, UUIDs are compared case insensitively */
+static QString tagKey(const QString& tagName, const QString& tagValue)
+{
+    const bool isUuid = tagName.endsWith(QStringLiteral("UUID"));
+    return tagName + QLatin1Char('=') + (isUuid ? tagValue.toLower() : tagValue);
+}
+
+static FstabEntryList parseFstab(const QString& fstabPath);
+
+/** Returns the model of an fstab file, parsing it again only if it was modified.
+    Must be called with fstabMutex held.
+*/
+static const FstabModel& fstabModel(const QString& fstabPath)
+{
+    const QFileInfo fileInfo(fstabPath);
+    FstabModel& model = fstabModels[fstabPath];
+    if (model.size == fileInfo.size() && model.lastModified == fileInfo.lastModified())
+        return model;
+
+    model = FstabModel();
+    model.lastModified = fileInfo.lastModified();
+    model.size = fileInfo.size();
+    model.entries = parseFstab(fstabPath);
+
+    for (int i = 0; i < model.entries.size(); ++i) {
+        const FstabEntry& entry = model.entries.at(i);
+        if (entry.entryType() == FstabEntry::Type::deviceNode) {
+            const QString canonicalPath = QFileInfo(entry.fsSpec()).canonicalFilePath();
+            model.byDeviceNode[canonicalPath.isEmpty() ? entry.fsSpec() : canonicalPath].append(i);
+        } else if (entry.entryType() != FstabEntry::Type::comment) {
+            const int separator = entry.fsSpec().indexOf(QLatin1Char('='));
+            model.byTag[tagKey(entry.fsSpec().left(separator), entry.fsSpec().mid(separator + 1))].append(i);
+        }
+    }
+
+    return model;
 }
 
+/** Reads the entries of an fstab file.
+
+    The file is only parsed again if it was modified since the last call. Every call returns new
+    FstabEntry objects that can be changed without affecting other callers. Devices given by tags
+    are only looked up when FstabEntry::deviceNode() is called.
+    @param fstabPath path of the fstab file
+    @return all entries, including comments
+*/
 FstabEntryList readFstabEntries( const QString& fstabPath )
+{
+    FstabEntryList cachedEntries;
+    {
+        QMutexLocker locker(&fstabMutex);
+        cachedEntries = fstabModel(fstabPath).entries;
+    }
+
+    FstabEntryList fstabEntries;
+    fstabEntries.reserve(cachedEntries.size());
+    for (const auto &e : qAsConst(cachedEntries))
+        fstabEntries.push_back( { e.fsSpec(), e.mountPoint(), e.type(), e.options().join(QLatin1Char(',')), e.dumpFreq(), e.passNumber(), e.comment() } );
+
+    return fstabEntries;
+}
+
+static FstabEntryList parseFstab(const QString& fstabPath)
 {
     FstabEntryList fstabEntries;
     QFile fstabFile( fstabPath );
@@ -114,7 +201,9 @@ FstabEntryList readFstabEntries( const QString& fstabPath )
 void FstabEntry::setFsSpec(const QString& s)
 {
     d->m_fsSpec = s;
-    parseFsSpec(d->m_fsSpec, d->m_entryType, d->m_deviceNode);
+    d->m_deviceNode.clear();
+    d->m_deviceNodeResolved = false;
+    parseFsSpec(d->m_fsSpec, d->m_entryType, d->m_tagName, d->m_tagValue);
 }
 
 const QString& FstabEntry::fsSpec() const
@@ -122,8 +211,17 @@ const QString& FstabEntry::fsSpec() const
     return d->m_fsSpec;
 }
 
+/** Devices given by a tag such as UUID= are looked up on first use. */
 const QString& FstabEntry::deviceNode() const
 {
+    if (!d->m_deviceNodeResolved) {
+        if (d->m_entryType == Type::deviceNode)
+            d->m_deviceNode = d->m_fsSpec;
+        else if (!d->m_tagName.isEmpty())
+            d->m_deviceNode = findBlkIdDevice(d->m_tagName, d->m_tagValue);
+        d->m_deviceNodeResolved = true;
+    }
+
     return d->m_deviceNode;
 }
 
@@ -182,50 +280,104 @@ void FstabEntry::setPassNumber(int s)
     d->m_passNumber = s;
 }
 
+/** Finds the mount points fstab lists for a device.
+
+    Entries with a device path are matched by canonical path. Entries with tags are matched
+    against the UUIDs and labels of the device itself, so no other device has to be probed.
+    @param deviceNode the device node
+    @param fstabPath path of the fstab file
+    @return the mount points in the order of the fstab file
+*/
 QStringList possibleMountPoints(const QString& deviceNode, const QString& fstabPath)
 {
+    const QString canonicalPath = QFileInfo(deviceNode).canonicalFilePath();
+
+    QMutexLocker locker(&fstabMutex);
+    const FstabModel& model = fstabModel(fstabPath);
+
+    QList<int> matches = model.byDeviceNode.value(canonicalPath.isEmpty() ? deviceNode : canonicalPath);
+
+    if (!model.byTag.isEmpty()) {
+        const FstabEntryList entries = model.entries;
+        const QHash<QString, QList<int>> byTag = model.byTag;
+        locker.unlock();
+
+        const QList<QPair<QString, QString>> tags = {
+            { QStringLiteral("UUID"), DevicePropertyCache::fileSystemProperty(deviceNode, QStringLiteral("ID_FS_UUID")) },
+            { QStringLiteral("LABEL"), DevicePropertyCache::fileSystemProperty(deviceNode, QStringLiteral("ID_FS_LABEL")) },
+            { QStringLiteral("PARTUUID"), DevicePropertyCache::udevProperty(deviceNode, QStringLiteral("ID_PART_ENTRY_UUID")) },
+            { QStringLiteral("PARTLABEL"), DevicePropertyCache::udevProperty(deviceNode, QStringLiteral("ID_PART_ENTRY_NAME")) },
+        };
+
+        for (const auto &tag : tags) {
+            if (!tag.second.isEmpty())
+                matches.append(byTag.value(tagKey(tag.first, tag.second)));
+        }
+
+        std::sort(matches.begin(), matches.end());
+
+        QStringList mountPoints;
+        for (int i : qAsConst(matches))
+            mountPoints.append(entries.at(i).mountPoint());
+        return mountPoints;
+    }
+
     QStringList mountPoints;
-    QString canonicalPath = QFileInfo(deviceNode).canonicalFilePath();
-    const FstabEntryList fstabEntryList = readFstabEntries( fstabPath );
-    for (const FstabEntry &entry : fstabEntryList)
-        if (QFileInfo(entry.deviceNode()).canonicalFilePath() == canonicalPath)
-            mountPoints.append(entry.mountPoint());
+    for (int i : qAsConst(matches))
+        mountPoints.append(model.entries.at(i).mountPoint());
 
     return mountPoints;
 }
 
-static QString findBlkIdDevice(const char *token, const QString& value)
+/** Looks up the device with a tag in a blkid cache shared by all entries, so
+    devices are only probed again if the cached information turns out to be stale.
+*/
+static QString findBlkIdDevice(const QString& token, const QString& value)
 {
     QString rval;
 
 #if defined(Q_OS_LINUX)
-    if (char* c = blkid_evaluate_tag(token, value.toLocal8Bit().constData(), nullptr)) {
+    static QMutex blkidMutex;
+    static blkid_cache cache = nullptr;
+
+    QMutexLocker locker(&blkidMutex);
+    if (cache == nullptr && blkid_get_cache(&cache, nullptr) != 0)
+        cache = nullptr;
+
+    if (cache) {
+        if (char* c = blkid_get_devname(cache, token.toLocal8Bit().constData(), value.toLocal8Bit().constData())) {
+            rval = QString::fromLocal8Bit(c);
+            free(c);
+        }
+    } else if (char* c = blkid_evaluate_tag(token.toLocal8Bit().constData(), value.toLocal8Bit().constData(), nullptr)) {
         rval = QString::fromLocal8Bit(c);
         free(c);
     }
+#else
+    Q_UNUSED(token)
+    Q_UNUSED(value)
 #endif
 
     return rval;
 }
 
-static void parseFsSpec(const QString& m_fsSpec, FstabEntry::Type& m_entryType, QString& m_deviceNode)
+static void parseFsSpec(const QString& m_fsSpec, FstabEntry::Type& m_entryType, QString& m_tagName, QString& m_tagValue)
 {
     m_entryType = FstabEntry::Type::comment;
-    if (m_fsSpec.startsWith(QStringLiteral("UUID="))) {
+    m_tagName.clear();
+    m_tagValue.clear();
+    if (m_fsSpec.startsWith(QStringLiteral("UUID=")) || m_fsSpec.startsWith(QStringLiteral("PARTUUID=")))
         m_entryType = FstabEntry::Type::uuid;
-        m_deviceNode = findBlkIdDevice("UUID", QString(m_fsSpec).remove(QStringLiteral("UUID=")));
-    } else if (m_fsSpec.startsWith(QStringLiteral("LABEL="))) {
+    else if (m_fsSpec.startsWith(QStringLiteral("LABEL=")) || m_fsSpec.startsWith(QStringLiteral("PARTLABEL=")))
         m_entryType = FstabEntry::Type::label;
-        m_deviceNode = findBlkIdDevice("LABEL", QString(m_fsSpec).remove(QStringLiteral("LABEL=")));
-    } else if (m_fsSpec.startsWith(QStringLiteral("PARTUUID="))) {
-        m_entryType = FstabEntry::Type::uuid;
-        m_deviceNode = findBlkIdDevice("PARTUUID", QString(m_fsSpec).remove(QStringLiteral("PARTUUID=")));
-    } else if (m_fsSpec.startsWith(QStringLiteral("PARTLABEL="))) {
-        m_entryType = FstabEntry::Type::label;
-        m_deviceNode = findBlkIdDevice("PARTLABEL", QString(m_fsSpec).remove(QStringLiteral("PARTLABEL=")));
-    } else if (m_fsSpec.startsWith(QStringLiteral("/"))) {
+    else if (m_fsSpec.startsWith(QStringLiteral("/")))
         m_entryType = FstabEntry::Type::deviceNode;
-        m_deviceNode = m_fsSpec;
+
+    // The device itself is only looked up when it is needed, see FstabEntry::deviceNode()
+    if (m_entryType == FstabEntry::Type::uuid || m_entryType == FstabEntry::Type::label) {
+        const int separator = m_fsSpec.indexOf(QLatin1Char('='));
+        m_tagName = m_fsSpec.left(separator);
+        m_tagValue = m_fsSpec.mid(separator + 1);
     }
 }
 
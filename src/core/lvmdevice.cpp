@@ -17,6 +17,8 @@
  *************************************************************************/
 
 #include "core/lvmdevice.h"
+#include "core/devicepropertycache.h"
+#include "core/lvmtopology.h"
 #include "core/partition.h"
 #include "core/partitiontable.h"
 #include "core/volumemanagerdevice_p.h"
@@ -25,15 +27,20 @@
 #include "fs/luks.h"
 #include "fs/filesystemfactory.h"
 
+#include "util/capacity.h"
 #include "util/externalcommand.h"
 #include "util/helpers.h"
 #include "util/globallog.h"
 #include "util/report.h"
 
+#include <QFile>
+#include <QFileInfo>
 #include <QRegularExpression>
 #include <QStorageInfo>
 #include <QtMath>
 
+#include <algorithm>
+
 #include <KLocalizedString>
 
 #define d_ptr std::static_pointer_cast<LvmDevicePrivate>(d)
@@ -45,13 +52,89 @@ public:
     qint64 m_totalPE;
     qint64 m_allocPE;
     qint64 m_freePE;
+    qint64 m_thinExtents;
+    qint64 m_hiddenExtents;
     QString m_UUID;
 
     mutable QStringList m_LVPathList;
     QVector <const Partition*> m_PVs;
     mutable std::unique_ptr<QHash<QString, qint64>> m_LVSizeMap;
+    QHash<QString, qint64> m_LVStartMap;
+    QHash<QString, LvmDevice::VolumeLayout> m_LayoutMap;
+    QList<LvmDevice::ThinPool> m_ThinPools;
+    QHash<QString, LvmDevice::CacheSettings> m_CacheMap;
+    LvmSegmentMap m_SegmentMap;
 };
 
+static bool isThinPool(const LvmTopology::LogicalVolume& lv)
+{
+    const QStringList layout = lv.layout.split(QLatin1Char(','));
+    return layout.contains(QStringLiteral("thin")) && layout.contains(QStringLiteral("pool"));
+}
+
+/** @return the thin pools of a VG with their usage */
+static QList<LvmDevice::ThinPool> readThinPools(const QString& vgName)
+{
+    QList<LvmDevice::ThinPool> pools;
+    for (const auto &lv : LvmTopology::current().logicalVolumes(vgName)) {
+        if (!isThinPool(lv))
+            continue;
+
+        LvmDevice::ThinPool pool;
+        pool.name = lv.name;
+        pool.size = lv.size;
+        pool.metadataSize = lv.metadataSize;
+        pool.dataPercent = lv.dataPercent;
+        pool.metadataPercent = lv.metadataPercent;
+        pools.append(pool);
+    }
+    return pools;
+}
+
+/** Warns in the report when a thin pool runs out of data or metadata space.
+
+    A full pool makes all its thin LVs fail writes, so every new thin LV or
+    snapshot is a good moment to look at it.
+*/
+static void checkThinPoolUsage(Report& report, const QString& vgName, const QString& poolName)
+{
+    for (const auto &pool : readThinPools(vgName)) {
+        if (pool.name != poolName)
+            continue;
+
+        if (pool.dataPercent >= 80 || pool.metadataPercent >= 80)
+            report.line() << xi18nc("@info:progress", "Thin pool %1 is %2% full and its metadata %3% full.", poolName,
+                                    QString::number(pool.dataPercent, 'f', 1), QString::number(pool.metadataPercent, 'f', 1));
+    }
+}
+
+/** Checks that a thin pool exists and warns when its thin LVs would be larger than the pool.
+
+    Overprovisioning is allowed, but the pool must then be grown before the
+    thin LVs are filled.
+
+    @param extents virtual size of the new thin LV
+    @return false if there is no such thin pool
+*/
+static bool checkThinPoolCapacity(Report& report, const LvmDevice& d, const QString& poolName, qint64 extents)
+{
+    const auto pool = std::find_if(d.thinPools().cbegin(), d.thinPools().cend(), [&poolName](const LvmDevice::ThinPool& candidate) { return candidate.name == poolName; });
+    if (pool == d.thinPools().cend()) {
+        report.line() << xi18nc("@info:progress", "Volume group %1 has no thin pool %2.", d.name(), poolName);
+        return false;
+    }
+
+    qint64 provisioned = extents * d.peSize();
+    for (const auto &lv : LvmTopology::current().logicalVolumes(d.name()))
+        if (lv.poolLv == poolName && !isThinPool(lv))
+            provisioned += qMax<qint64>(0, lv.size);
+
+    if (provisioned > pool->size)
+        report.line() << xi18nc("@info:progress", "The thin volumes in pool %1 will be %2 in total, but the pool only holds %3.", poolName,
+                                Capacity::formatByteSize(provisioned), Capacity::formatByteSize(pool->size));
+    return true;
+}
+
 /** Constructs a representation of LVM device with initialized LV as Partitions
  *
  *  @param vgName Volume Group name
@@ -73,6 +156,8 @@ LvmDevice::LvmDevice(const QString& vgName, const QString& iconName)
     d_ptr->m_UUID    = getUUID(vgName);
     d_ptr->m_LVPathList = getLVs(vgName);
     d_ptr->m_LVSizeMap  = std::make_unique<QHash<QString, qint64>>();
+    d_ptr->m_SegmentMap = LvmSegmentMap(LvmTopology::current(), vgName);
+    d_ptr->m_ThinPools = readThinPools(vgName);
 
     initPartitions();
 }
@@ -99,11 +184,30 @@ void LvmDevice::initPartitions()
     qint64 lastUsable  = totalPE() - 1;
     PartitionTable* pTable = new PartitionTable(PartitionTable::vmd, firstUsable, lastUsable);
 
+    // LVs are laid out one after another in the abstract partition table, see scanPartition()
+    qint64 lvStart = 0;
+    d_ptr->m_LVStartMap.clear();
+    for (const auto &lvPath : partitionNodes()) {
+        d_ptr->m_LVStartMap.insert(lvPath, lvStart);
+        lvStart += qMax<qint64>(0, getTotalLE(lvPath));
+    }
+
+    // Thin LVs take no extents of the VG, the table grows by their virtual size so the free extents still fit
+    d_ptr->m_thinExtents = 0;
+    qint64 shownExtents = 0;
     for (const auto &p : scanPartitions(pTable)) {
         LVSizeMap()->insert(p->partitionPath(), p->length());
+        if (volumeLayout(p->partitionPath()).type == LayoutType::Thin)
+            d_ptr->m_thinExtents += p->length();
+        else
+            shownExtents += p->length();
         pTable->append(p);
     }
 
+    // Thin and cache pools, their metadata and the images of raid LVs are allocated, but have no row
+    d_ptr->m_hiddenExtents = qMax<qint64>(0, allocatedPE() - shownExtents);
+    pTable->setLastUsableSector(lastUsable + thinExtents() - hiddenExtents());
+
     if (pTable)
         pTable->updateUnallocated(*this);
     else
@@ -128,6 +232,73 @@ const QList<Partition*> LvmDevice::scanPartitions(PartitionTable* pTable) const
     return pList;
 }
 
+/** @return segment type and stripe geometry of a LV as LVM reports them */
+static LvmDevice::VolumeLayout readVolumeLayout(const QString& lvPath)
+{
+    LvmDevice::VolumeLayout layout;
+
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::LogicalVolume* lv = topology.logicalVolume(lvPath);
+    if (!lv)
+        return layout;
+
+    // LVs are created with a single segment, extended ones keep the type of their first segment
+    const QList<LvmTopology::Segment> segments = topology.segments(lv->uuid);
+    if (segments.isEmpty())
+        return layout;
+
+    const LvmTopology::Segment& seg = segments.first();
+    if (seg.type == QStringLiteral("thin")) {
+        layout.type = LvmDevice::LayoutType::Thin;
+        layout.thinPool = lv->poolLv;
+        return layout;
+    }
+
+    if (seg.type == QStringLiteral("raid0") || seg.type == QStringLiteral("raid0_meta"))
+        layout.type = LvmDevice::LayoutType::Raid0;
+    else if (seg.type == QStringLiteral("raid10"))
+        layout.type = LvmDevice::LayoutType::Raid10;
+    else if (seg.type == QStringLiteral("striped") && seg.stripes > 1)
+        layout.type = LvmDevice::LayoutType::Striped;
+    else
+        return layout;
+
+    layout.stripes = seg.dataStripes;
+    layout.stripeSize = seg.stripeSize;
+    return layout;
+}
+
+/** @return cache type and options of a LV as LVM reports them */
+static LvmDevice::CacheSettings readCacheSettings(const QString& lvPath)
+{
+    LvmDevice::CacheSettings settings;
+
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::LogicalVolume* lv = topology.logicalVolume(lvPath);
+    if (!lv)
+        return settings;
+
+    // Cached LVs have the layout "cache" or "writecache", cache pools "cache,pool"
+    const QStringList layout = lv->layout.split(QLatin1Char(','));
+    if (layout.contains(QStringLiteral("writecache")))
+        settings.type = LvmDevice::CacheType::WriteCache;
+    else if (layout.contains(QStringLiteral("cache")) && !layout.contains(QStringLiteral("pool")))
+        settings.type = LvmDevice::CacheType::Cache;
+    else
+        return settings;
+
+    settings.mode = lv->cacheMode == QStringLiteral("writethrough") ? LvmDevice::CacheMode::WriteThrough : LvmDevice::CacheMode::WriteBack;
+    settings.policy = lv->cachePolicy;
+    for (const auto &seg : topology.segments(lv->uuid)) {
+        if (seg.type == QStringLiteral("cache") && seg.chunkSize > 0) {
+            settings.chunkSize = seg.chunkSize;
+            break;
+        }
+    }
+
+    return settings;
+}
+
 /** scan and construct a partition(LV) at a given path
  *
  * NOTE:
@@ -146,6 +317,14 @@ Partition* LvmDevice::scanPartition(const QString& lvPath, PartitionTable* pTabl
 {
     activateLV(lvPath);
 
+    d_ptr->m_LayoutMap.insert(lvPath, readVolumeLayout(lvPath));
+
+    const CacheSettings cache = readCacheSettings(lvPath);
+    if (cache.type != CacheType::None)
+        d_ptr->m_CacheMap.insert(lvPath, cache);
+    else
+        d_ptr->m_CacheMap.remove(lvPath);
+
     qint64 lvSize = getTotalLE(lvPath);
     qint64 startSector = mappedSector(lvPath, 0);
     qint64 endSector = startSector + lvSize - 1;
@@ -207,6 +386,9 @@ void LvmDevice::scanSystemLVM(QList<Device*>& devices)
 {
     LvmDevice::s_OrphanPVs.clear();
 
+    // Everything below is answered from one lvm fullreport
+    DevicePropertyCache::Scope lvmReport;
+
     QList<LvmDevice*> lvmList;
     for (const auto &vgName : getVGs()) {
         lvmList.append(new LvmDevice(vgName));
@@ -230,30 +412,29 @@ void LvmDevice::scanSystemLVM(QList<Device*>& devices)
 
 }
 
+/** Maps a sector of an LV to the abstract partition table of the VG.
+
+    The start of every LV is computed once when the partitions are scanned. Where the
+    extents really are on the PVs is answered by segmentMap().
+*/
 qint64 LvmDevice::mappedSector(const QString& lvPath, qint64 sector) const
 {
-    qint64 mSector = 0;
-    QStringList lvpathList = partitionNodes();
-    qint32 devIndex = lvpathList.indexOf(lvPath);
+    return d_ptr->m_LVStartMap.value(lvPath, 0) + sector;
+}
 
-    if (devIndex) {
-        for (int i = 0; i < devIndex; i++) {
-            mSector += LVSizeMap()->value(lvpathList[i]);
-        }
-        mSector += sector;
-    }
-    return mSector;
+/** @return the node LVM knows a PV partition by, i.e. the mapper of LUKS containers */
+static QString physicalVolumeNode(const Partition* p)
+{
+    if (p->roles().has(PartitionRole::Luks))
+        return static_cast<const FS::luks*>(&p->fileSystem())->mapperName();
+    return p->partitionPath();
 }
 
 const QStringList LvmDevice::deviceNodes() const
 {
     QStringList pvList;
-    for (const auto &p : physicalVolumes()) {
-        if (p->roles().has(PartitionRole::Luks))
-            pvList << static_cast<const FS::luks*>(&p->fileSystem())->mapperName();
-        else
-            pvList << p->partitionPath();
-    }
+    for (const auto &p : physicalVolumes())
+        pvList << physicalVolumeNode(p);
 
     return pvList;
 }
@@ -270,41 +451,28 @@ qint64 LvmDevice::partitionSize(QString& partitionPath) const
 
 const QStringList LvmDevice::getVGs()
 {
-    QStringList vgList;
-    QString output = getField(QStringLiteral("vg_name"));
-    if (!output.isEmpty()) {
-        const QStringList vgNameList = output.split(QLatin1Char('\n'), QString::SkipEmptyParts);
-        for (const auto &vgName : vgNameList) {
-            vgList.append(vgName.trimmed());
-        }
-    }
-    return vgList;
+    return LvmTopology::current().volumeGroupNames();
 }
 
 const QStringList LvmDevice::getLVs(const QString& vgName)
 {
-    QStringList lvPathList;
-    QString cmdOutput = getField(QStringLiteral("lv_path"), vgName);
-
-    if (cmdOutput.size()) {
-        const QStringList tempPathList = cmdOutput.split(QLatin1Char('\n'), QString::SkipEmptyParts);
-        for (const auto &lvPath : tempPathList) {
-            lvPathList.append(lvPath.trimmed());
-        }
-    }
-    return lvPathList;
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::VolumeGroup* vg = topology.volumeGroup(vgName);
+    return vg ? vg->logicalVolumes : QStringList();
 }
 
 qint64 LvmDevice::getPeSize(const QString& vgName)
 {
-    QString val = getField(QStringLiteral("vg_extent_size"), vgName);
-    return val.isEmpty() ? -1 : val.toLongLong();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::VolumeGroup* vg = topology.volumeGroup(vgName);
+    return vg ? vg->extentSize : -1;
 }
 
 qint64 LvmDevice::getTotalPE(const QString& vgName)
 {
-    QString val = getField(QStringLiteral("vg_extent_count"), vgName);
-    return val.isEmpty() ? -1 : val.toInt();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::VolumeGroup* vg = topology.volumeGroup(vgName);
+    return vg ? vg->extentCount : -1;
 }
 
 qint64 LvmDevice::getAllocatedPE(const QString& vgName)
@@ -314,15 +482,16 @@ qint64 LvmDevice::getAllocatedPE(const QString& vgName)
 
 qint64 LvmDevice::getFreePE(const QString& vgName)
 {
-    QString val =  getField(QStringLiteral("vg_free_count"), vgName);
-    return val.isEmpty() ? -1 : val.toInt();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::VolumeGroup* vg = topology.volumeGroup(vgName);
+    return vg ? vg->freeCount : -1;
 }
 
 QString LvmDevice::getUUID(const QString& vgName)
 {
-    QString val = getField(QStringLiteral("vg_uuid"), vgName);
-    return val.isEmpty() ? QStringLiteral("---") : val;
-
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::VolumeGroup* vg = topology.volumeGroup(vgName);
+    return vg && !vg->uuid.isEmpty() ? vg->uuid : QStringLiteral("---");
 }
 
 /** Get LVM vgs command output with field name
@@ -355,6 +524,10 @@ QString LvmDevice::getField(const QString& fieldName, const QString& vgName)
 
 qint64 LvmDevice::getTotalLE(const QString& lvPath)
 {
+    const LvmTopology topology = LvmTopology::current();
+    if (const LvmTopology::LogicalVolume* lv = topology.logicalVolume(lvPath))
+        return lv->extents;
+
     ExternalCommand cmd(QStringLiteral("lvm"),
             { QStringLiteral("lvdisplay"),
               lvPath});
@@ -377,43 +550,198 @@ bool LvmDevice::removeLV(Report& report, LvmDevice& d, Partition& p)
               QStringLiteral("--yes"),
               p.partitionPath()});
 
+    // lvremove drops the cache pool or cache volume of a cached LV together with it
     if (cmd.run(-1) && cmd.exitCode() == 0) {
+        d.setVolumeLayout(p.partitionPath(), VolumeLayout());
+        d.setCacheSettings(p.partitionPath(), CacheSettings());
         d.partitionTable()->remove(&p);
         return  true;
     }
     return false;
 }
 
-bool LvmDevice::createLV(Report& report, LvmDevice& d, Partition& p, const QString& lvName)
+/** Removes a LV that is not part of the partition table, e.g. a temporary snapshot. */
+bool LvmDevice::removeLV(Report& report, const QString& lvPath)
 {
     ExternalCommand cmd(report, QStringLiteral("lvm"),
-            { QStringLiteral("lvcreate"),
+            { QStringLiteral("lvremove"),
               QStringLiteral("--yes"),
-              QStringLiteral("--extents"),
-              QString::number(p.length()),
-              QStringLiteral("--name"),
-              lvName,
-              d.name()});
-
+              lvPath });
     return (cmd.run(-1) && cmd.exitCode() == 0);
 }
 
-bool LvmDevice::createLVSnapshot(Report& report, Partition& p, const QString& name, const qint64 extents)
+/** Creates a LV.
+
+    Striped and raid LVs without stripe size get the one of optimalStripeSize(),
+    which is then stored in the layout so file systems can be aligned to it.
+
+    @param layout how the extents of the LV are spread over the PVs
+*/
+bool LvmDevice::createLV(Report& report, LvmDevice& d, Partition& p, const QString& lvName, VolumeLayout layout)
+{
+    if (requiredPhysicalVolumes(layout) > d.physicalVolumes().count()) {
+        report.line() << xi18nc("@info:progress", "The layout of <filename>%1</filename> needs %2 physical volumes, but volume group %3 only has %4.",
+                                p.partitionPath(), requiredPhysicalVolumes(layout), d.name(), d.physicalVolumes().count());
+        return false;
+    }
+
+    QStringList args = { QStringLiteral("lvcreate"),
+                         QStringLiteral("--yes"),
+                         QStringLiteral("--extents"),
+                         QString::number(p.length()),
+                         QStringLiteral("--name"),
+                         lvName };
+
+    if (layout.type == LayoutType::Thin) {
+        if (!checkThinPoolCapacity(report, d, layout.thinPool, p.length()))
+            return false;
+
+        // Thin LVs only take space from their pool as they are written to
+        args = QStringList { QStringLiteral("lvcreate"),
+                             QStringLiteral("--yes"),
+                             QStringLiteral("--type"),
+                             QStringLiteral("thin"),
+                             QStringLiteral("--virtualsize"),
+                             QString::number(p.length() * d.peSize()) + QLatin1Char('b'),
+                             QStringLiteral("--thinpool"),
+                             layout.thinPool,
+                             QStringLiteral("--name"),
+                             lvName };
+    } else if (layout.type != LayoutType::Linear) {
+        if (layout.stripeSize <= 0)
+            layout.stripeSize = d.optimalStripeSize();
+
+        switch (layout.type) {
+        case LayoutType::Striped:
+            args << QStringLiteral("--type") << QStringLiteral("striped");
+            break;
+        case LayoutType::Raid0:
+            args << QStringLiteral("--type") << QStringLiteral("raid0");
+            break;
+        case LayoutType::Raid10:
+            args << QStringLiteral("--type") << QStringLiteral("raid10") << QStringLiteral("--mirrors") << QStringLiteral("1");
+            break;
+        case LayoutType::Linear:
+        case LayoutType::Thin:
+            break;
+        }
+
+        args << QStringLiteral("--stripes") << QString::number(layout.stripes)
+             << QStringLiteral("--stripesize") << QString::number(layout.stripeSize / 1024) + QLatin1Char('k');
+    }
+
+    args << d.name();
+
+    ExternalCommand cmd(report, QStringLiteral("lvm"), args);
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return false;
+
+    d.setVolumeLayout(p.partitionPath(), layout);
+    if (layout.type == LayoutType::Thin)
+        checkThinPoolUsage(report, d.name(), layout.thinPool);
+    return true;
+}
+
+/** lvcreate options for snapshots of frozen file systems.
+
+    LVM archives the VG metadata in /etc/lvm before changing it. That write
+    would wait forever if the frozen file system holds /etc.
+*/
+static QStringList frozenOriginArgs(bool frozen)
 {
+    if (!frozen)
+        return {};
+    return { QStringLiteral("--config"), QStringLiteral("backup { archive = 0 backup = 0 }") };
+}
+
+/** Creates a snapshot of a LV.
+
+    Snapshots of thin LVs are thin snapshots, which share the pool with their
+    origin and need neither preallocated extents nor copies on origin writes.
+    Other LVs get a classic copy-on-write snapshot of the given size.
+
+    @param frozen true if the file system on the LV is frozen, which skips everything lvcreate does not need.
+                  The layout of the LV is not read then, callers pick createThinSnapshot() for thin LVs before freezing.
+*/
+bool LvmDevice::createLVSnapshot(Report& report, Partition& p, const QString& name, const qint64 extents, bool frozen)
+{
+    if (!frozen) {
+        const LvmTopology topology = LvmTopology::current();
+        const LvmTopology::LogicalVolume* lv = topology.logicalVolume(p.partitionPath());
+        if (lv && lv->layout.split(QLatin1Char(',')).contains(QStringLiteral("thin")))
+            return createThinSnapshot(report, p, name, frozen);
+    }
+
     QString numExtents = (extents > 0) ? QString::number(extents) :
         QString::number(p.length());
     ExternalCommand cmd(report, QStringLiteral("lvm"),
-            { QStringLiteral("lvcreate"),
-              QStringLiteral("--yes"),
-              QStringLiteral("--extents"),
-              numExtents,
-              QStringLiteral("--snapshot"),
-              QStringLiteral("--name"),
-              name,
-              p.partitionPath() });
+            QStringList { QStringLiteral("lvcreate"),
+                          QStringLiteral("--yes") }
+            << frozenOriginArgs(frozen)
+            << QStringList { QStringLiteral("--extents"),
+                             numExtents,
+                             QStringLiteral("--snapshot"),
+                             QStringLiteral("--name"),
+                             name,
+                             p.partitionPath() });
+    return (cmd.run(-1) && cmd.exitCode() == 0);
+}
+
+/** Creates a thin pool.
+    @param d the volume group to allocate the pool from
+    @param poolName name of the new pool
+    @param extents size of the data area of the pool
+    @param settings metadata size, chunk size and zeroing of the pool
+*/
+bool LvmDevice::createThinPool(Report& report, LvmDevice& d, const QString& poolName, qint64 extents, const ThinPoolSettings& settings)
+{
+    QStringList args = { QStringLiteral("lvcreate"),
+                         QStringLiteral("--yes"),
+                         QStringLiteral("--type"),
+                         QStringLiteral("thin-pool"),
+                         QStringLiteral("--extents"),
+                         QString::number(extents),
+                         QStringLiteral("--zero"),
+                         settings.zero ? QStringLiteral("y") : QStringLiteral("n") };
+    if (settings.metadataSize > 0)
+        args << QStringLiteral("--poolmetadatasize") << QString::number(settings.metadataSize) + QLatin1Char('b');
+    if (settings.chunkSize > 0)
+        args << QStringLiteral("--chunksize") << QString::number(settings.chunkSize / 1024) + QLatin1Char('k');
+    args << QStringLiteral("--name") << poolName << d.name();
+
+    ExternalCommand cmd(report, QStringLiteral("lvm"), args);
     return (cmd.run(-1) && cmd.exitCode() == 0);
 }
 
+/** Creates a thin snapshot of a thin LV.
+
+    LVM marks thin snapshots to be skipped on activation, they are created
+    without that flag so they can be mounted right away.
+*/
+bool LvmDevice::createThinSnapshot(Report& report, const Partition& origin, const QString& name, bool frozen)
+{
+    ExternalCommand cmd(report, QStringLiteral("lvm"),
+            QStringList { QStringLiteral("lvcreate"),
+                          QStringLiteral("--yes") }
+            << frozenOriginArgs(frozen)
+            << QStringList { QStringLiteral("--snapshot"),
+                             QStringLiteral("--setactivationskip"),
+                             QStringLiteral("n"),
+                             QStringLiteral("--name"),
+                             name,
+                             origin.partitionPath() });
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return false;
+
+    if (frozen)
+        return true;
+
+    const LvmTopology topology = LvmTopology::current();
+    if (const LvmTopology::LogicalVolume* lv = topology.logicalVolume(origin.partitionPath()))
+        checkThinPoolUsage(report, lv->vgName, lv->poolLv);
+    return true;
+}
+
 bool LvmDevice::resizeLV(Report& report, Partition& p)
 {
     ExternalCommand cmd(report, QStringLiteral("lvm"),
@@ -463,6 +791,154 @@ bool LvmDevice::movePV(Report& report, const QString& pvPath, const QStringList&
     return (cmd.run(-1) && cmd.exitCode() == 0);
 }
 
+/** Starts a planned move in the background and returns as soon as pvmove has set it up.
+    @see movePVProgress
+*/
+bool LvmDevice::startMovePV(Report& report, const LvmMovePlanner::Move& move)
+{
+    if (move.extents <= 0)
+        return true;
+
+    QStringList args = { QStringLiteral("pvmove"), QStringLiteral("--background"), LvmMovePlanner::sourceArgument(move) };
+    args << LvmMovePlanner::destinationArguments(move);
+
+    ExternalCommand cmd(report, QStringLiteral("lvm"), args);
+    return (cmd.run(-1) && cmd.exitCode() == 0);
+}
+
+/** Stops the background moves off a PV.
+
+    Extents that were copied completely stay on their destination, the rest
+    stays where it was.
+*/
+bool LvmDevice::abortMovePV(Report& report, const QString& pvPath)
+{
+    ExternalCommand cmd(report, QStringLiteral("lvm"), { QStringLiteral("pvmove"), QStringLiteral("--abort"), pvPath });
+    return (cmd.run(-1) && cmd.exitCode() == 0);
+}
+
+/** Reads how far the running pvmoves of a Volume Group are.
+
+    A move that is no longer listed has finished.
+
+    @param vgName name of the Volume Group
+    @param progress percentage copied so far, keyed by the source PV
+    @return false if lvs could not be run
+*/
+bool LvmDevice::movePVProgress(const QString& vgName, QMap<QString, qreal>& progress)
+{
+    ExternalCommand cmd(QStringLiteral("lvm"),
+            { QStringLiteral("lvs"),
+              QStringLiteral("--all"),
+              QStringLiteral("--noheadings"),
+              QStringLiteral("--separator"),
+              QStringLiteral("|"),
+              QStringLiteral("--options"),
+              QStringLiteral("move_pv,copy_percent"),
+              QStringLiteral("--select"),
+              QStringLiteral("lv_attr=~^p"),
+              vgName });
+
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return false;
+
+    progress.clear();
+    for (const auto &line : cmd.output().split(QLatin1Char('\n'), QString::SkipEmptyParts)) {
+        const QStringList fields = line.trimmed().split(QLatin1Char('|'));
+        if (fields.size() == 2 && !fields[0].isEmpty())
+            progress.insert(fields[0], fields[1].toDouble());
+    }
+    return true;
+}
+
+/** Puts a cache on a faster PV in front of a LV.
+
+    The cache is a new LV named after the cached one with a "_cache" suffix.
+    It is removed again if it cannot be attached.
+
+    @param d the volume group of the LV and of cachePV
+    @param p the LV to cache
+    @param cachePV the PV the cache is allocated on, usually an SSD
+    @param cacheExtents size of the cache
+    @param settings cache type and options
+*/
+bool LvmDevice::attachCache(Report& report, LvmDevice& d, const Partition& p, const QString& cachePV, qint64 cacheExtents, const CacheSettings& settings)
+{
+    const QString cacheName = p.partitionPath().section(QLatin1Char('/'), -1) + QStringLiteral("_cache");
+    const QString cacheLV = d.name() + QLatin1Char('/') + cacheName;
+
+    QStringList createArgs = { QStringLiteral("lvcreate"),
+                               QStringLiteral("--yes"),
+                               QStringLiteral("--extents"),
+                               QString::number(cacheExtents),
+                               QStringLiteral("--name"),
+                               cacheName };
+    QStringList convertArgs = { QStringLiteral("lvconvert"), QStringLiteral("--yes") };
+
+    if (settings.type == CacheType::WriteCache) {
+        convertArgs << QStringLiteral("--type") << QStringLiteral("writecache")
+                    << QStringLiteral("--cachevol") << cacheLV;
+    } else {
+        createArgs << QStringLiteral("--type") << QStringLiteral("cache-pool");
+        if (settings.chunkSize > 0)
+            createArgs << QStringLiteral("--chunksize") << QString::number(settings.chunkSize / 1024) + QLatin1Char('k');
+
+        convertArgs << QStringLiteral("--type") << QStringLiteral("cache")
+                    << QStringLiteral("--cachepool") << cacheLV
+                    << QStringLiteral("--cachemode") << (settings.mode == CacheMode::WriteBack ? QStringLiteral("writeback") : QStringLiteral("writethrough"));
+        if (!settings.policy.isEmpty())
+            convertArgs << QStringLiteral("--cachepolicy") << settings.policy;
+    }
+
+    createArgs << d.name() << cachePV;
+    convertArgs << p.partitionPath();
+
+    ExternalCommand createCmd(report, QStringLiteral("lvm"), createArgs);
+    if (!createCmd.run(-1) || createCmd.exitCode() != 0)
+        return false;
+
+    ExternalCommand convertCmd(report, QStringLiteral("lvm"), convertArgs);
+    if (convertCmd.run(-1) && convertCmd.exitCode() == 0)
+        return true;
+
+    ExternalCommand removeCmd(report, QStringLiteral("lvm"),
+            { QStringLiteral("lvremove"),
+              QStringLiteral("--yes"),
+              cacheLV });
+    removeCmd.run(-1);
+    return false;
+}
+
+/** Removes the cache of a LV after writing back everything that is only in the cache.
+
+    Write back caches are switched to write through first, which makes LVM flush
+    the dirty blocks while the LV stays in use. lvconvert then only has to drop
+    a clean cache.
+*/
+bool LvmDevice::detachCache(Report& report, const Partition& p, const CacheSettings& settings)
+{
+    if (settings.type == CacheType::None)
+        return true;
+
+    if (settings.type == CacheType::Cache && settings.mode == CacheMode::WriteBack) {
+        ExternalCommand flushCmd(report, QStringLiteral("lvm"),
+                { QStringLiteral("lvchange"),
+                  QStringLiteral("--yes"),
+                  QStringLiteral("--cachemode"),
+                  QStringLiteral("writethrough"),
+                  p.partitionPath() });
+        if (!flushCmd.run(-1) || flushCmd.exitCode() != 0)
+            return false;
+    }
+
+    ExternalCommand cmd(report, QStringLiteral("lvm"),
+            { QStringLiteral("lvconvert"),
+              QStringLiteral("--yes"),
+              QStringLiteral("--uncache"),
+              p.partitionPath() });
+    return (cmd.run(-1) && cmd.exitCode() == 0);
+}
+
 bool LvmDevice::createVG(Report& report, const QString vgName, const QVector<const Partition*>& pvList, const qint32 peSize)
 {
     QStringList args = { QStringLiteral("vgcreate"), QStringLiteral("--physicalextentsize"), QString::number(peSize) };
@@ -566,6 +1042,177 @@ const QVector <const Partition*>& LvmDevice::physicalVolumes() const
     return d_ptr->m_PVs;
 }
 
+/** @return where the extents of the LVs of this VG are stored on its PVs */
+const LvmSegmentMap& LvmDevice::segmentMap() const
+{
+    return d_ptr->m_SegmentMap;
+}
+
+/** @return how the extents of a LV are spread over the PVs */
+LvmDevice::VolumeLayout LvmDevice::volumeLayout(const QString& lvPath) const
+{
+    return d_ptr->m_LayoutMap.value(lvPath);
+}
+
+/** Sets the layout of a LV, e.g. of a new LV in the preview. */
+void LvmDevice::setVolumeLayout(const QString& lvPath, const VolumeLayout& layout)
+{
+    d_ptr->m_LayoutMap.insert(lvPath, layout);
+}
+
+/** @return number of PVs lvcreate needs for a layout, every stripe and mirror image goes to its own PV */
+int LvmDevice::requiredPhysicalVolumes(const VolumeLayout& layout)
+{
+    switch (layout.type) {
+    case LayoutType::Striped:
+    case LayoutType::Raid0:
+        return qMax(1, layout.stripes);
+    case LayoutType::Raid10:
+        return 2 * qMax(1, layout.stripes);
+    case LayoutType::Linear:
+    case LayoutType::Thin:
+        break;
+    }
+    return 1;
+}
+
+/** @return number of extents a LV with a layout takes from the VG.
+
+    LVM rounds striped LVs up to whole stripes. Raid10 stores every extent on
+    two images and adds a metadata LV of one extent to each of them. Thin LVs
+    take their extents from the thin pool instead.
+
+    @param extents size of the LV in extents
+*/
+qint64 LvmDevice::requiredExtents(const VolumeLayout& layout, qint64 extents)
+{
+    const int stripes = qMax(1, layout.stripes);
+    const qint64 rounded = (extents + stripes - 1) / stripes * stripes;
+
+    switch (layout.type) {
+    case LayoutType::Striped:
+    case LayoutType::Raid0:
+        return rounded;
+    case LayoutType::Raid10:
+        return 2 * rounded + 2 * stripes;
+    case LayoutType::Thin:
+        return 0;
+    case LayoutType::Linear:
+        break;
+    }
+    return extents;
+}
+
+/** Picks a stripe size from the optimal I/O size the kernel reports for the PVs.
+
+    PVs on hardware RAID or md report their full stripe width, which is the
+    largest request that does not need a read-modify-write cycle on them.
+    If that is not a power of two, e.g. on RAID 5 with three data disks, the largest power
+    of two it is a multiple of is used, which is the chunk size of such arrays.
+    @return a power of two between 4 KiB and the extent size, 64 KiB if no PV reports an optimal I/O size
+*/
+qint64 LvmDevice::optimalStripeSize() const
+{
+    qint64 ioSize = 0;
+    for (const auto &pvNode : deviceNodes()) {
+        const QString name = QFileInfo(QFileInfo(pvNode).canonicalFilePath()).fileName();
+        QFile file(QStringLiteral("/sys/class/block/") + name + QStringLiteral("/queue/optimal_io_size"));
+        if (file.open(QIODevice::ReadOnly))
+            ioSize = qMax(ioSize, file.readAll().trimmed().toLongLong());
+    }
+
+    if (ioSize <= 0)
+        return 64 * 1024;
+
+    // Rounding down to a power of two would not divide the stripe width, keep to its chunks
+    ioSize &= -ioSize;
+
+    qint64 stripeSize = 4096;
+    while (stripeSize * 2 <= ioSize && stripeSize * 2 <= peSize())
+        stripeSize *= 2;
+    return stripeSize;
+}
+
+/** @return virtual size of the thin LVs in extents, they are laid out in the partition table but take no extents of the VG */
+qint64 LvmDevice::thinExtents() const
+{
+    return d_ptr->m_thinExtents;
+}
+
+void LvmDevice::setThinExtents(qint64 extents)
+{
+    d_ptr->m_thinExtents = extents;
+}
+
+/** @return allocated extents no LV shows, e.g. thin pools or the mirrors of raid10 LVs. The partition table leaves them out. */
+qint64 LvmDevice::hiddenExtents() const
+{
+    return d_ptr->m_hiddenExtents;
+}
+
+void LvmDevice::setHiddenExtents(qint64 extents)
+{
+    d_ptr->m_hiddenExtents = extents;
+}
+
+/** @return the thin pools of this volume group as they were when it was scanned */
+const QList<LvmDevice::ThinPool>& LvmDevice::thinPools() const
+{
+    return d_ptr->m_ThinPools;
+}
+
+/** @return how a LV is cached, type is CacheType::None for LVs without cache */
+LvmDevice::CacheSettings LvmDevice::cacheSettings(const QString& lvPath) const
+{
+    return d_ptr->m_CacheMap.value(lvPath);
+}
+
+void LvmDevice::setCacheSettings(const QString& lvPath, const CacheSettings& settings)
+{
+    if (settings.type == CacheType::None)
+        d_ptr->m_CacheMap.remove(lvPath);
+    else
+        d_ptr->m_CacheMap.insert(lvPath, settings);
+}
+
+/** Plans emptying PVs that leave this volume group.
+    @param removed PVs of this volume group that are going to be removed
+    @param inserted PVs that are going to be added before the moves run
+    @return the moves with the fewest extents moved, based on the layout at scan time
+*/
+LvmMovePlanner::Plan LvmDevice::planPVRemoval(const QList<const Partition*>& removed, const QList<const Partition*>& inserted) const
+{
+    QList<LvmMovePlanner::Volume> volumes;
+    for (const auto &p : physicalVolumes()) {
+        FS::lvm2_pv* lvm2PVFs;
+        innerFS(p, lvm2PVFs);
+
+        LvmMovePlanner::Volume volume;
+        volume.name = physicalVolumeNode(p);
+        volume.extentCount = lvm2PVFs ? lvm2PVFs->totalPE() : 0;
+        volume.allocatedExtents = lvm2PVFs ? lvm2PVFs->allocatedPE() : 0;
+        volume.remove = removed.contains(p);
+        volumes.append(volume);
+    }
+
+    const LvmTopology topology = LvmTopology::current();
+    for (const auto &p : inserted) {
+        if (physicalVolumes().contains(p))
+            continue;
+
+        LvmMovePlanner::Volume volume;
+        volume.name = physicalVolumeNode(p);
+
+        // Label and metadata come before the first extent, pvcreate aligns it to 1 MiB by default
+        const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(volume.name);
+        const qint64 extentStart = pv && pv->extentStart > 0 ? pv->extentStart : Capacity::unitFactor(Capacity::Unit::Byte, Capacity::Unit::MiB);
+        volume.extentCount = qMax(0LL, (p->capacity() - extentStart) / peSize());
+        volumes.append(volume);
+    }
+
+    return LvmMovePlanner::plan(volumes, segmentMap(), peSize());
+}
+
 std::unique_ptr<QHash<QString, qint64>>& LvmDevice::LVSizeMap() const
 {
     return d_ptr->m_LVSizeMap;
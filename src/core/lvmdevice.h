@@ -20,10 +20,13 @@
 #define KPMCORE_LVMDEVICE_H
 
 #include "core/device.h"
+#include "core/lvmmoveplanner.h"
+#include "core/lvmsegmentmap.h"
 #include "core/volumemanagerdevice.h"
 #include "util/libpartitionmanagerexport.h"
 
 #include <QHash>
+#include <QMap>
 #include <QString>
 #include <QObject>
 #include <QStringList>
@@ -47,6 +50,57 @@ class LIBKPMCORE_EXPORT LvmDevice : public VolumeManagerDevice
 
     friend class VolumeManagerDevice;
 
+public:
+    enum class LayoutType {
+        Linear,
+        Striped,
+        Raid0,
+        Raid10,  /**< striped over mirrored pairs */
+        Thin     /**< thinly provisioned from a thin pool */
+    };
+
+    /** How the extents of a logical volume are spread over the physical volumes */
+    struct VolumeLayout {
+        LayoutType type = LayoutType::Linear;
+        int stripes = 1;       /**< number of data stripes */
+        qint64 stripeSize = 0; /**< in bytes, 0 picks it from the I/O size of the PVs */
+        QString thinPool;      /**< name of the pool of thin LVs */
+    };
+
+    struct ThinPoolSettings {
+        qint64 metadataSize = 0; /**< in bytes, 0 lets LVM choose */
+        qint64 chunkSize = 0;    /**< in bytes, 0 lets LVM choose */
+        bool zero = true;        /**< zero newly provisioned chunks */
+    };
+
+    /** A thin pool and how full it is */
+    struct ThinPool {
+        QString name;
+        qint64 size = 0;             /**< data size in bytes */
+        qint64 metadataSize = 0;     /**< in bytes */
+        double dataPercent = -1;     /**< -1 if the pool is not active */
+        double metadataPercent = -1;
+    };
+
+    enum class CacheType {
+        None,
+        Cache,      /**< dm-cache with a cache pool */
+        WriteCache  /**< dm-writecache with a cache volume */
+    };
+
+    enum class CacheMode {
+        WriteThrough,
+        WriteBack
+    };
+
+    /** How a logical volume is cached on a faster physical volume */
+    struct CacheSettings {
+        CacheType type = CacheType::None;
+        CacheMode mode = CacheMode::WriteThrough; /**< writecache is always write back */
+        qint64 chunkSize = 0; /**< in bytes, 0 lets LVM choose */
+        QString policy;       /**< e.g. "smq", empty lets LVM choose */
+    };
+
 public:
     LvmDevice(const QString& name, const QString& iconName = QString());
     ~LvmDevice();
@@ -72,8 +126,11 @@ public:
     static qint64 getTotalLE(const QString& lvPath);
 
     static bool removeLV(Report& report, LvmDevice& d, Partition& p);
-    static bool createLV(Report& report, LvmDevice& d, Partition& p, const QString& lvName);
-    static bool createLVSnapshot(Report& report, Partition& p, const QString& name, const qint64 extents = 0);
+    static bool removeLV(Report& report, const QString& lvPath);
+    static bool createLV(Report& report, LvmDevice& d, Partition& p, const QString& lvName, VolumeLayout layout = VolumeLayout());
+    static bool createLVSnapshot(Report& report, Partition& p, const QString& name, const qint64 extents = 0, bool frozen = false);
+    static bool createThinPool(Report& report, LvmDevice& d, const QString& poolName, qint64 extents, const ThinPoolSettings& settings);
+    static bool createThinSnapshot(Report& report, const Partition& origin, const QString& name, bool frozen = false);
     static bool resizeLV(Report& report, Partition& p);
     static bool deactivateLV(Report& report, const Partition& p);
     static bool activateLV(const QString& deviceNode);
@@ -81,6 +138,12 @@ public:
     static bool removePV(Report& report, LvmDevice& d, const QString& pvPath);
     static bool insertPV(Report& report, LvmDevice& d, const QString& pvPath);
     static bool movePV(Report& report, const QString& pvPath, const QStringList& destinations = QStringList());
+    static bool startMovePV(Report& report, const LvmMovePlanner::Move& move);
+    static bool abortMovePV(Report& report, const QString& pvPath);
+    static bool movePVProgress(const QString& vgName, QMap<QString, qreal>& progress);
+
+    static bool attachCache(Report& report, LvmDevice& d, const Partition& p, const QString& cachePV, qint64 cacheExtents, const CacheSettings& settings);
+    static bool detachCache(Report& report, const Partition& p, const CacheSettings& settings);
 
     static bool removeVG(Report& report, LvmDevice& d);
     static bool createVG(Report& report, const QString vgName, const QVector<const Partition*>& pvList, const qint32 peSize = 4); // peSize in megabytes
@@ -102,6 +165,20 @@ public:
     QString UUID() const;
     QVector <const Partition*>& physicalVolumes();
     const QVector <const Partition*>& physicalVolumes() const;
+    const LvmSegmentMap& segmentMap() const;
+    VolumeLayout volumeLayout(const QString& lvPath) const;
+    void setVolumeLayout(const QString& lvPath, const VolumeLayout& layout);
+    static int requiredPhysicalVolumes(const VolumeLayout& layout);
+    static qint64 requiredExtents(const VolumeLayout& layout, qint64 extents);
+    qint64 optimalStripeSize() const;
+    const QList<ThinPool>& thinPools() const;
+    qint64 thinExtents() const;
+    void setThinExtents(qint64 extents);
+    qint64 hiddenExtents() const;
+    void setHiddenExtents(qint64 extents);
+    CacheSettings cacheSettings(const QString& lvPath) const;
+    void setCacheSettings(const QString& lvPath, const CacheSettings& settings);
+    LvmMovePlanner::Plan planPVRemoval(const QList<const Partition*>& removed, const QList<const Partition*>& inserted = QList<const Partition*>()) const;
 
 protected:
     std::unique_ptr<QHash<QString, qint64>>& LVSizeMap() const;
@@ -0,0 +1,335 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "core/lvmmoveplanner.h"
+
+#include "core/lvmsegmentmap.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+struct FreeRange {
+    QString pvName;
+    qint64 first;
+    qint64 size;
+};
+
+struct Piece {
+    qint64 first;
+    qint64 size;
+    LvmSegmentMap::Area area; /**< empty lvUuid if the layout is unknown */
+};
+
+typedef QHash<QString, QList<LvmSegmentMap::Area>> Placements; /**< key: LV UUID */
+
+}
+
+/** Unallocated extents of a PV that stays in the volume group */
+static void appendFreeRanges(std::vector<FreeRange>& free, const LvmMovePlanner::Volume& volume, const LvmSegmentMap& segmentMap)
+{
+    const QList<LvmSegmentMap::Area> areas = segmentMap.physicalVolumeAreas(volume.name);
+
+    // Without a layout assume the allocated extents are at the start of the PV
+    if (areas.isEmpty()) {
+        if (volume.extentCount > volume.allocatedExtents)
+            free.push_back({ volume.name, qMax(volume.allocatedExtents, 0LL), volume.extentCount - qMax(volume.allocatedExtents, 0LL) });
+        return;
+    }
+
+    qint64 next = 0;
+    for (const auto &area : areas) {
+        if (area.pvStart > next)
+            free.push_back({ volume.name, next, area.pvStart - next });
+        next = qMax(next, area.pvStart + area.extents);
+    }
+    if (volume.extentCount > next)
+        free.push_back({ volume.name, next, volume.extentCount - next });
+}
+
+/** @return PVs that hold another stripe of the segment of area or another image of its LV, now or after the planned moves */
+static QSet<QString> conflictingVolumes(const LvmSegmentMap::Area& area, const LvmSegmentMap& segmentMap, const Placements& placed)
+{
+    QSet<QString> volumes;
+    if (area.lvUuid.isEmpty())
+        return volumes;
+
+    if (area.stripes > 1) {
+        const QList<LvmSegmentMap::Area> stripes = segmentMap.logicalVolumeAreas(area.lvUuid) + placed.value(area.lvUuid);
+        for (const auto &stripe : stripes)
+            if (stripe.lvStart == area.lvStart && stripe.stripe != area.stripe)
+                volumes.insert(stripe.pvName);
+    }
+
+    for (const auto &image : segmentMap.siblingImages(area.lvUuid)) {
+        const QList<LvmSegmentMap::Area> areas = segmentMap.logicalVolumeAreas(image) + placed.value(image);
+        for (const auto &other : areas)
+            volumes.insert(other.pvName);
+    }
+
+    return volumes;
+}
+
+/** @return the smallest free range outside of excluded that holds size extents or else the largest one, nullptr if nothing is free */
+static FreeRange* bestFit(std::vector<FreeRange>& free, qint64 size, const QSet<QString>& excluded)
+{
+    FreeRange* fitting = nullptr;
+    FreeRange* largest = nullptr;
+    for (auto &range : free) {
+        if (range.size <= 0 || excluded.contains(range.pvName))
+            continue;
+        if (range.size >= size && (!fitting || range.size < fitting->size))
+            fitting = &range;
+        if (!largest || range.size > largest->size)
+            largest = &range;
+    }
+    return fitting ? fitting : largest;
+}
+
+static void mergeRanges(QList<QPair<qint64, qint64>>& ranges)
+{
+    std::sort(ranges.begin(), ranges.end());
+
+    QList<QPair<qint64, qint64>> merged;
+    for (const auto &range : qAsConst(ranges)) {
+        if (!merged.isEmpty() && merged.last().second + 1 >= range.first)
+            merged.last().second = qMax(merged.last().second, range.second);
+        else
+            merged.append(range);
+    }
+    ranges = merged;
+}
+
+static void mergeDestinations(QList<LvmMovePlanner::Destination>& ranges)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const LvmMovePlanner::Destination& a, const LvmMovePlanner::Destination& b) {
+        return a.pvName != b.pvName ? a.pvName < b.pvName : a.first < b.first;
+    });
+
+    QList<LvmMovePlanner::Destination> merged;
+    for (const auto &range : qAsConst(ranges)) {
+        if (!merged.isEmpty() && merged.last().pvName == range.pvName && merged.last().last + 1 >= range.first)
+            merged.last().last = qMax(merged.last().last, range.last);
+        else
+            merged.append(range);
+    }
+    ranges = merged;
+}
+
+/** Plans moving all extents off the PVs marked for removal.
+
+    @param volumes all PVs of the volume group after the change, including the ones to remove and new ones
+    @param segmentMap current layout of the volume group
+    @param extentSize size of one extent in bytes
+    @return the pvmove calls in the order they should run; possible is false if
+            the remaining PVs do not have enough free extents
+*/
+LvmMovePlanner::Plan LvmMovePlanner::plan(const QList<Volume>& volumes, const LvmSegmentMap& segmentMap, qint64 extentSize)
+{
+    Plan result;
+
+    std::vector<FreeRange> free;
+    QList<Volume> sources;
+    for (const auto &volume : volumes) {
+        if (volume.remove)
+            sources.append(volume);
+        else
+            appendFreeRanges(free, volume, segmentMap);
+    }
+
+    // Emptying the least used PVs first frees them with the fewest moves done so far
+    std::stable_sort(sources.begin(), sources.end(), [](const Volume& a, const Volume& b) {
+        return a.allocatedExtents != b.allocatedExtents ? a.allocatedExtents < b.allocatedExtents : a.name < b.name;
+    });
+
+    QHash<QString, int> batches;
+    Placements placed;
+    for (const auto &source : qAsConst(sources)) {
+        result.removalOrder.append(source.name);
+        if (source.allocatedExtents <= 0)
+            continue;
+
+        const QList<LvmSegmentMap::Area> areas = segmentMap.physicalVolumeAreas(source.name);
+        const bool knownLayout = !areas.isEmpty();
+
+        std::vector<Piece> pieces;
+        if (knownLayout)
+            for (const auto &area : areas)
+                pieces.push_back({ area.pvStart, area.extents, area });
+        else
+            pieces.push_back({ 0, source.allocatedExtents, LvmSegmentMap::Area() });
+
+        std::stable_sort(pieces.begin(), pieces.end(), [](const Piece& a, const Piece& b) { return a.size > b.size; });
+
+        for (const auto &piece : pieces) {
+            const QSet<QString> excluded = conflictingVolumes(piece.area, segmentMap, placed);
+            qint64 first = piece.first;
+            qint64 remaining = piece.size;
+            while (remaining > 0) {
+                FreeRange* range = bestFit(free, remaining, excluded);
+                if (!range) {
+                    result.possible = false;
+                    break;
+                }
+
+                const qint64 taken = qMin(remaining, range->size);
+                const QString key = knownLayout ? source.name + QLatin1Char('\n') + range->pvName : source.name;
+                auto batch = batches.constFind(key);
+                if (batch == batches.cend()) {
+                    Move move;
+                    move.source = source.name;
+                    batch = batches.insert(key, result.moves.size());
+                    result.moves.append(move);
+                }
+
+                Move& move = result.moves[*batch];
+                if (!move.destinations.contains(range->pvName))
+                    move.destinations.append(range->pvName);
+                if (knownLayout)
+                    move.ranges.append(qMakePair(first, first + taken - 1));
+                move.destinationRanges.append(Destination { range->pvName, range->first, range->first + taken - 1 });
+                move.extents += taken;
+
+                if (!piece.area.lvUuid.isEmpty()) {
+                    LvmSegmentMap::Area area = piece.area;
+                    area.pvName = range->pvName;
+                    area.pvStart = range->first;
+                    area.extents = taken;
+                    placed[area.lvUuid].append(area);
+                }
+
+                range->first += taken;
+                range->size -= taken;
+                first += taken;
+                remaining -= taken;
+            }
+        }
+    }
+
+    for (auto &move : result.moves) {
+        mergeRanges(move.ranges);
+        mergeDestinations(move.destinationRanges);
+        result.extentsMoved += move.extents;
+    }
+    result.bytesMoved = result.extentsMoved * extentSize;
+
+    return result;
+}
+
+/** @return source PV argument of pvmove, restricted to the extent ranges of the move */
+QString LvmMovePlanner::sourceArgument(const Move& move)
+{
+    QString argument = move.source;
+    for (const auto &range : move.ranges)
+        argument += QLatin1Char(':') + QString::number(range.first) + QLatin1Char('-') + QString::number(range.second);
+    return argument;
+}
+
+/** @return destination PV arguments of pvmove, restricted to the extents the planner reserved */
+QStringList LvmMovePlanner::destinationArguments(const Move& move)
+{
+    QStringList arguments;
+    for (const auto &pvName : move.destinations) {
+        QString argument = pvName;
+        for (const auto &range : move.destinationRanges)
+            if (range.pvName == pvName)
+                argument += QLatin1Char(':') + QString::number(range.first) + QLatin1Char('-') + QString::number(range.last);
+        arguments.append(argument);
+    }
+    return arguments;
+}
+
+/** Splits a move into moves of at most maxExtents extents each.
+    Moves of everything on the source cannot be split.
+*/
+QList<LvmMovePlanner::Move> LvmMovePlanner::split(const Move& move, qint64 maxExtents)
+{
+    if (maxExtents <= 0 || move.ranges.isEmpty() || move.extents <= maxExtents)
+        return { move };
+
+    QList<Move> moves;
+    Move part = move;
+    part.ranges.clear();
+    part.extents = 0;
+
+    for (const auto &range : move.ranges) {
+        qint64 first = range.first;
+        while (first <= range.second) {
+            const qint64 last = qMin(range.second, first + maxExtents - part.extents - 1);
+            part.ranges.append(qMakePair(first, last));
+            part.extents += last - first + 1;
+            first = last + 1;
+
+            if (part.extents == maxExtents) {
+                moves.append(part);
+                part.ranges.clear();
+                part.extents = 0;
+            }
+        }
+    }
+    if (part.extents > 0)
+        moves.append(part);
+
+    // Hand the reserved destination extents out to the parts in order
+    int index = 0;
+    qint64 next = move.destinationRanges.isEmpty() ? 0 : move.destinationRanges.first().first;
+    for (auto &piece : moves) {
+        piece.destinations.clear();
+        piece.destinationRanges.clear();
+
+        qint64 needed = piece.extents;
+        while (needed > 0 && index < move.destinationRanges.size()) {
+            const Destination& range = move.destinationRanges.at(index);
+            const qint64 last = qMin(range.last, next + needed - 1);
+            piece.destinationRanges.append(Destination { range.pvName, next, last });
+            if (!piece.destinations.contains(range.pvName))
+                piece.destinations.append(range.pvName);
+            needed -= last - next + 1;
+
+            if (last < range.last)
+                next = last + 1;
+            else if (++index < move.destinationRanges.size())
+                next = move.destinationRanges.at(index).first;
+        }
+        if (piece.destinations.isEmpty())
+            piece.destinations = move.destinations;
+    }
+
+    return moves;
+}
+
+/** @return UUIDs of the LVs that have extents in the ranges of the move */
+QStringList LvmMovePlanner::logicalVolumes(const Move& move, const LvmSegmentMap& segmentMap)
+{
+    QStringList uuids;
+    for (const auto &area : segmentMap.physicalVolumeAreas(move.source)) {
+        const qint64 last = area.pvStart + area.extents - 1;
+        bool touched = move.ranges.isEmpty();
+        for (const auto &range : move.ranges)
+            touched = touched || (area.pvStart <= range.second && last >= range.first);
+
+        if (touched && !uuids.contains(area.lvUuid))
+            uuids.append(area.lvUuid);
+    }
+    return uuids;
+}
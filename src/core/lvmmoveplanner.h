@@ -0,0 +1,94 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#ifndef KPMCORE_LVMMOVEPLANNER_H
+#define KPMCORE_LVMMOVEPLANNER_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+class LvmSegmentMap;
+
+/** Plans which extents pvmove has to move when physical volumes leave a volume group.
+
+    Every allocated extent of a removed PV is moved exactly once, straight to a
+    PV that stays in the volume group, so nothing is ever copied onto a PV that
+    is going to be removed later. PVs are emptied in order of increasing
+    allocation. Areas are placed largest first into the smallest free range that
+    holds them completely and are only split when no such range is left.
+
+    Stripes of one segment and the images of a RAID or mirror LV are never placed
+    on the same PV, pvmove refuses to put them together.
+
+    Moves from one source to one destination are batched into a single pvmove
+    call with a list of extent ranges on both PVs, so LVM allocates exactly
+    the extents picked here. Moves can be split into smaller ones to
+    throttle them, and moves that touch neither the same PVs nor the same LVs
+    can run at the same time.
+*/
+class LIBKPMCORE_EXPORT LvmMovePlanner
+{
+    LvmMovePlanner() = delete;
+
+public:
+    /** A physical volume of the target layout */
+    struct Volume {
+        QString name;
+        qint64 extentCount = 0;
+        qint64 allocatedExtents = 0;
+        bool remove = false; /**< true if the PV leaves the volume group */
+    };
+
+    /** Extents reserved for a move on a destination PV */
+    struct Destination {
+        QString pvName;
+        qint64 first = 0;
+        qint64 last = 0;
+    };
+
+    /** One pvmove call */
+    struct Move {
+        QString source;
+        QStringList destinations; /**< a single PV unless the layout of the source is unknown */
+        QList<QPair<qint64, qint64>> ranges; /**< first and last extent on source; empty to move everything */
+        QList<Destination> destinationRanges; /**< first and last extent on the destinations */
+        qint64 extents = 0;
+    };
+
+    struct Plan {
+        QList<Move> moves;
+        QStringList removalOrder;
+        qint64 extentsMoved = 0;
+        qint64 bytesMoved = 0;
+        bool possible = true;
+    };
+
+public:
+    static Plan plan(const QList<Volume>& volumes, const LvmSegmentMap& segmentMap, qint64 extentSize);
+    static QString sourceArgument(const Move& move);
+    static QStringList destinationArguments(const Move& move);
+    static QList<Move> split(const Move& move, qint64 maxExtents);
+    static QStringList logicalVolumes(const Move& move, const LvmSegmentMap& segmentMap);
+};
+
+#endif
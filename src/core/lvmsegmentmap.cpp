@@ -0,0 +1,245 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "core/lvmsegmentmap.h"
+
+#include "core/lvmtopology.h"
+
+#include <QRegularExpression>
+#include <QSet>
+#include <QStringList>
+
+#include <algorithm>
+
+/** Builds the map from the segments in an LVM report.
+    @param topology the LVM report
+    @param vgName only include the LVs and PVs of this VG, all of them if empty
+*/
+LvmSegmentMap::LvmSegmentMap(const LvmTopology& topology, const QString& vgName)
+{
+    QHash<QString, QString> pvNames; // uuid -> name
+    for (const auto &pv : topology.physicalVolumes()) {
+        if (!vgName.isEmpty() && pv.vgName != vgName)
+            continue;
+
+        pvNames.insert(pv.uuid, pv.name);
+        m_PhysicalVolumes[pv.name];
+        m_ExtentCounts.insert(pv.name, pv.extentCount);
+    }
+
+    const QStringList vgNames = vgName.isEmpty() ? topology.volumeGroupNames() : QStringList(vgName);
+    QStringList lvUuids;
+    QSet<QString> knownUuids;
+    for (const auto &name : vgNames) {
+        const LvmTopology::VolumeGroup* vg = topology.volumeGroup(name);
+        if (vg == nullptr)
+            continue;
+
+        for (const auto &lvPath : vg->logicalVolumes)
+            if (const LvmTopology::LogicalVolume* lv = topology.logicalVolume(lvPath)) {
+                lvUuids.append(lv->uuid);
+                knownUuids.insert(lv->uuid);
+            }
+    }
+
+    // RAID and mirror images are hidden LVs named like [lv_rimage_0], metadata of image n is [lv_rmeta_n]
+    const QRegularExpression imageName(QStringLiteral("^\\[?(.+)_(?:rimage|rmeta|mimage)_(\\d+)\\]?$"));
+    for (const auto &name : vgNames)
+        for (const auto &lv : topology.logicalVolumes(name)) {
+            const QRegularExpressionMatch match = imageName.match(lv.name);
+            if (match.hasMatch())
+                m_Images.insert(lv.uuid, qMakePair(name + QLatin1Char('/') + match.captured(1), match.captured(2).toInt()));
+        }
+
+    // Hidden LVs such as RAID images have no path, their PV segments still name them
+    for (auto it = pvNames.cbegin(); it != pvNames.cend(); ++it)
+        for (const auto &pvseg : topology.physicalSegments(it.key()))
+            if (!pvseg.lvUuid.isEmpty() && !knownUuids.contains(pvseg.lvUuid)) {
+                lvUuids.append(pvseg.lvUuid);
+                knownUuids.insert(pvseg.lvUuid);
+            }
+
+    for (const auto &lvUuid : qAsConst(lvUuids)) {
+        for (const auto &segment : topology.segments(lvUuid)) {
+            // devices looks like /dev/sda2(0),/dev/sdb(100) with one entry per stripe
+            const QStringList devices = segment.devices.split(QLatin1Char(','), QString::SkipEmptyParts);
+            for (int stripe = 0; stripe < devices.size(); ++stripe) {
+                const QString& device = devices.at(stripe);
+                const int bracket = device.lastIndexOf(QLatin1Char('('));
+
+                Area area;
+                area.lvUuid = lvUuid;
+                area.pvName = device.left(bracket);
+                area.pvStart = device.mid(bracket + 1, device.size() - bracket - 2).toLongLong();
+                area.lvStart = segment.startExtent;
+                area.stripes = segment.stripes;
+                area.stripe = stripe;
+                area.extents = segment.extents / qMax(1, segment.stripes);
+
+                // Sub LVs of RAID and thin volumes are mapped through their own segments
+                if (bracket > 0 && area.extents > 0 && m_PhysicalVolumes.contains(area.pvName))
+                    insert(area);
+            }
+        }
+    }
+}
+
+/** Adds an area, e.g. to plan where extents will be moved to. */
+void LvmSegmentMap::insert(const Area& area)
+{
+    LogicalSegments& segments = m_LogicalVolumes[area.lvUuid];
+    QList<Area>& stripes = segments[area.lvStart];
+    stripes.append(area);
+    std::sort(stripes.begin(), stripes.end(), [] (const Area& a, const Area& b) { return a.stripe < b.stripe; });
+
+    m_PhysicalVolumes[area.pvName][area.pvStart] = area;
+}
+
+/** Maps an extent of an LV to the PVs.
+    @return one location per stripe, empty if the extent is not mapped to any PV
+*/
+QList<LvmSegmentMap::Location> LvmSegmentMap::physicalExtents(const QString& lvUuid, qint64 lvExtent) const
+{
+    QList<Location> locations;
+
+    const auto lv = m_LogicalVolumes.constFind(lvUuid);
+    if (lv == m_LogicalVolumes.cend())
+        return locations;
+
+    auto it = lv->upper_bound(lvExtent);
+    if (it == lv->cbegin())
+        return locations;
+    --it;
+
+    for (const auto &area : it->second) {
+        const qint64 offset = (lvExtent - area.lvStart) / area.stripes;
+        if (offset >= area.extents)
+            continue;
+
+        Location location;
+        location.pvName = area.pvName;
+        location.extent = area.pvStart + offset;
+        locations.append(location);
+    }
+
+    return locations;
+}
+
+/** Maps an extent of a PV to the LV stored there.
+    @return the location in the LV, with an empty lvUuid if the extent is free
+*/
+LvmSegmentMap::Location LvmSegmentMap::logicalExtent(const QString& pvName, qint64 pvExtent) const
+{
+    Location location;
+
+    const auto pv = m_PhysicalVolumes.constFind(pvName);
+    if (pv == m_PhysicalVolumes.cend())
+        return location;
+
+    auto it = pv->upper_bound(pvExtent);
+    if (it == pv->cbegin())
+        return location;
+    --it;
+
+    const Area& area = it->second;
+    if (pvExtent >= area.pvStart + area.extents)
+        return location;
+
+    location.lvUuid = area.lvUuid;
+    location.extent = area.lvStart + (pvExtent - area.pvStart) * area.stripes + area.stripe;
+    return location;
+}
+
+/** @return the areas of an LV ordered by LV extent, striped segments have one area per stripe */
+QList<LvmSegmentMap::Area> LvmSegmentMap::logicalVolumeAreas(const QString& lvUuid) const
+{
+    QList<Area> areas;
+    for (const auto &segment : m_LogicalVolumes.value(lvUuid))
+        areas.append(segment.second);
+
+    return areas;
+}
+
+/** @return the allocated areas of a PV ordered by PV extent */
+QList<LvmSegmentMap::Area> LvmSegmentMap::physicalVolumeAreas(const QString& pvName) const
+{
+    QList<Area> areas;
+    for (const auto &area : m_PhysicalVolumes.value(pvName))
+        areas.append(area.second);
+
+    return areas;
+}
+
+/** @return first extent and length of all unallocated ranges of a PV */
+QList<QPair<qint64, qint64>> LvmSegmentMap::freeRanges(const QString& pvName) const
+{
+    QList<QPair<qint64, qint64>> ranges;
+
+    qint64 next = 0;
+    for (const auto &area : m_PhysicalVolumes.value(pvName)) {
+        if (area.first > next)
+            ranges.append(qMakePair(next, area.first - next));
+        next = qMax(next, area.first + area.second.extents);
+    }
+
+    const qint64 extentCount = m_ExtentCounts.value(pvName, next);
+    if (extentCount > next)
+        ranges.append(qMakePair(next, extentCount - next));
+
+    return ranges;
+}
+
+/** @return number of allocated extents of a PV between firstExtent and lastExtent inclusive */
+qint64 LvmSegmentMap::allocatedExtents(const QString& pvName, qint64 firstExtent, qint64 lastExtent) const
+{
+    const auto pv = m_PhysicalVolumes.constFind(pvName);
+    if (pv == m_PhysicalVolumes.cend() || lastExtent < firstExtent)
+        return 0;
+
+    // Start with the area that may reach into the range from before
+    auto it = pv->upper_bound(firstExtent);
+    if (it != pv->cbegin())
+        --it;
+
+    qint64 allocated = 0;
+    for (; it != pv->cend() && it->first <= lastExtent; ++it) {
+        const qint64 first = qMax(firstExtent, it->first);
+        const qint64 last = qMin(lastExtent, it->first + it->second.extents - 1);
+        if (last >= first)
+            allocated += last - first + 1;
+    }
+
+    return allocated;
+}
+
+/** @return UUIDs of the other images of the RAID or mirror LV that lvUuid is an image of.
+    Different images must not share a PV.
+*/
+QStringList LvmSegmentMap::siblingImages(const QString& lvUuid) const
+{
+    QStringList uuids;
+
+    const auto image = m_Images.constFind(lvUuid);
+    if (image == m_Images.cend())
+        return uuids;
+
+    for (auto it = m_Images.cbegin(); it != m_Images.cend(); ++it)
+        if (it->first == image->first && it->second != image->second)
+            uuids.append(it.key());
+
+    return uuids;
+}
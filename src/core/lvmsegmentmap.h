@@ -0,0 +1,92 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_LVMSEGMENTMAP_H
+#define KPMCORE_LVMSEGMENTMAP_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <map>
+
+class LvmTopology;
+
+/** Where the extents of LVM logical volumes are stored on the physical volumes.
+
+    Segments are kept in interval maps keyed by their first extent, once per LV
+    and once per PV, so mapping an extent in either direction is O(log n) in the
+    number of segments.
+
+    Striped segments spread every extent over all stripes. Extents are mapped
+    to the part of the segment on each stripe, i.e. LV extent n of a segment
+    with s stripes is at extent n / s of every stripe area.
+*/
+class LIBKPMCORE_EXPORT LvmSegmentMap
+{
+public:
+    /** A contiguous range of extents of one LV on one PV */
+    struct Area {
+        QString lvUuid;
+        QString pvName;
+        qint64 lvStart = 0;  /**< first extent of the segment in the LV */
+        qint64 pvStart = 0;  /**< first extent of this area on the PV */
+        qint64 extents = 0;  /**< number of extents of this area on the PV */
+        int stripes = 1;
+        int stripe = 0;      /**< index of this area among the stripes of its segment */
+    };
+
+    /** An extent on a physical volume (pvName set) or in a logical volume (lvUuid set) */
+    struct Location {
+        QString lvUuid;
+        QString pvName;
+        qint64 extent = -1;
+    };
+
+public:
+    LvmSegmentMap() = default;
+    explicit LvmSegmentMap(const LvmTopology& topology, const QString& vgName = QString());
+
+public:
+    QList<Location> physicalExtents(const QString& lvUuid, qint64 lvExtent) const;
+    Location logicalExtent(const QString& pvName, qint64 pvExtent) const;
+
+    QList<Area> logicalVolumeAreas(const QString& lvUuid) const;
+    QList<Area> physicalVolumeAreas(const QString& pvName) const;
+    QList<QPair<qint64, qint64>> freeRanges(const QString& pvName) const;
+
+    qint64 allocatedExtents(const QString& pvName, qint64 firstExtent, qint64 lastExtent) const;
+    QStringList siblingImages(const QString& lvUuid) const;
+
+    void insert(const Area& area);
+
+private:
+    typedef std::map<qint64, QList<Area>> LogicalSegments; /**< key: first LV extent, value: one area per stripe */
+    typedef std::map<qint64, Area> PhysicalAreas;           /**< key: first PV extent */
+
+    QHash<QString, LogicalSegments> m_LogicalVolumes;
+    QHash<QString, PhysicalAreas> m_PhysicalVolumes;
+    QHash<QString, qint64> m_ExtentCounts;
+    QHash<QString, QPair<QString, int>> m_Images; /**< key: UUID of a RAID or mirror sub LV, value: its LV and image index */
+};
+
+#endif
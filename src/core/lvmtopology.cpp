@@ -0,0 +1,323 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "core/lvmtopology.h"
+
+#include "core/devicepropertycache.h"
+
+#include "util/externalcommand.h"
+
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+struct LvmTopologyPrivate
+{
+    bool m_Valid = false;
+    QStringList m_VGNames;
+    QVector<LvmTopology::VolumeGroup> m_VGs;
+    QVector<LvmTopology::LogicalVolume> m_LVs;
+    QVector<LvmTopology::PhysicalVolume> m_PVs;
+    QHash<QString, int> m_VGIndex;
+    QHash<QString, int> m_LVIndex;
+    QHash<QString, int> m_PVIndex;
+    QHash<QString, QList<LvmTopology::Segment>> m_Segments;
+    QHash<QString, QList<LvmTopology::PhysicalSegment>> m_PhysicalSegments;
+};
+
+static QMutex topologyMutex;
+static LvmTopology scanTopology;
+static quint64 scanTopologyGeneration = 0;
+
+/** LVM prints all values as strings, with --units B --nosuffix numbers are plain bytes */
+static qint64 toNumber(const QJsonObject& object, const char* field)
+{
+    bool ok;
+    const qint64 value = object[QLatin1String(field)].toString().toLongLong(&ok);
+    return ok ? value : -1;
+}
+
+static QString toString(const QJsonObject& object, const char* field)
+{
+    return object[QLatin1String(field)].toString();
+}
+
+/** @return the percentage or -1 if lvm left the field empty */
+static double toPercent(const QJsonObject& object, const char* field)
+{
+    bool ok;
+    const double value = object[QLatin1String(field)].toString().toDouble(&ok);
+    return ok ? value : -1;
+}
+
+/** @return number of stripes without parity and mirror images, older lvm cannot report data_stripes */
+static int dataStripes(const QString& segmentType, int stripes)
+{
+    if (segmentType == QStringLiteral("raid1") || segmentType == QStringLiteral("mirror"))
+        return 1;
+    if (segmentType == QStringLiteral("raid10"))
+        return qMax(1, stripes / 2);
+    if (segmentType.startsWith(QStringLiteral("raid4")) || segmentType.startsWith(QStringLiteral("raid5")))
+        return qMax(1, stripes - 1);
+    if (segmentType.startsWith(QStringLiteral("raid6")))
+        return qMax(1, stripes - 2);
+    return stripes;
+}
+
+/** Constructs an empty, invalid topology */
+LvmTopology::LvmTopology() :
+    d(std::make_shared<LvmTopologyPrivate>())
+{
+}
+
+/** @return the topology of the system, read once per scan */
+LvmTopology LvmTopology::current()
+{
+    const quint64 generation = DevicePropertyCache::scanGeneration();
+    if (generation == 0)
+        return read();
+
+    // Parallel scans of several disks wait for the first one to read the report
+    QMutexLocker locker(&topologyMutex);
+    if (scanTopologyGeneration != generation) {
+        scanTopology = read();
+        scanTopologyGeneration = generation;
+    }
+
+    return scanTopology;
+}
+
+/** Runs lvm fullreport.
+    @return the topology of the system, invalid if lvm failed
+*/
+LvmTopology LvmTopology::read()
+{
+    ExternalCommand cmd(QStringLiteral("lvm"), {
+                        QStringLiteral("fullreport"),
+                        QStringLiteral("--foreign"),
+                        QStringLiteral("--readonly"),
+                        QStringLiteral("--reportformat"), QStringLiteral("json"),
+                        QStringLiteral("--units"), QStringLiteral("B"),
+                        QStringLiteral("--nosuffix"),
+                        QStringLiteral("--configreport"), QStringLiteral("vg"),
+                        QStringLiteral("--options"), QStringLiteral("vg_name,vg_uuid,vg_extent_size,vg_extent_count,vg_free_count"),
+                        QStringLiteral("--configreport"), QStringLiteral("lv"),
+                        QStringLiteral("--options"), QStringLiteral("lv_name,lv_path,lv_uuid,lv_attr,lv_layout,pool_lv,origin,cache_mode,cache_policy,lv_size,lv_metadata_size,data_percent,metadata_percent"),
+                        QStringLiteral("--configreport"), QStringLiteral("pv"),
+                        QStringLiteral("--options"), QStringLiteral("pv_name,pv_uuid,pv_pe_count,pv_pe_alloc_count,pv_used,pe_start"),
+                        QStringLiteral("--configreport"), QStringLiteral("seg"),
+                        QStringLiteral("--options"), QStringLiteral("lv_uuid,segtype,seg_start_pe,seg_size_pe,stripes,stripe_size,chunk_size,devices"),
+                        QStringLiteral("--configreport"), QStringLiteral("pvseg"),
+                        QStringLiteral("--options"), QStringLiteral("pv_uuid,lv_uuid,pvseg_start,pvseg_size") },
+                        QProcess::ProcessChannelMode::SeparateChannels);
+
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return LvmTopology();
+
+    return fromJson(cmd.rawOutput());
+}
+
+/** Builds the topology from the JSON output of lvm fullreport.
+
+    The report has one element per VG with the subreports vg, lv, pv, seg and pvseg.
+    PVs that are not in any VG come in an element with an empty vg subreport.
+    @param report the output of lvm fullreport --reportformat json
+*/
+LvmTopology LvmTopology::fromJson(const QByteArray& report)
+{
+    auto data = std::make_shared<LvmTopologyPrivate>();
+
+    const QJsonDocument document = QJsonDocument::fromJson(report);
+    if (!document.isObject())
+        return LvmTopology();
+
+    const QJsonArray reports = document.object()[QLatin1String("report")].toArray();
+    for (const auto &reportValue : reports) {
+        const QJsonObject vgReport = reportValue.toObject();
+
+        VolumeGroup vg;
+        const QJsonArray vgs = vgReport[QLatin1String("vg")].toArray();
+        if (!vgs.isEmpty()) {
+            const QJsonObject object = vgs.first().toObject();
+            vg.name = toString(object, "vg_name");
+            vg.uuid = toString(object, "vg_uuid");
+            vg.extentSize = toNumber(object, "vg_extent_size");
+            vg.extentCount = toNumber(object, "vg_extent_count");
+            vg.freeCount = toNumber(object, "vg_free_count");
+        }
+
+        const QJsonArray lvs = vgReport[QLatin1String("lv")].toArray();
+        for (const auto &lvValue : lvs) {
+            const QJsonObject object = lvValue.toObject();
+            LogicalVolume lv;
+            lv.name = toString(object, "lv_name");
+            lv.path = toString(object, "lv_path");
+            lv.uuid = toString(object, "lv_uuid");
+            lv.vgName = vg.name;
+            lv.attributes = toString(object, "lv_attr");
+            lv.layout = toString(object, "lv_layout");
+            lv.poolLv = toString(object, "pool_lv");
+            lv.cacheMode = toString(object, "cache_mode");
+            lv.cachePolicy = toString(object, "cache_policy");
+            lv.origin = toString(object, "origin");
+            lv.size = toNumber(object, "lv_size");
+            lv.extents = vg.extentSize > 0 && lv.size >= 0 ? lv.size / vg.extentSize : -1;
+            lv.metadataSize = toNumber(object, "lv_metadata_size");
+            lv.dataPercent = toPercent(object, "data_percent");
+            lv.metadataPercent = toPercent(object, "metadata_percent");
+
+            // Hidden LVs such as thin pool metadata have no path, pools cannot hold file systems
+            if (!lv.path.isEmpty() && !lv.layout.split(QLatin1Char(',')).contains(QStringLiteral("pool"))) {
+                vg.logicalVolumes.append(lv.path);
+                data->m_LVIndex.insert(lv.path, data->m_LVs.size());
+            }
+            data->m_LVs.append(lv);
+        }
+
+        const QJsonArray pvs = vgReport[QLatin1String("pv")].toArray();
+        for (const auto &pvValue : pvs) {
+            const QJsonObject object = pvValue.toObject();
+            PhysicalVolume pv;
+            pv.name = toString(object, "pv_name");
+            pv.uuid = toString(object, "pv_uuid");
+            pv.vgName = vg.name;
+            pv.extentCount = toNumber(object, "pv_pe_count");
+            pv.allocatedExtents = toNumber(object, "pv_pe_alloc_count");
+            pv.extentSize = vg.name.isEmpty() ? 0 : vg.extentSize;
+            pv.used = toNumber(object, "pv_used");
+            pv.extentStart = toNumber(object, "pe_start");
+
+            // kpmcore may know the PV under another path, e.g. /dev/dm-0 instead of /dev/mapper/...
+            vg.physicalVolumes.append(pv.name);
+            data->m_PVIndex.insert(pv.name, data->m_PVs.size());
+            const QString canonicalPath = QFileInfo(pv.name).canonicalFilePath();
+            if (!canonicalPath.isEmpty() && !data->m_PVIndex.contains(canonicalPath))
+                data->m_PVIndex.insert(canonicalPath, data->m_PVs.size());
+            data->m_PVs.append(pv);
+        }
+
+        const QJsonArray segs = vgReport[QLatin1String("seg")].toArray();
+        for (const auto &segValue : segs) {
+            const QJsonObject object = segValue.toObject();
+            Segment seg;
+            seg.lvUuid = toString(object, "lv_uuid");
+            seg.type = toString(object, "segtype");
+            seg.startExtent = toNumber(object, "seg_start_pe");
+            seg.extents = toNumber(object, "seg_size_pe");
+            seg.stripes = qMax<qint64>(1, toNumber(object, "stripes"));
+            seg.dataStripes = dataStripes(seg.type, seg.stripes);
+            seg.stripeSize = qMax<qint64>(0, toNumber(object, "stripe_size"));
+            seg.chunkSize = qMax<qint64>(0, toNumber(object, "chunk_size"));
+            seg.devices = toString(object, "devices");
+            data->m_Segments[seg.lvUuid].append(seg);
+        }
+
+        const QJsonArray pvsegs = vgReport[QLatin1String("pvseg")].toArray();
+        for (const auto &pvsegValue : pvsegs) {
+            const QJsonObject object = pvsegValue.toObject();
+            PhysicalSegment pvseg;
+            pvseg.pvUuid = toString(object, "pv_uuid");
+            pvseg.lvUuid = toString(object, "lv_uuid");
+            pvseg.start = toNumber(object, "pvseg_start");
+            pvseg.size = toNumber(object, "pvseg_size");
+            data->m_PhysicalSegments[pvseg.pvUuid].append(pvseg);
+        }
+
+        if (!vg.name.isEmpty()) {
+            data->m_VGNames.append(vg.name);
+            data->m_VGIndex.insert(vg.name, data->m_VGs.size());
+            data->m_VGs.append(vg);
+        }
+    }
+
+    data->m_Valid = true;
+
+    LvmTopology topology;
+    topology.d = data;
+    return topology;
+}
+
+/** @return false if the report could not be read */
+bool LvmTopology::isValid() const
+{
+    return d->m_Valid;
+}
+
+/** @return names of all volume groups in the order LVM lists them */
+QStringList LvmTopology::volumeGroupNames() const
+{
+    return d->m_VGNames;
+}
+
+/** @return the volume group or nullptr if there is none with this name */
+const LvmTopology::VolumeGroup* LvmTopology::volumeGroup(const QString& vgName) const
+{
+    const int i = d->m_VGIndex.value(vgName, -1);
+    return i < 0 ? nullptr : &d->m_VGs.at(i);
+}
+
+/** @return the logical volume or nullptr if there is none at this path */
+const LvmTopology::LogicalVolume* LvmTopology::logicalVolume(const QString& lvPath) const
+{
+    const int i = d->m_LVIndex.value(lvPath, -1);
+    return i < 0 ? nullptr : &d->m_LVs.at(i);
+}
+
+/** Finds a physical volume by the device node LVM reports or any other path of the same device.
+    @return the physical volume or nullptr if deviceNode is none
+*/
+const LvmTopology::PhysicalVolume* LvmTopology::physicalVolume(const QString& deviceNode) const
+{
+    int i = d->m_PVIndex.value(deviceNode, -1);
+    if (i < 0)
+        i = d->m_PVIndex.value(QFileInfo(deviceNode).canonicalFilePath(), -1);
+
+    return i < 0 ? nullptr : &d->m_PVs.at(i);
+}
+
+/** @return all logical volumes of a volume group, including hidden ones and pools without path */
+QList<LvmTopology::LogicalVolume> LvmTopology::logicalVolumes(const QString& vgName) const
+{
+    QList<LogicalVolume> lvs;
+    for (const auto &lv : qAsConst(d->m_LVs))
+        if (lv.vgName == vgName)
+            lvs.append(lv);
+    return lvs;
+}
+
+/** @return all physical volumes, including the ones not in any volume group */
+QList<LvmTopology::PhysicalVolume> LvmTopology::physicalVolumes() const
+{
+    return d->m_PVs.toList();
+}
+
+/** @return the segments of a logical volume ordered by their first extent */
+QList<LvmTopology::Segment> LvmTopology::segments(const QString& lvUuid) const
+{
+    return d->m_Segments.value(lvUuid);
+}
+
+/** @return the used and free ranges of a physical volume ordered by their first extent */
+QList<LvmTopology::PhysicalSegment> LvmTopology::physicalSegments(const QString& pvUuid) const
+{
+    return d->m_PhysicalSegments.value(pvUuid);
+}
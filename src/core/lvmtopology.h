@@ -0,0 +1,129 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_LVMTOPOLOGY_H
+#define KPMCORE_LVMTOPOLOGY_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <memory>
+
+struct LvmTopologyPrivate;
+
+/** Volume groups, logical and physical volumes and their segments as reported by LVM.
+
+    The whole model comes from a single "lvm fullreport" with JSON output instead of
+    one lvm process per field and volume. While a scan is in progress (see
+    DevicePropertyCache::Scope) current() runs that report only once, outside of a
+    scan every call reads the system again.
+
+    All sizes are in bytes, extent counts are in extents of the volume group.
+*/
+class LIBKPMCORE_EXPORT LvmTopology
+{
+public:
+    struct VolumeGroup {
+        QString name;
+        QString uuid;
+        qint64 extentSize = -1;
+        qint64 extentCount = -1;
+        qint64 freeCount = -1;
+        QStringList logicalVolumes;  /**< paths of the LVs in the order LVM lists them */
+        QStringList physicalVolumes; /**< device nodes of the PVs */
+    };
+
+    struct LogicalVolume {
+        QString name;
+        QString path;
+        QString uuid;
+        QString vgName;
+        QString attributes;
+        QString layout;      /**< e.g. "linear", "cache" or "writecache" */
+        QString poolLv;      /**< the cache pool or cache volume of cached LVs */
+        QString cacheMode;
+        QString cachePolicy;
+        QString origin;      /**< the origin of snapshots */
+        qint64 size = -1;
+        qint64 extents = -1;
+        qint64 metadataSize = -1;    /**< of thin and cache pools */
+        double dataPercent = -1;     /**< usage of thin pools and snapshots */
+        double metadataPercent = -1; /**< metadata usage of thin pools */
+    };
+
+    struct PhysicalVolume {
+        QString name;
+        QString uuid;
+        QString vgName; /**< empty for PVs that are not in any VG */
+        qint64 extentCount = -1;
+        qint64 allocatedExtents = -1;
+        qint64 extentSize = -1;
+        qint64 used = -1;
+        qint64 extentStart = -1; /**< offset of the first extent, i.e. the size of the metadata area */
+    };
+
+    /** A range of extents of a LV with the same mapping */
+    struct Segment {
+        QString lvUuid;
+        QString type;
+        qint64 startExtent = -1;
+        qint64 extents = -1;
+        int stripes = 1;      /**< number of areas, for raid including parity and mirror images */
+        int dataStripes = 1;  /**< number of areas that hold distinct data */
+        qint64 stripeSize = 0; /**< in bytes */
+        qint64 chunkSize = 0; /**< in bytes, for cache and snapshot segments */
+        QString devices; /**< physical ranges, e.g. /dev/sda2(0) */
+    };
+
+    /** A range of extents on a PV, lvUuid is empty for free space */
+    struct PhysicalSegment {
+        QString pvUuid;
+        QString lvUuid;
+        qint64 start = -1;
+        qint64 size = -1;
+    };
+
+public:
+    LvmTopology();
+
+    static LvmTopology current();
+    static LvmTopology read();
+    static LvmTopology fromJson(const QByteArray& report);
+
+public:
+    bool isValid() const;
+
+    QStringList volumeGroupNames() const;
+    const VolumeGroup* volumeGroup(const QString& vgName) const;
+    const LogicalVolume* logicalVolume(const QString& lvPath) const;
+    QList<LogicalVolume> logicalVolumes(const QString& vgName) const;
+    const PhysicalVolume* physicalVolume(const QString& deviceNode) const;
+    QList<PhysicalVolume> physicalVolumes() const;
+
+    QList<Segment> segments(const QString& lvUuid) const;
+    QList<PhysicalSegment> physicalSegments(const QString& pvUuid) const;
+
+private:
+    std::shared_ptr<const LvmTopologyPrivate> d;
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include "core/operationrunner.h"
 #include "core/operationstack.h"
 #include "ops/operation.h"
+#include "util/externalcommand.h"
 #include "util/report.h"
 
 #include <QDBusInterface>
@@ -92,6 +93,34 @@ void OperationRunner::run()
         emit finished();
 }
 
+/** Sets cancelling to true and stops the command or copy that is currently running.
+
+    The running Operation fails, the remaining ones are not started.
+*/
+void OperationRunner::cancel() const
+{
+    m_Cancelling = true;
+    ExternalCommand::cancelRunning();
+}
+
+/** Suspends running the operations.
+
+    A copy in progress pauses at its next block boundary, no new Operation is started
+    until resume() is called. Must be called from the thread that later calls resume().
+*/
+void OperationRunner::suspend() const
+{
+    suspendMutex().lock();
+    ExternalCommand::pauseRunning();
+}
+
+/** Resumes running the operations after suspend(). */
+void OperationRunner::resume() const
+{
+    ExternalCommand::resumeRunning();
+    suspendMutex().unlock();
+}
+
 /** @return the number of Operations to run */
 qint32 OperationRunner::numOperations() const
 {
@@ -51,9 +51,9 @@ public:
     bool isCancelling() const {
         return m_Cancelling;    /**< @return if the user has requested cancelling */
     }
-    void cancel() const {
-        m_Cancelling = true;    /**< Sets cancelling to true. */
-    }
+    void cancel() const;
+    void suspend() const;
+    void resume() const;
     QMutex& suspendMutex() const {
         return m_SuspendMutex;    /**< @return the QMutex used for syncing */
     }
@@ -43,6 +43,7 @@
 #include <KLocalizedString>
 
 #include <QReadLocker>
+#include <QThread>
 #include <QWriteLocker>
 
 /** Constructs a new OperationStack */
@@ -133,7 +134,7 @@ bool OperationStack::mergeNewOperation(Operation*& currentOp, Operation*& pushed
         newPartition->setLastSector(pushedResizeOp->newLastSector());
         newPartition->fileSystem().setLastSector(pushedResizeOp->newLastSector());
 
-        NewOperation* revisedNewOp = new NewOperation(newOp->targetDevice(), newPartition);
+        NewOperation* revisedNewOp = new NewOperation(newOp->targetDevice(), newPartition, newOp->volumeLayout());
         delete pushedOp;
         pushedOp = revisedNewOp;
 
@@ -569,3 +570,72 @@ void OperationStack::sortDevices()
 
     emit devicesChanged();
 }
+
+/** Replaces, adds or removes a single Device after it was rescanned.
+
+    The Device list is changed in place, so only deviceAdded(), deviceChanged() or deviceRemoved()
+    and devicesChanged() are emitted instead of rebuilding everything. Devices that pending
+    operations refer to are not touched.
+
+    Slots look at the Devices on the thread of the OperationStack, so if called on another thread,
+    e.g. by the DeviceScanner, the change is handed to that thread and made there later.
+    @param deviceNode the device node that was rescanned
+    @param d the newly scanned Device or nullptr if it is gone. Ownership is taken.
+    @return true if the Device list was changed or the change was handed to the thread of the OperationStack
+*/
+bool OperationStack::updateDevice(const QString& deviceNode, Device* d)
+{
+    if (QThread::currentThread() != thread()) {
+        if (d)
+            d->moveToThread(thread());
+        QMetaObject::invokeMethod(this, [this, deviceNode, d] { updateDevice(deviceNode, d); }, Qt::QueuedConnection);
+        return true;
+    }
+
+    Device* oldDevice = nullptr;
+
+    {
+        QWriteLocker lockDevices(&lock());
+
+        int index = -1;
+        for (int i = 0; i < previewDevices().size(); ++i) {
+            if (previewDevices().at(i)->deviceNode() == deviceNode) {
+                index = i;
+                break;
+            }
+        }
+
+        if (index >= 0) {
+            for (const auto &o : qAsConst(operations())) {
+                if (o->targets(*previewDevices().at(index))) {
+                    delete d;
+                    return false;
+                }
+            }
+
+            oldDevice = previewDevices().at(index);
+            if (d)
+                previewDevices()[index] = d;
+            else
+                previewDevices().removeAt(index);
+        } else if (d) {
+            previewDevices().insert(std::upper_bound(previewDevices().begin(), previewDevices().end(), d, deviceLessThan), d);
+        } else {
+            return false;
+        }
+    }
+
+    if (!d)
+        emit deviceRemoved(deviceNode);
+    else if (oldDevice)
+        emit deviceChanged(d);
+    else
+        emit deviceAdded(d);
+
+    emit devicesChanged();
+
+    // Slots on this thread have run, they could look at the old device until now
+    delete oldDevice;
+
+    return true;
+}
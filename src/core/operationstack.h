@@ -57,6 +57,9 @@ public:
 Q_SIGNALS:
     void operationsChanged();
     void devicesChanged();
+    void deviceAdded(Device* d);
+    void deviceChanged(Device* d);
+    void deviceRemoved(const QString& deviceNode);
 
 public:
     void push(Operation* o);
@@ -91,6 +94,7 @@ protected:
     void clearDevices();
     void addDevice(Device* d);
     void sortDevices();
+    bool updateDevice(const QString& deviceNode, Device* d);
 
     bool mergeNewOperation(Operation*& currentOp, Operation*& pushedOp);
     bool mergeCopyOperation(Operation*& currentOp, Operation*& pushedOp);
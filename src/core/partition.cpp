@@ -20,6 +20,7 @@
 #include "core/partition.h"
 
 #include "core/device.h"
+#include "core/devicepropertycache.h"
 
 #include "fs/filesystem.h"
 #include "fs/filesystemfactory.h"
@@ -29,7 +30,6 @@
 #include "util/report.h"
 
 #include <QRegularExpression>
-#include <QStorageInfo>
 #include <QString>
 #include <QStringList>
 #include <QTextStream>
@@ -336,14 +336,8 @@ bool Partition::unmount(Report& report)
         success = fileSystem().unmount(report, deviceNode());
     }
 
-    const QString canonicalDeviceNode = QFileInfo(deviceNode()).canonicalFilePath();
-    const QList<QStorageInfo> mountedVolumes = QStorageInfo::mountedVolumes();
-    for (const QStorageInfo &storage : mountedVolumes) {
-        if (QFileInfo(QString::fromLocal8Bit(storage.device())).canonicalFilePath() == canonicalDeviceNode ) {
-            success = false;
-            break;
-        }
-    }
+    if (!DevicePropertyCache::mountPoints(deviceNode()).isEmpty())
+        success = false;
 
     setMounted(!success);
 
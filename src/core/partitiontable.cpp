@@ -460,6 +460,12 @@ qint64 PartitionTable::defaultLastUsable(const Device& d, TableType t)
     if (t == gpt)
         return d.totalLogical() - 1 - 32 - 1;
 
+    // Thin LVs are laid out after the extents of the VG, extents no LV shows are left out
+    if (t == vmd && d.type() == Device::Type::LVM_Device) {
+        const LvmDevice& lvm = static_cast<const LvmDevice&>(d);
+        return d.totalLogical() - 1 + lvm.thinExtents() - lvm.hiddenExtents();
+    }
+
     return d.totalLogical() - 1;
 }
 
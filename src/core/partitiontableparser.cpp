@@ -0,0 +1,380 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "core/partitiontableparser.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QSet>
+#include <QtEndian>
+
+#include <array>
+#include <cstring>
+
+// Offsets into the GPT header, see the UEFI specification
+static const int gptHeaderSize = 12;
+static const int gptHeaderCrc = 16;
+static const int gptMyLba = 24;
+static const int gptAlternateLba = 32;
+static const int gptFirstUsableLba = 40;
+static const int gptLastUsableLba = 48;
+static const int gptDiskGuid = 56;
+static const int gptEntriesLba = 72;
+static const int gptNumberOfEntries = 80;
+static const int gptEntrySize = 84;
+static const int gptEntriesCrc = 88;
+static const int gptMinHeaderSize = 92;
+
+// Offsets into a GPT partition entry
+static const int entryTypeGuid = 0;
+static const int entryUniqueGuid = 16;
+static const int entryFirstLba = 32;
+static const int entryLastLba = 40;
+static const int entryName = 56;
+static const int entryNameSize = 72;
+
+// Offsets into a MBR or EBR
+static const int mbrDiskId = 440;
+static const int mbrEntries = 446;
+static const int mbrEntrySize = 16;
+static const int mbrSignature = 510;
+static const int mbrSize = 512;
+
+// Entry arrays bigger than this are treated as corrupted
+static const qint64 maxEntriesSize = 4 * 1024 * 1024;
+
+// Bounds the EBR chain, which could otherwise loop through a corrupted table
+static const int maxLogicalPartitions = 256;
+
+template <typename T>
+static T readLittleEndian(const QByteArray& data, int offset)
+{
+    return qFromLittleEndian<T>(reinterpret_cast<const uchar*>(data.constData()) + offset);
+}
+
+static bool isExtended(quint8 type)
+{
+    return type == 0x05 || type == 0x0f || type == 0x85;
+}
+
+static bool isNullGuid(const QByteArray& data, int offset)
+{
+    for (int i = 0; i < 16; ++i)
+        if (data[offset + i] != 0)
+            return false;
+    return true;
+}
+
+/** Formats a GUID, whose first three fields are stored little-endian. */
+static QString guidToString(const QByteArray& data, int offset)
+{
+    return QStringLiteral("%1-%2-%3-%4-%5")
+            .arg(readLittleEndian<quint32>(data, offset), 8, 16, QLatin1Char('0'))
+            .arg(readLittleEndian<quint16>(data, offset + 4), 4, 16, QLatin1Char('0'))
+            .arg(readLittleEndian<quint16>(data, offset + 6), 4, 16, QLatin1Char('0'))
+            .arg(QString::fromLatin1(data.mid(offset + 8, 2).toHex()))
+            .arg(QString::fromLatin1(data.mid(offset + 10, 6).toHex()))
+            .toUpper();
+}
+
+/** Reads and verifies a GPT header and its entry array.
+    @param lba sector of the header
+    @return false if the header or the entries are damaged
+*/
+static bool readGpt(const PartitionTableParser::Reader& read, qint64 lba, qint64 sectorSize, qint64 totalSectors, QByteArray& header, QByteArray& entries)
+{
+    if (!read(header, lba * sectorSize, sectorSize) || header.size() < gptMinHeaderSize)
+        return false;
+
+    if (!header.startsWith("EFI PART"))
+        return false;
+
+    const quint32 headerSize = readLittleEndian<quint32>(header, gptHeaderSize);
+    if (headerSize < gptMinHeaderSize || headerSize > sectorSize)
+        return false;
+
+    QByteArray crcData = header.left(headerSize);
+    std::memset(crcData.data() + gptHeaderCrc, 0, sizeof(quint32));
+    if (PartitionTableParser::crc32(crcData.constData(), crcData.size()) != readLittleEndian<quint32>(header, gptHeaderCrc))
+        return false;
+
+    if (static_cast<qint64>(readLittleEndian<quint64>(header, gptMyLba)) != lba)
+        return false;
+
+    const qint64 entriesLba = readLittleEndian<quint64>(header, gptEntriesLba);
+    const qint64 numberOfEntries = readLittleEndian<quint32>(header, gptNumberOfEntries);
+    const qint64 entrySize = readLittleEndian<quint32>(header, gptEntrySize);
+    if (entrySize < 128 || entrySize % 8 != 0 || numberOfEntries * entrySize > maxEntriesSize)
+        return false;
+
+    const qint64 entriesSize = numberOfEntries * entrySize;
+    if (entriesLba < 1 || entriesLba * sectorSize + entriesSize > totalSectors * sectorSize)
+        return false;
+
+    if (!read(entries, entriesLba * sectorSize, entriesSize) || entries.size() != entriesSize)
+        return false;
+
+    return PartitionTableParser::crc32(entries.constData(), entries.size()) == readLittleEndian<quint32>(header, gptEntriesCrc);
+}
+
+static bool parseGpt(const PartitionTableParser::Reader& read, const QString& deviceNode, qint64 sectorSize, qint64 totalSectors, QJsonObject& partitionTable)
+{
+    QByteArray header;
+    QByteArray entries;
+    const qint64 lastLba = totalSectors - 1;
+
+    if (readGpt(read, 1, sectorSize, totalSectors, header, entries)) {
+        // The backup header must describe the same entries
+        QByteArray backupHeader;
+        QByteArray backupEntries;
+        const qint64 alternateLba = readLittleEndian<quint64>(header, gptAlternateLba);
+        const bool backupValid = alternateLba > 1 && alternateLba <= lastLba
+                && readGpt([&] (QByteArray& buffer, qint64 offset, qint64 size) {
+                        // Reuse the primary entries, only the backup header is read
+                        if (offset == alternateLba * sectorSize)
+                            return read(buffer, offset, size);
+                        buffer = entries;
+                        return size == entries.size();
+                    }, alternateLba, sectorSize, totalSectors, backupHeader, backupEntries)
+                && readLittleEndian<quint32>(backupHeader, gptEntriesCrc) == readLittleEndian<quint32>(header, gptEntriesCrc);
+
+        if (!backupValid)
+            qWarning() << "the backup GPT header of" << deviceNode << "is damaged";
+    }
+    else if (readGpt(read, lastLba, sectorSize, totalSectors, header, entries))
+        qWarning() << "the primary GPT header of" << deviceNode << "is damaged, using the backup header";
+    else
+        return false;
+
+    const qint64 numberOfEntries = readLittleEndian<quint32>(header, gptNumberOfEntries);
+    const qint64 entrySize = readLittleEndian<quint32>(header, gptEntrySize);
+
+    QJsonArray partitions;
+    for (int i = 0; i < numberOfEntries; ++i) {
+        const QByteArray entry = entries.mid(i * entrySize, entrySize);
+        if (isNullGuid(entry, entryTypeGuid))
+            continue;
+
+        const qint64 firstLba = readLittleEndian<quint64>(entry, entryFirstLba);
+        const qint64 lastLbaOfEntry = readLittleEndian<quint64>(entry, entryLastLba);
+        if (lastLbaOfEntry < firstLba)
+            return false;
+
+        QString name;
+        for (int c = 0; c < entryNameSize; c += 2) {
+            const quint16 unit = readLittleEndian<quint16>(entry, entryName + c);
+            if (unit == 0)
+                break;
+            name.append(QChar(unit));
+        }
+
+        QJsonObject partition;
+        partition[QLatin1String("node")] = PartitionTableParser::partitionNode(deviceNode, i + 1);
+        partition[QLatin1String("start")] = firstLba;
+        partition[QLatin1String("size")] = lastLbaOfEntry - firstLba + 1;
+        partition[QLatin1String("type")] = guidToString(entry, entryTypeGuid);
+        partition[QLatin1String("uuid")] = guidToString(entry, entryUniqueGuid);
+        if (!name.isEmpty())
+            partition[QLatin1String("name")] = name;
+        partitions.append(partition);
+    }
+
+    partitionTable[QLatin1String("label")] = QStringLiteral("gpt");
+    partitionTable[QLatin1String("id")] = guidToString(header, gptDiskGuid);
+    partitionTable[QLatin1String("device")] = deviceNode;
+    partitionTable[QLatin1String("unit")] = QStringLiteral("sectors");
+    partitionTable[QLatin1String("firstlba")] = static_cast<qint64>(readLittleEndian<quint64>(header, gptFirstUsableLba));
+    partitionTable[QLatin1String("lastlba")] = static_cast<qint64>(readLittleEndian<quint64>(header, gptLastUsableLba));
+    partitionTable[QLatin1String("maxentries")] = numberOfEntries;
+    partitionTable[QLatin1String("partitions")] = partitions;
+
+    return true;
+}
+
+static QJsonObject mbrPartition(const QString& node, const QByteArray& sector, int entry, qint64 startOffset)
+{
+    const int offset = mbrEntries + entry * mbrEntrySize;
+
+    QJsonObject partition;
+    partition[QLatin1String("node")] = node;
+    partition[QLatin1String("start")] = startOffset + readLittleEndian<quint32>(sector, offset + 8);
+    partition[QLatin1String("size")] = static_cast<qint64>(readLittleEndian<quint32>(sector, offset + 12));
+    partition[QLatin1String("type")] = QString::number(static_cast<quint8>(sector[offset + 4]), 16);
+    if (static_cast<quint8>(sector[offset]) == 0x80)
+        partition[QLatin1String("bootable")] = true;
+    return partition;
+}
+
+static bool hasMbrSignature(const QByteArray& sector)
+{
+    return sector.size() >= mbrSize
+            && static_cast<quint8>(sector[mbrSignature]) == 0x55
+            && static_cast<quint8>(sector[mbrSignature + 1]) == 0xaa;
+}
+
+/** Walks the chain of extended boot records. Logical partitions are numbered from 5 on. */
+static bool parseLogicalPartitions(const PartitionTableParser::Reader& read, const QString& deviceNode, qint64 sectorSize, qint64 extendedStart, QJsonArray& partitions)
+{
+    QSet<qint64> visited;
+    qint64 ebrLba = extendedStart;
+    int number = 5;
+
+    while (number < 5 + maxLogicalPartitions && !visited.contains(ebrLba)) {
+        visited.insert(ebrLba);
+
+        QByteArray ebr;
+        if (!read(ebr, ebrLba * sectorSize, mbrSize))
+            return false;
+        if (!hasMbrSignature(ebr))
+            break;
+
+        const int first = mbrEntries;
+        if (ebr[first + 4] != 0 && readLittleEndian<quint32>(ebr, first + 12) != 0)
+            partitions.append(mbrPartition(PartitionTableParser::partitionNode(deviceNode, number++), ebr, 0, ebrLba));
+
+        const int next = mbrEntries + mbrEntrySize;
+        if (!isExtended(ebr[next + 4]) || readLittleEndian<quint32>(ebr, next + 8) == 0)
+            break;
+
+        ebrLba = extendedStart + readLittleEndian<quint32>(ebr, next + 8);
+    }
+
+    return true;
+}
+
+/** A FAT or NTFS file system on the whole device has the same signature as a MBR
+    and boot code that can look like partition entries.
+    @return true if the sector is the boot sector of such a file system
+*/
+static bool isVolumeBootRecord(const QByteArray& sector)
+{
+    // OEM ID of NTFS and exFAT, file system type of FAT12/16 and of FAT32
+    return sector.mid(3, 8) == "NTFS    " || sector.mid(3, 8) == "EXFAT   "
+            || sector.mid(0x36, 3) == "FAT" || sector.mid(0x52, 3) == "FAT";
+}
+
+static bool parseMbr(const PartitionTableParser::Reader& read, const QByteArray& mbr, const QString& deviceNode, qint64 sectorSize, QJsonObject& partitionTable)
+{
+    // Let sfdisk decide what it is
+    if (isVolumeBootRecord(mbr))
+        return false;
+
+    QJsonArray partitions;
+    bool empty = true;
+
+    for (int i = 0; i < 4; ++i) {
+        const int offset = mbrEntries + i * mbrEntrySize;
+        const quint8 bootFlag = mbr[offset];
+        const quint8 type = mbr[offset + 4];
+
+        // A boot sector without a partition table, let sfdisk decide what it is
+        if (bootFlag != 0x00 && bootFlag != 0x80)
+            return false;
+
+        if (type == 0 || readLittleEndian<quint32>(mbr, offset + 12) == 0)
+            continue;
+
+        empty = false;
+        partitions.append(mbrPartition(PartitionTableParser::partitionNode(deviceNode, i + 1), mbr, i, 0));
+    }
+
+    if (empty)
+        return false;
+
+    for (int i = 0; i < 4; ++i) {
+        const int offset = mbrEntries + i * mbrEntrySize;
+        if (isExtended(mbr[offset + 4]) && !parseLogicalPartitions(read, deviceNode, sectorSize, readLittleEndian<quint32>(mbr, offset + 8), partitions))
+            return false;
+    }
+
+    partitionTable[QLatin1String("label")] = QStringLiteral("dos");
+    partitionTable[QLatin1String("id")] = QStringLiteral("0x%1").arg(readLittleEndian<quint32>(mbr, mbrDiskId), 8, 16, QLatin1Char('0'));
+    partitionTable[QLatin1String("device")] = deviceNode;
+    partitionTable[QLatin1String("unit")] = QStringLiteral("sectors");
+    partitionTable[QLatin1String("partitions")] = partitions;
+
+    return true;
+}
+
+/** Parses the partition table of a device.
+    @param read reads raw bytes from the device
+    @param deviceNode the device node, used to name the partitions
+    @param logicalSectorSize logical sector size of the device
+    @param totalSectors size of the device in logical sectors
+    @param partitionTable set to the table in sfdisk --json layout
+    @return false if there is no GPT or MBR table that could be read and verified
+*/
+bool PartitionTableParser::parse(const Reader& read, const QString& deviceNode, qint64 logicalSectorSize, qint64 totalSectors, QJsonObject& partitionTable)
+{
+    if (logicalSectorSize < mbrSize || totalSectors < 3)
+        return false;
+
+    // The MBR, the primary GPT header and usually its entries fit into one read
+    QByteArray head;
+    const qint64 headSize = qMin(2 * logicalSectorSize + 128 * 128, totalSectors * logicalSectorSize);
+    if (!read(head, 0, headSize) || head.size() != headSize)
+        return false;
+
+    auto cachedRead = [&head, &read] (QByteArray& buffer, qint64 offset, qint64 size) {
+        if (offset + size <= head.size()) {
+            buffer = head.mid(offset, size);
+            return true;
+        }
+        return read(buffer, offset, size);
+    };
+
+    if (!hasMbrSignature(head))
+        return false;
+
+    for (int i = 0; i < 4; ++i) {
+        if (static_cast<quint8>(head[mbrEntries + i * mbrEntrySize + 4]) == 0xee)
+            return parseGpt(cachedRead, deviceNode, logicalSectorSize, totalSectors, partitionTable);
+    }
+
+    return parseMbr(cachedRead, head.left(mbrSize), deviceNode, logicalSectorSize, partitionTable);
+}
+
+/** @return the device node of a partition, e.g. /dev/sda1 or /dev/nvme0n1p1 */
+QString PartitionTableParser::partitionNode(const QString& deviceNode, int number)
+{
+    // Like the kernel, separate the number with a p if the device name ends with a digit
+    if (!deviceNode.isEmpty() && deviceNode.back().isDigit())
+        return deviceNode + QLatin1Char('p') + QString::number(number);
+
+    return deviceNode + QString::number(number);
+}
+
+/** @return the CRC32 (IEEE 802.3) checksum used by GPT */
+quint32 PartitionTableParser::crc32(const char* data, qint64 size)
+{
+    static const std::array<quint32, 256> table = [] {
+        std::array<quint32, 256> t;
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    quint32 crc = 0xffffffff;
+    for (qint64 i = 0; i < size; ++i)
+        crc = table[(crc ^ static_cast<quint8>(data[i])) & 0xff] ^ (crc >> 8);
+
+    return crc ^ 0xffffffff;
+}
@@ -0,0 +1,55 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_PARTITIONTABLEPARSER_H
+#define KPMCORE_PARTITIONTABLEPARSER_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QtGlobal>
+
+#include <functional>
+
+/** Reads GPT and MBR partition tables without running sfdisk.
+
+    The result has the same layout as the "partitiontable" object printed by
+    sfdisk --json, so the backends can use either source. GPT tables
+    additionally get a "maxentries" value from the header.
+
+    GPT headers and entry arrays are verified with their CRC32. If the primary
+    header is damaged the backup header in the last sector is used instead.
+    Anything that cannot be read or verified makes parse() fail and callers
+    should fall back to sfdisk.
+*/
+class LIBKPMCORE_EXPORT PartitionTableParser
+{
+    PartitionTableParser() = delete;
+
+public:
+    /** Reads size bytes at offset into buffer. Returns false on errors. */
+    typedef std::function<bool(QByteArray& buffer, qint64 offset, qint64 size)> Reader;
+
+    static bool parse(const Reader& read, const QString& deviceNode, qint64 logicalSectorSize, qint64 totalSectors, QJsonObject& partitionTable);
+
+    static QString partitionNode(const QString& deviceNode, int number);
+    static quint32 crc32(const char* data, qint64 size);
+};
+
+#endif
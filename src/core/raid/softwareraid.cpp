@@ -19,14 +19,21 @@
 
 #include "backend/corebackend.h"
 #include "backend/corebackendmanager.h"
+#include "core/devicepropertycache.h"
 #include "core/partition.h"
 #include "core/volumemanagerdevice_p.h"
 #include "fs/filesystem.h"
 #include "fs/filesystemfactory.h"
+#include "util/capacity.h"
 #include "util/externalcommand.h"
 
 #include <KLocalizedString>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QRegularExpression>
 
 #define d_ptr std::static_pointer_cast<SoftwareRAIDPrivate>(d)
@@ -44,6 +51,154 @@ public:
     SoftwareRAID::Status m_status;
 };
 
+/** What sysfs knows about an array, read at once */
+struct MdArray
+{
+    qint32 level = -1;
+    qint64 chunkSize = -1;
+    qint64 logicalSectorSize = -1;
+    qint64 arraySize = -1;
+    QString uuid;
+    QStringList members;
+};
+
+/** /proc/mdstat, configuration files and arrays, each read once per scan */
+struct MdScanState
+{
+    bool mdstatRead = false;
+    QString mdstat;
+    QHash<QString, QString> configurations;
+    QHash<QString, MdArray> arrays;
+};
+
+static QMutex scanStateMutex;
+static MdScanState scanState;
+static quint64 scanStateGeneration = 0;
+
+static QString readFile(const QString& path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    QTextStream stream(&file);
+
+    return stream.readAll();
+}
+
+/** @return the scan state of the running scan. Call with scanStateMutex locked. */
+static MdScanState& currentScanState(quint64 generation)
+{
+    if (scanStateGeneration != generation) {
+        scanState = MdScanState();
+        scanStateGeneration = generation;
+    }
+    return scanState;
+}
+
+static QString mdstat()
+{
+    const quint64 generation = DevicePropertyCache::scanGeneration();
+    if (generation == 0)
+        return readFile(QStringLiteral("/proc/mdstat"));
+
+    QMutexLocker locker(&scanStateMutex);
+    MdScanState& state = currentScanState(generation);
+    if (!state.mdstatRead) {
+        state.mdstat = readFile(QStringLiteral("/proc/mdstat"));
+        state.mdstatRead = true;
+    }
+    return state.mdstat;
+}
+
+/** @return the sysfs directory of an array, empty if the kernel does not know it */
+static QString sysfsPath(const QString& path)
+{
+    const QString name = QFileInfo(path).canonicalFilePath().section(QLatin1Char('/'), -1);
+    const QString sysfs = QStringLiteral("/sys/block/") + name;
+
+    return (!name.isEmpty() && QFileInfo::exists(sysfs + QStringLiteral("/md"))) ? sysfs : QString();
+}
+
+static MdArray readArray(const QString& path)
+{
+    MdArray array;
+
+    const QString sysfs = sysfsPath(path);
+    if (sysfs.isEmpty())
+        return array;
+
+    bool ok;
+    const QString level = readFile(sysfs + QStringLiteral("/md/level")).trimmed();
+    if (level.startsWith(QStringLiteral("raid"))) {
+        const qint32 raidLevel = level.midRef(4).toInt(&ok);
+        if (ok)
+            array.level = raidLevel;
+    }
+
+    // mdadm prints the chunk size in KiB
+    const qint64 chunkSize = readFile(sysfs + QStringLiteral("/md/chunk_size")).trimmed().toLongLong();
+    array.chunkSize = chunkSize > 0 ? chunkSize / 1024 : -1;
+
+    const qint64 logicalSectorSize = readFile(sysfs + QStringLiteral("/queue/logical_block_size")).trimmed().toLongLong();
+    array.logicalSectorSize = logicalSectorSize > 0 ? logicalSectorSize : -1;
+
+    const qint64 sectors = readFile(sysfs + QStringLiteral("/size")).trimmed().toLongLong(&ok);
+    if (ok)
+        array.arraySize = sectors * 512;
+
+    const QStringList members = QDir(sysfs + QStringLiteral("/md")).entryList({ QStringLiteral("dev-*") }, QDir::Dirs);
+    for (const auto &member : members)
+        array.members << QStringLiteral("/dev/") + member.mid(4).replace(QLatin1Char('!'), QLatin1Char('/'));
+
+    // udev stores the UUID mdadm reported when the array appeared
+    array.uuid = DevicePropertyCache::udevProperty(path, QStringLiteral("MD_UUID"));
+
+    return array;
+}
+
+/** @return a queue limit of a disk or of the disk a partition is on, -1 if unknown */
+static qint64 queueLimit(const QString& devicePath, const QString& limit)
+{
+    QString sysfs = QFileInfo(QStringLiteral("/sys/class/block/") + QFileInfo(devicePath).canonicalFilePath().section(QLatin1Char('/'), -1)).canonicalFilePath();
+    if (!QFileInfo::exists(sysfs + QStringLiteral("/queue")))
+        sysfs = sysfs.section(QLatin1Char('/'), 0, -2);
+
+    bool ok;
+    const qint64 value = readFile(sysfs + QStringLiteral("/queue/") + limit).trimmed().toLongLong(&ok);
+    return ok ? value : -1;
+}
+
+static QString consistencyPolicyName(SoftwareRAID::ConsistencyPolicy policy)
+{
+    switch (policy) {
+    case SoftwareRAID::ConsistencyPolicy::Resync:
+        return QStringLiteral("resync");
+    case SoftwareRAID::ConsistencyPolicy::Bitmap:
+        return QStringLiteral("bitmap");
+    case SoftwareRAID::ConsistencyPolicy::Journal:
+        return QStringLiteral("journal");
+    case SoftwareRAID::ConsistencyPolicy::Ppl:
+        return QStringLiteral("ppl");
+    default:
+        return QString();
+    }
+}
+
+static MdArray mdArray(const QString& path)
+{
+    const quint64 generation = DevicePropertyCache::scanGeneration();
+    if (generation == 0)
+        return readArray(path);
+
+    QMutexLocker locker(&scanStateMutex);
+    MdScanState& state = currentScanState(generation);
+    if (!state.arrays.contains(path))
+        state.arrays.insert(path, readArray(path));
+    return state.arrays.value(path);
+}
+
 SoftwareRAID::SoftwareRAID(const QString& name, SoftwareRAID::Status status, const QString& iconName)
     : VolumeManagerDevice(std::make_shared<SoftwareRAIDPrivate>(),
                           name,
@@ -183,15 +338,9 @@ void SoftwareRAID::scanSoftwareRAID(QList<Device*>& devices)
         }
     }
 
-    QFile mdstat(QStringLiteral("/proc/mdstat"));
-
-    if (mdstat.open(QIODevice::ReadOnly)) {
-        QTextStream stream(&mdstat);
-
-        QString content = stream.readAll();
-
-        mdstat.close();
+    const QString content = mdstat();
 
+    if (!content.isEmpty()) {
         QRegularExpression re(QStringLiteral("md([\\/\\w]+)\\s+:\\s+([\\w]+)"));
         QRegularExpressionMatchIterator i  = re.globalMatch(content);
         while (i.hasNext()) {
@@ -240,45 +389,15 @@ void SoftwareRAID::scanSoftwareRAID(QList<Device*>& devices)
 
 qint32 SoftwareRAID::getRaidLevel(const QString &path)
 {
-    QString output = getDetail(path);
-
-    if (!output.isEmpty()) {
-        QRegularExpression re(QStringLiteral("Raid Level :\\s+\\w+(\\d+)"));
-        QRegularExpressionMatch reMatch = re.match(output);
-        if (reMatch.hasMatch())
-            return reMatch.captured(1).toLongLong();
-    }
-
-    return -1;
+    return mdArray(path).level;
 }
 
 qint64 SoftwareRAID::getChunkSize(const QString &path)
 {
-    if (getRaidLevel(path) == 1) {
-        QStringList devices = getDevicePathList(path);
-
-        if (!devices.isEmpty()) {
-            QString device = devices[0];
-            // Look sector size for the first device/partition on the list, as RAID 1 is composed by mirrored devices
-            ExternalCommand sectorSize(QStringLiteral("blockdev"), { QStringLiteral("--getss"), device });
-
-            if (sectorSize.run(-1) && sectorSize.exitCode() == 0) {
-                int sectors = sectorSize.output().trimmed().toLongLong();
-                return sectors;
-            }
-        }
-    }
-    else {
-        QString output = getDetail(path);
-        if (!output.isEmpty()) {
-            QRegularExpression re(QStringLiteral("Chunk Size :\\s+(\\d+)"));
-            QRegularExpressionMatch reMatch = re.match(output);
-            if (reMatch.hasMatch())
-                return reMatch.captured(1).toLongLong();
-        }
-    }
-    return -1;
+    const MdArray array = mdArray(path);
 
+    // RAID 1 is composed by mirrored devices and has no chunks, use its logical sector size
+    return array.level == 1 ? array.logicalSectorSize : array.chunkSize;
 }
 
 qint64 SoftwareRAID::getTotalChunk(const QString &path)
@@ -288,24 +407,20 @@ qint64 SoftwareRAID::getTotalChunk(const QString &path)
 
 qint64 SoftwareRAID::getArraySize(const QString &path)
 {
-    QString output = getDetail(path);
-    if (!output.isEmpty()) {
-        QRegularExpression re(QStringLiteral("Array Size :\\s+(\\d+)"));
-        QRegularExpressionMatch reMatch = re.match(output);
-        if (reMatch.hasMatch())
-            return reMatch.captured(1).toLongLong() * 1024;
-    }
-    return -1;
-
+    return mdArray(path).arraySize;
 }
 
 QString SoftwareRAID::getUUID(const QString &path)
 {
-    QString output = getDetail(path);
+    const MdArray array = mdArray(path);
+
+    if (!array.uuid.isEmpty())
+        return array.uuid;
 
-    if (!output.isEmpty()) {
-        QRegularExpression re(QStringLiteral("UUID :\\s+([\\w:]+)"));
-        QRegularExpressionMatch reMatch = re.match(output);
+    // Not known to udev, e.g. when udev rules of mdadm are missing
+    if (!sysfsPath(path).isEmpty()) {
+        QRegularExpression re(QStringLiteral("^MD_UUID=([\\w:]+)$"), QRegularExpression::MultilineOption);
+        QRegularExpressionMatch reMatch = re.match(getDetail(path));
 
         if (reMatch.hasMatch())
             return reMatch.captured(1);
@@ -350,45 +465,146 @@ QString SoftwareRAID::getUUID(const QString &path)
 
 QStringList SoftwareRAID::getDevicePathList(const QString &path)
 {
-    QStringList result;
+    return mdArray(path).members;
+}
 
-    QString detail = getDetail(path);
+bool SoftwareRAID::isRaidPath(const QString &path)
+{
+    return !sysfsPath(path).isEmpty();
+}
 
-    if (!detail.isEmpty()) {
-        QRegularExpression re(QStringLiteral("\\s+\\/dev\\/(\\w+)"));
-        QRegularExpressionMatchIterator i = re.globalMatch(detail);
+/** Creates a new array and tunes it for performance.
 
-        while (i.hasNext()) {
-            QRegularExpressionMatch match = i.next();
+    Every setting that was chosen is recorded in the report.
 
-            QString device = QStringLiteral("/dev/") + match.captured(1);
-            if (device != path)
-                result << device;
-        }
+    @param name name of the array, e.g. md0
+    @param devicePathList member devices
+    @param raidLevel RAID level
+    @param chunkSize chunk size in KiB, 0 to derive it from the members
+    @param options bitmap, consistency policy and stripe cache settings
+    @see optimalChunkSize
+*/
+bool SoftwareRAID::createSoftwareRAID(Report &report,
+                                      const QString &name,
+                                      const QStringList devicePathList,
+                                      const qint32 raidLevel,
+                                      const qint32 chunkSize,
+                                      const CreateOptions& options)
+{
+    const QString path = QStringLiteral("/dev/") + name;
+
+    QStringList args = { QStringLiteral("--create"),
+                         path,
+                         QStringLiteral("--run"),
+                         QStringLiteral("--level=") + QString::number(raidLevel),
+                         QStringLiteral("--raid-devices=") + QString::number(devicePathList.size()) };
+
+    // RAID 1 is composed by mirrored devices and has no chunks
+    qint32 chunk = 0;
+    if (raidLevel != 1) {
+        chunk = chunkSize > 0 ? chunkSize : optimalChunkSize(devicePathList);
+        args << QStringLiteral("--chunk=%1K").arg(chunk);
     }
 
-    return result;
+    // A partial parity log or a journal cannot be combined with a bitmap, the bitmap policy needs one
+    WriteIntentBitmap bitmap = options.bitmap;
+    if (options.consistencyPolicy == ConsistencyPolicy::Ppl || options.consistencyPolicy == ConsistencyPolicy::Journal)
+        bitmap = WriteIntentBitmap::None;
+    else if (options.consistencyPolicy == ConsistencyPolicy::Bitmap)
+        bitmap = WriteIntentBitmap::Internal;
+
+    if (bitmap == WriteIntentBitmap::None)
+        args << QStringLiteral("--bitmap=none");
+    else if (bitmap == WriteIntentBitmap::Internal)
+        args << QStringLiteral("--bitmap=internal");
+
+    if (bitmap != WriteIntentBitmap::None && options.bitmapChunkSize > 0)
+        args << QStringLiteral("--bitmap-chunk=%1K").arg(options.bitmapChunkSize / 1024);
+
+    // The journal policy follows from the journal device
+    if (options.consistencyPolicy == ConsistencyPolicy::Journal)
+        args << QStringLiteral("--write-journal") << options.journalDevice;
+    else if (options.consistencyPolicy != ConsistencyPolicy::Default)
+        args << QStringLiteral("--consistency-policy=") + consistencyPolicyName(options.consistencyPolicy);
+
+    if (options.assumeClean)
+        args << QStringLiteral("--assume-clean");
+
+    args << devicePathList;
+
+    ExternalCommand cmd(report, QStringLiteral("mdadm"), args);
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return false;
+
+    if (chunk > 0)
+        report.line() << xi18nc("@info:progress", "Chunk size of <filename>%1</filename>: %2 KiB", path, chunk);
+    if (bitmap == WriteIntentBitmap::None)
+        report.line() << xi18nc("@info:progress", "Write-intent bitmap of <filename>%1</filename>: none", path);
+    else if (bitmap == WriteIntentBitmap::Internal && options.bitmapChunkSize > 0)
+        report.line() << xi18nc("@info:progress", "Write-intent bitmap of <filename>%1</filename>: internal, %2 KiB chunks", path, options.bitmapChunkSize / 1024);
+    else if (bitmap == WriteIntentBitmap::Internal)
+        report.line() << xi18nc("@info:progress", "Write-intent bitmap of <filename>%1</filename>: internal", path);
+    if (options.consistencyPolicy != ConsistencyPolicy::Default)
+        report.line() << xi18nc("@info:progress", "Consistency policy of <filename>%1</filename>: %2", path, consistencyPolicyName(options.consistencyPolicy));
+    if (options.assumeClean)
+        report.line() << xi18nc("@info:progress", "Initial resync of <filename>%1</filename> skipped.", path);
+
+    const bool parity = raidLevel == 4 || raidLevel == 5 || raidLevel == 6;
+    if (parity && options.stripeCacheSize > 0 && !setStripeCacheSize(report, path, options.stripeCacheSize))
+        report.line() << xi18nc("@info:progress", "Could not set the stripe cache size of <filename>%1</filename>.", path);
+
+    return true;
 }
 
-bool SoftwareRAID::isRaidPath(const QString &path)
+/** @return chunk size in KiB that suits the I/O sizes the members prefer
+
+    Members that report an optimal I/O size, like hardware RAID controllers and
+    some SSDs, get chunks of that size rounded down to a power of two between
+    64 KiB and 4 MiB. Otherwise the mdadm default of 512 KiB is used.
+*/
+qint32 SoftwareRAID::optimalChunkSize(const QStringList& devicePathList)
 {
-    return !getDetail(path).isEmpty();
+    qint64 optimal = 0;
+    for (const auto &path : devicePathList)
+        optimal = qMax(optimal, queueLimit(path, QStringLiteral("optimal_io_size")));
+
+    if (optimal <= 0)
+        return 512;
+
+    qint64 chunk = 64 * 1024;
+    while (chunk * 2 <= optimal && chunk < 4 * 1024 * 1024)
+        chunk *= 2;
+
+    return chunk / 1024;
 }
 
-bool SoftwareRAID::createSoftwareRAID(Report &report,
-                                      const QString &name,
-                                      const QStringList devicePathList,
-                                      const qint32 raidLevel,
-                                      const qint32 chunkSize)
+/** Sets how many pages per member the kernel uses to cache stripes of a RAID 4/5/6 array.
+
+    The kernel default of 256 pages limits sequential writes. The cache takes
+    pages * 4 KiB of memory for every member. The setting is lost when the array
+    is stopped.
+*/
+bool SoftwareRAID::setStripeCacheSize(Report& report, const QString& path, qint32 pages)
 {
-    Q_UNUSED(report)
-    Q_UNUSED(name)
-    Q_UNUSED(devicePathList)
-    Q_UNUSED(raidLevel)
-    Q_UNUSED(chunkSize)
-    return false;
+    const QString sysfs = sysfsPath(path);
+    if (sysfs.isEmpty())
+        return false;
+
+    ExternalCommand cmd;
+    if (!cmd.writeData(report, QByteArray::number(pages), sysfs + QStringLiteral("/md/stripe_cache_size"), 0))
+        return false;
+
+    report.line() << xi18nc("@info:progress", "Stripe cache size of <filename>%1</filename>: %2 pages per device, which take %3 of memory per device", path, pages,
+                            Capacity::formatByteSize(static_cast<qint64>(pages) * 4096));
+    return true;
 }
 
+/**
+ * shared list of partitions that will become members of new arrays.
+ * (have been added to an operation, but not yet applied)
+*/
+QVector<const Partition*> SoftwareRAID::s_DirtyMembers;
+
 bool SoftwareRAID::deleteSoftwareRAID(Report &report,
                                       SoftwareRAID &raidDevice)
 {
@@ -424,18 +640,23 @@ bool SoftwareRAID::reassembleSoftwareRAID(const QString &deviceNode)
     return stopSoftwareRAID(deviceNode) && assembleSoftwareRAID(deviceNode);
 }
 
-bool SoftwareRAID::isRaidMember(const QString &path)
+/** @return true if /proc/mdstat, read once per scan, lists the array */
+bool SoftwareRAID::isArrayInMdstat(const QString& deviceNode)
 {
-    QFile mdstat(QStringLiteral("/proc/mdstat"));
-
-    if (!mdstat.open(QIODevice::ReadOnly))
-        return false;
+    QRegularExpression re(QStringLiteral("md([\\/\\w]+)\\s+:"));
+    QRegularExpressionMatchIterator i  = re.globalMatch(mdstat());
 
-    QTextStream stream(&mdstat);
+    while (i.hasNext()) {
+        if ((QStringLiteral("/dev/md") + i.next().captured(1)) == deviceNode)
+            return true;
+    }
 
-    QString content = stream.readAll();
+    return false;
+}
 
-    mdstat.close();
+bool SoftwareRAID::isRaidMember(const QString &path)
+{
+    const QString content = mdstat();
 
     QRegularExpression re(QStringLiteral("(\\w+)\\[\\d+\\]"));
     QRegularExpressionMatchIterator i  = re.globalMatch(content);
@@ -467,22 +688,19 @@ qint64 SoftwareRAID::mappedSector(const QString &partitionPath, qint64 sector) c
 QString SoftwareRAID::getDetail(const QString &path)
 {
     ExternalCommand cmd(QStringLiteral("mdadm"),
-                       { QStringLiteral("--misc"), QStringLiteral("--detail"), path });
+                       { QStringLiteral("--misc"), QStringLiteral("--detail"), QStringLiteral("--export"), path });
     return (cmd.run(-1) && cmd.exitCode() == 0) ? cmd.output() : QString();
 }
 
 QString SoftwareRAID::getRAIDConfiguration(const QString &configurationPath)
 {
-    QFile config(configurationPath);
-
-    if (!config.open(QIODevice::ReadOnly))
-        return QString();
-
-    QTextStream stream(&config);
-
-    QString result = stream.readAll();
-
-    config.close();
+    const quint64 generation = DevicePropertyCache::scanGeneration();
+    if (generation == 0)
+        return readFile(configurationPath);
 
-    return result;
+    QMutexLocker locker(&scanStateMutex);
+    MdScanState& state = currentScanState(generation);
+    if (!state.configurations.contains(configurationPath))
+        state.configurations.insert(configurationPath, readFile(configurationPath));
+    return state.configurations.value(configurationPath);
 }
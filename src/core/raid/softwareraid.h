@@ -22,6 +22,10 @@
 #include "util/libpartitionmanagerexport.h"
 #include "util/report.h"
 
+#include <QVector>
+
+class Partition;
+
 class LIBKPMCORE_EXPORT SoftwareRAID : public VolumeManagerDevice
 {
     Q_DISABLE_COPY(SoftwareRAID)
@@ -36,6 +40,31 @@ public:
         Recovery,
     };
 
+    enum class WriteIntentBitmap {
+        Default,  /**< let mdadm decide */
+        None,
+        Internal
+    };
+
+    /** How parity and mirrors are kept consistent after a crash */
+    enum class ConsistencyPolicy {
+        Default,  /**< let mdadm decide */
+        Resync,   /**< resync the whole array */
+        Bitmap,   /**< resync regions marked in the write-intent bitmap */
+        Journal,  /**< RAID 4/5/6 write journal on a separate device */
+        Ppl       /**< RAID 5 partial parity log, closes the write hole without a bitmap */
+    };
+
+    /** Options of a new array that affect its performance */
+    struct CreateOptions {
+        WriteIntentBitmap bitmap = WriteIntentBitmap::Default;
+        qint64 bitmapChunkSize = 0; /**< in bytes, 0 lets mdadm choose */
+        ConsistencyPolicy consistencyPolicy = ConsistencyPolicy::Default;
+        QString journalDevice;      /**< required for ConsistencyPolicy::Journal */
+        bool assumeClean = false;   /**< skip the initial resync, only safe on zeroed or new disks */
+        qint32 stripeCacheSize = 0; /**< pages per member for RAID 4/5/6, each takes 4 KiB of memory, 0 keeps the kernel default */
+    };
+
     SoftwareRAID(const QString& name,
                  SoftwareRAID::Status status = SoftwareRAID::Status::Active,
                  const QString& iconName = QString());
@@ -76,7 +105,12 @@ public:
                                    const QString& name,
                                    const QStringList devicePathList,
                                    const qint32 raidLevel,
-                                   const qint32 chunkSize);
+                                   const qint32 chunkSize,
+                                   const CreateOptions& options = CreateOptions());
+
+    static qint32 optimalChunkSize(const QStringList& devicePathList);
+
+    static bool setStripeCacheSize(Report& report, const QString& path, qint32 pages);
 
     static bool deleteSoftwareRAID(Report& report,
                                    SoftwareRAID& raidDevice);
@@ -89,6 +123,10 @@ public:
 
     static bool isRaidMember(const QString& path);
 
+    static bool isArrayInMdstat(const QString& deviceNode);
+
+    static QVector<const Partition*> s_DirtyMembers;
+
 protected:
     void initPartitions() override;
 
@@ -0,0 +1,84 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "core/uevent.h"
+
+#include <QStringList>
+#include <QtEndian>
+
+#include <cstring>
+
+/** Splits a message from the udev monitor socket into its properties.
+    @param message the datagram as received
+    @param properties the KEY=VALUE pairs of the message
+    @return false if the message did not come from udev
+*/
+bool Uevent::parse(const QByteArray& message, QMap<QString, QString>& properties)
+{
+    // Layout of struct udev_monitor_netlink_header in libudev
+    struct {
+        char prefix[8];
+        quint32 magic;
+        quint32 headerSize;
+        quint32 propertiesOffset;
+        quint32 propertiesLength;
+    } header;
+
+    if (message.size() < static_cast<int>(sizeof(header)))
+        return false;
+
+    std::memcpy(&header, message.constData(), sizeof(header));
+    // libudev stores its magic number in network byte order
+    if (std::strncmp(header.prefix, "libudev", sizeof(header.prefix)) != 0 ||
+            qFromBigEndian(header.magic) != 0xfeedcafe ||
+            header.propertiesOffset + static_cast<qint64>(header.propertiesLength) > message.size())
+        return false;
+
+    const QList<QByteArray> lines = message.mid(header.propertiesOffset, header.propertiesLength).split('\0');
+    for (const auto &line : lines) {
+        const int separator = line.indexOf('=');
+        if (separator > 0)
+            properties.insert(QString::fromUtf8(line.left(separator)), QString::fromUtf8(line.mid(separator + 1)));
+    }
+
+    return true;
+}
+
+/** Finds the disk an uevent is about.
+    @param properties the KEY=VALUE pairs of the uevent
+    @return the device node of the disk or an empty string if the event can be ignored
+*/
+QString Uevent::diskNode(const QMap<QString, QString>& properties)
+{
+    if (properties.value(QStringLiteral("SUBSYSTEM")) != QLatin1String("block"))
+        return QString();
+
+    // Changes of a partition are rescanned as part of its disk: /devices/.../block/sda/sda1
+    const QStringList devicePath = properties.value(QStringLiteral("DEVPATH")).split(QLatin1Char('/'), QString::SkipEmptyParts);
+    const QString devType = properties.value(QStringLiteral("DEVTYPE"));
+    QString name;
+    if (devType == QLatin1String("disk") && devicePath.size() >= 1)
+        name = devicePath.last();
+    else if (devType == QLatin1String("partition") && devicePath.size() >= 2)
+        name = devicePath.at(devicePath.size() - 2);
+
+    // Device mapper and RAID devices are only found by full scans together with their volume managers
+    if (name.isEmpty() || name.startsWith(QLatin1String("dm-")) || name.startsWith(QLatin1String("md")))
+        return QString();
+
+    return QStringLiteral("/dev/") + name.replace(QLatin1Char('!'), QLatin1Char('/'));
+}
@@ -0,0 +1,42 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_UEVENT_H
+#define KPMCORE_UEVENT_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+/** Messages of the udev monitor netlink socket.
+
+    udev sends a message for every block device it processed after the kernel
+    reported a change. Each starts with a libudev header followed by the
+    KEY=VALUE properties of the device, separated by null bytes.
+*/
+class LIBKPMCORE_EXPORT Uevent
+{
+    Uevent() = delete;
+
+public:
+    static bool parse(const QByteArray& message, QMap<QString, QString>& properties);
+    static QString diskNode(const QMap<QString, QString>& properties);
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "core/usedcapacityreader.h"
+
+#include "core/device.h"
+#include "core/operationstack.h"
+#include "core/partition.h"
+#include "core/partitiontable.h"
+
+#include "fs/filesystem.h"
+#include "fs/filesystemfactory.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QReadLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+class UsedCapacityJob;
+
+struct UsedCapacityReaderPrivate
+{
+    QThreadPool m_Pool;
+    QMutex m_Mutex;
+    QHash<Partition*, UsedCapacityJob*> m_Queued;
+    quint64 m_Generation = 0; // changed by clear(), so results for dropped Devices are ignored
+    OperationStack* m_OperationStack = nullptr;
+};
+
+/** Reads the usage of one file system with a private FileSystem instance, so the
+    Partition itself is only touched in the reader's thread.
+*/
+class UsedCapacityJob : public QRunnable
+{
+public:
+    UsedCapacityJob(UsedCapacityReader* reader, UsedCapacityReaderPrivate* d, Partition* p) :
+        m_Reader(reader),
+        m_Private(d),
+        m_Partition(p),
+        m_Key(p),
+        m_Generation(d->m_Generation),
+        m_DeviceNode(p->partitionPath()),
+        m_Type(p->fileSystem().type()),
+        m_FirstSector(p->fileSystem().firstSector()),
+        m_LastSector(p->fileSystem().lastSector()),
+        m_SectorSize(p->fileSystem().sectorSize())
+    {
+    }
+
+    void run() override
+    {
+        {
+            QMutexLocker locker(&m_Private->m_Mutex);
+            m_Private->m_Queued.remove(m_Key);
+        }
+
+        std::unique_ptr<FileSystem> fs(FileSystemFactory::create(m_Type, m_FirstSector, m_LastSector, m_SectorSize));
+        const qint64 usedBytes = fs ? fs->readUsedCapacity(m_DeviceNode) : -1;
+        if (usedBytes < 0)
+            return;
+
+        const QPointer<Partition> partition = m_Partition;
+        Partition* key = m_Key;
+        const quint64 generation = m_Generation;
+        const FileSystem::Type type = m_Type;
+        const qint64 sectorsUsed = usedBytes / m_SectorSize;
+        UsedCapacityReader* reader = m_Reader;
+        UsedCapacityReaderPrivate* d = m_Private;
+        QMetaObject::invokeMethod(reader, [reader, d, partition, key, generation, type, sectorsUsed] {
+            {
+                // Rescans delete Partitions on the scanner thread. They only do so after clear()
+                // or with the OperationStack locked, so check both before touching the Partition.
+                OperationStack* stack = d->m_OperationStack;
+                QReadLocker lockDevices(stack ? &stack->lock() : nullptr);
+                QMutexLocker locker(&d->m_Mutex);
+                if (generation != d->m_Generation)
+                    return;
+
+                if (stack ? stack->findDeviceForPartition(key) == nullptr : partition.isNull())
+                    return;
+
+                // An operation may have changed the file system in the meantime
+                if (key->fileSystem().type() != type)
+                    return;
+
+                key->fileSystem().setSectorsUsed(sectorsUsed);
+            }
+
+            emit reader->usedCapacityRead(key);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    UsedCapacityReader* m_Reader;
+    UsedCapacityReaderPrivate* m_Private;
+    QPointer<Partition> m_Partition;
+    Partition* m_Key;
+    quint64 m_Generation;
+    QString m_DeviceNode;
+    FileSystem::Type m_Type;
+    qint64 m_FirstSector;
+    qint64 m_LastSector;
+    qint64 m_SectorSize;
+};
+
+/** Partitions requested explicitly run before the ones queued after a scan */
+static const int requestedPriority = 1;
+
+UsedCapacityReader::UsedCapacityReader(QObject* parent) :
+    QObject(parent),
+    d(std::make_unique<UsedCapacityReaderPrivate>())
+{
+}
+
+UsedCapacityReader::~UsedCapacityReader()
+{
+    clear();
+    d->m_Pool.waitForDone();
+}
+
+/** Makes results only be stored in Partitions that are still in the OperationStack.
+    Without one, Partitions must only be deleted on the thread the reader lives in.
+    Call it before anything is queued.
+    @param stack the OperationStack that holds the Devices, or nullptr
+*/
+void UsedCapacityReader::setOperationStack(OperationStack* stack)
+{
+    d->m_OperationStack = stack;
+}
+
+/** @return true if the usage of the Partition is unknown and can only be read by a file system tool */
+bool UsedCapacityReader::needsReading(const Partition& p)
+{
+    return !p.isMounted() && p.fileSystem().sectorsUsed() < 0 &&
+           p.fileSystem().supportGetUsed() == FileSystem::cmdSupportFileSystem;
+}
+
+/** Queues all Partitions of the given Devices whose usage is unknown.
+    @param devices the Devices, usually just scanned with ScanFlag::deferUsedCapacity
+*/
+void UsedCapacityReader::enqueue(const QList<Device*>& devices)
+{
+    for (const auto &device : devices) {
+        if (device->partitionTable() == nullptr)
+            continue;
+
+        for (const auto &p : device->partitionTable()->children()) {
+            enqueue(p);
+            for (const auto &child : p->children())
+                enqueue(child);
+        }
+    }
+}
+
+/** Queues a single Partition if its usage is unknown. */
+void UsedCapacityReader::enqueue(Partition* p)
+{
+    if (needsReading(*p))
+        start(p, 0);
+}
+
+/** Reads the usage of the given Partitions before everything else that is queued.
+    @param partitions the Partitions, e.g. the ones currently shown to the user
+*/
+void UsedCapacityReader::request(const QList<Partition*>& partitions)
+{
+    for (const auto &p : partitions) {
+        if (needsReading(*p))
+            start(p, requestedPriority);
+    }
+}
+
+void UsedCapacityReader::start(Partition* p, int priority)
+{
+    QMutexLocker locker(&d->m_Mutex);
+
+    UsedCapacityJob* job = d->m_Queued.value(p);
+    if (job) {
+        // Already queued: move it forward if it is still waiting, a running job is left alone
+        if (priority == 0 || !d->m_Pool.tryTake(job))
+            return;
+    } else {
+        job = new UsedCapacityJob(this, d.get(), p);
+        d->m_Queued.insert(p, job);
+    }
+
+    d->m_Pool.start(job, priority);
+}
+
+/** Drops everything that has not started yet, e.g. before the Devices are deleted. */
+void UsedCapacityReader::clear()
+{
+    QMutexLocker locker(&d->m_Mutex);
+
+    for (const auto &job : qAsConst(d->m_Queued)) {
+        if (d->m_Pool.tryTake(job))
+            delete job;
+    }
+    d->m_Queued.clear();
+    ++d->m_Generation;
+}
+
+/** Waits until all queued file systems were read.
+    @param msecs time to wait or -1 to wait without a time limit
+    @return true if everything was read, the results are delivered once the event loop runs
+*/
+bool UsedCapacityReader::waitForDone(int msecs)
+{
+    return d->m_Pool.waitForDone(msecs);
+}
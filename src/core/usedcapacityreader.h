@@ -0,0 +1,74 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_USEDCAPACITYREADER_H
+#define KPMCORE_USEDCAPACITYREADER_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include <QList>
+#include <QObject>
+#include <QtGlobal>
+
+#include <memory>
+
+class Device;
+class OperationStack;
+class Partition;
+struct UsedCapacityReaderPrivate;
+
+/** Reads the usage of unmounted file systems in the background.
+
+    Scans with ScanFlag::deferUsedCapacity leave the used sectors of unmounted
+    file systems unknown, because the file system tools that read them are
+    usually the slowest part of a scan. This class runs those tools on a
+    thread pool afterwards and stores the results in the Partitions in the
+    thread the reader lives in, emitting usedCapacityRead() for each of them.
+
+    Partitions the user is looking at can be moved to the front of the queue
+    with request().
+*/
+class LIBKPMCORE_EXPORT UsedCapacityReader : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(UsedCapacityReader)
+
+public:
+    explicit UsedCapacityReader(QObject* parent = nullptr);
+    ~UsedCapacityReader() override;
+
+public:
+    void setOperationStack(OperationStack* stack);
+    void enqueue(const QList<Device*>& devices);
+    void enqueue(Partition* p);
+    void request(const QList<Partition*>& partitions);
+    void clear();
+    bool waitForDone(int msecs = -1);
+
+    static bool needsReading(const Partition& p);
+
+Q_SIGNALS:
+    void usedCapacityRead(Partition* p);
+
+private:
+    void start(Partition* p, int priority);
+
+private:
+    std::unique_ptr<UsedCapacityReaderPrivate> d;
+};
+
+#endif
@@ -133,10 +133,23 @@ bool ext2::check(Report& report, const QString& deviceNode) const
 
 bool ext2::create(Report& report, const QString& deviceNode)
 {
-    ExternalCommand cmd(report, QStringLiteral("mkfs.ext2"), { QStringLiteral("-qF"), deviceNode });
+    ExternalCommand cmd(report, QStringLiteral("mkfs.ext2"), QStringList() << QStringLiteral("-qF") << stripeArguments() << deviceNode);
     return cmd.run(-1) && cmd.exitCode() == 0;
 }
 
+/** @return mke2fs options that align the file system to the stripes of the device */
+QStringList ext2::stripeArguments() const
+{
+    const qint64 blockSize = 4096;
+    if (stripeCount() < 2 || stripeSize() < blockSize)
+        return {};
+
+    // stride and stripe_width are counted in file system blocks, so the block size must be fixed
+    const qint64 stride = stripeSize() / blockSize;
+    return { QStringLiteral("-b"), QString::number(blockSize),
+             QStringLiteral("-E"), QStringLiteral("stride=%1,stripe_width=%2").arg(stride).arg(stride * stripeCount()) };
+}
+
 bool ext2::resize(Report& report, const QString& deviceNode, qint64 length) const
 {
     const QString len = QString::number(length / 512) + QStringLiteral("s");
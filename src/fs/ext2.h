@@ -23,6 +23,7 @@
 
 #include "fs/filesystem.h"
 
+#include <QStringList>
 #include <QtGlobal>
 
 class Report;
@@ -95,6 +96,9 @@ public:
     SupportTool supportToolName() const override;
     bool supportToolFound() const override;
 
+protected:
+    QStringList stripeArguments() const;
+
 public:
     static CommandSupportType m_GetUsed;
     static CommandSupportType m_GetLabel;
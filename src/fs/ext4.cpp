@@ -36,7 +36,7 @@ qint64 ext4::maxCapacity() const
 
 bool ext4::create(Report& report, const QString& deviceNode)
 {
-    ExternalCommand cmd(report, QStringLiteral("mkfs.ext4"), QStringList() << QStringLiteral("-qF") << deviceNode);
+    ExternalCommand cmd(report, QStringLiteral("mkfs.ext4"), QStringList() << QStringLiteral("-qF") << stripeArguments() << deviceNode);
     return cmd.run(-1) && cmd.exitCode() == 0;
 }
 
@@ -17,6 +17,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
  *************************************************************************/
 
+#include "core/devicepropertycache.h"
 #include "core/fstab.h"
 
 #include "fs/filesystem.h"
@@ -32,9 +33,13 @@
 #include <KLocalizedString>
 
 #include <QColor>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSettings>
 #include <QStandardPaths>
-#include <QStorageInfo>
 
 const std::vector<QColor> FileSystem::defaultColorCode =
 {
@@ -83,6 +88,8 @@ struct FileSystemPrivate {
     qint64 m_SectorsUsed;
     QString m_Label;
     QString m_UUID;
+    qint64 m_StripeSize = 0;
+    int m_StripeCount = 0;
 };
 
 /** Creates a new FileSystem object
@@ -131,16 +138,7 @@ QString FileSystem::detectMountPoint(FileSystem* fs, const QString& partitionPat
     if (partitionPath.isEmpty()) // Happens when during initial scan LUKS is closed
         return QString();
 
-    QStringList mountPoints;
-    QFileInfo partitionPathFileInfo(partitionPath);
-    QString partitionCanonicalPath = partitionPathFileInfo.canonicalFilePath();
-    const QList<QStorageInfo> mountedVolumes = QStorageInfo::mountedVolumes();
-    for (const QStorageInfo &storage : mountedVolumes) {
-        if (partitionCanonicalPath == QFileInfo(QString::fromLocal8Bit(storage.device())).canonicalFilePath() ) {
-            mountPoints.append(storage.rootPath());
-        }
-    }
-
+    QStringList mountPoints = DevicePropertyCache::mountPoints(partitionPath);
     mountPoints.append(possibleMountPoints(partitionPath));
 
     return mountPoints.isEmpty() ? QString() : mountPoints.first();
@@ -565,6 +563,19 @@ qint64 FileSystem::lastSector() const
         return d->m_LastSector;
 }
 
+/** Results of findExternal(), persisted across runs.
+    Every entry records the modification time of the binary it was obtained with,
+    so upgrading or replacing a tool invalidates it.
+*/
+static QSettings& toolCache()
+{
+    static QSettings cache(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kpmcore/externaltools.ini"),
+                           QSettings::IniFormat);
+    return cache;
+}
+
+static QMutex toolCacheMutex;
+
 bool FileSystem::findExternal(const QString& cmdName, const QStringList& args, int expectedCode)
 {
     QString cmdFullPath = QStandardPaths::findExecutable(cmdName);
@@ -573,11 +584,41 @@ bool FileSystem::findExternal(const QString& cmdName, const QStringList& args, i
     if (cmdFullPath.isEmpty())
         return false;
 
+    // Tools such as mkfs.ext2 are often symlinks, the target is what gets upgraded
+    const QFileInfo binary(QFileInfo(cmdFullPath).canonicalFilePath());
+    const QString stamp = QString::number(binary.lastModified().toMSecsSinceEpoch()) + QLatin1Char('-') + QString::number(binary.size());
+
+    QByteArray probe = cmdFullPath.toUtf8();
+    for (const auto &arg : args)
+        probe += '\0' + arg.toUtf8();
+    probe += '\0' + QByteArray::number(expectedCode);
+    const QString key = QString::fromLatin1(QCryptographicHash::hash(probe, QCryptographicHash::Sha1).toHex());
+
+    {
+        QMutexLocker locker(&toolCacheMutex);
+        toolCache().beginGroup(key);
+        const bool cached = toolCache().value(QStringLiteral("stamp")).toString() == stamp;
+        const bool found = toolCache().value(QStringLiteral("found")).toBool();
+        toolCache().endGroup();
+
+        if (cached)
+            return found;
+    }
+
     ExternalCommand cmd(cmdFullPath, args);
     if (!cmd.run())
-        return false;
+        return false; // could not run it at all, try again next time
+
+    const bool found = cmd.exitCode() == 0 || cmd.exitCode() == expectedCode;
 
-    return cmd.exitCode() == 0 || cmd.exitCode() == expectedCode;
+    QMutexLocker locker(&toolCacheMutex);
+    toolCache().beginGroup(key);
+    toolCache().setValue(QStringLiteral("command"), cmdFullPath);
+    toolCache().setValue(QStringLiteral("stamp"), stamp);
+    toolCache().setValue(QStringLiteral("found"), found);
+    toolCache().endGroup();
+
+    return found;
 }
 
 bool FileSystem::supportToolFound() const
@@ -639,3 +680,19 @@ void FileSystem::setUUID(const QString& s)
 {
     d->m_UUID = s;
 }
+
+qint64 FileSystem::stripeSize() const
+{
+    return d->m_StripeSize;
+}
+
+int FileSystem::stripeCount() const
+{
+    return d->m_StripeCount;
+}
+
+void FileSystem::setStripeGeometry(qint64 size, int count)
+{
+    d->m_StripeSize = size;
+    d->m_StripeCount = count;
+}
@@ -283,6 +283,15 @@ public:
     /**< @param s the new UUID */
     void setUUID(const QString& s);
 
+    /**< @return bytes written to one device before moving on to the next, 0 if not striped */
+    qint64 stripeSize() const;
+
+    /**< @return number of devices holding data, 0 if not striped */
+    int stripeCount() const;
+
+    /**< @param size the stripe size of the device to align new file systems to, @param count the number of data stripes */
+    void setStripeGeometry(qint64 size, int count);
+
 protected:
     static bool findExternal(const QString& cmdName, const QStringList& args = QStringList(), int exptectedCode = 1);
 
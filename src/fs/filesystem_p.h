@@ -31,6 +31,8 @@ public:
     qint64 m_SectorsUsed;
     QString m_Label;
     QString m_UUID;
+    qint64 m_StripeSize = 0;
+    int m_StripeCount = 0;
 };
 
 #endif
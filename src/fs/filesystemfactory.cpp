@@ -56,13 +56,80 @@
 #include "backend/corebackendmanager.h"
 #include "backend/corebackend.h"
 
+#include "util/externalcommand.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+
 FileSystemFactory::FileSystems FileSystemFactory::m_FileSystems;
 
-/** Initializes the instance. */
+// File systems whose support tools have been detected, guarded by initMutex.
+// The mutex is not held while probing, initializing tells other threads to wait.
+static QSet<FileSystem::Type> initializedTypes;
+static bool initializing = false;
+static QMutex initMutex;
+static QWaitCondition initCondition;
+
+/** Runs init() of file systems that share static support flags, one after another */
+class FileSystemInitializer : public QRunnable
+{
+public:
+    explicit FileSystemInitializer(const QList<FileSystem*>& fileSystems) : m_FileSystems(fileSystems) {}
+
+    void run() override {
+        for (const auto &fs : qAsConst(m_FileSystems))
+            fs->init();
+    }
+
+private:
+    QList<FileSystem*> m_FileSystems;
+};
+
+/** @return the type whose init() a type inherits, or the type itself */
+static FileSystem::Type initOwner(FileSystem::Type type)
+{
+    switch (type) {
+    case FileSystem::Type::Ext3:
+    case FileSystem::Type::Ext4:
+        return FileSystem::Type::Ext2;
+    case FileSystem::Type::Fat32:
+        return FileSystem::Type::Fat16;
+    case FileSystem::Type::Luks2:
+        return FileSystem::Type::Luks;
+    default:
+        return type;
+    }
+}
+
+/** @return the type that declares the static support flags init() writes */
+static FileSystem::Type flagsOwner(FileSystem::Type type)
+{
+    type = initOwner(type);
+    return type == FileSystem::Type::Fat16 ? FileSystem::Type::Fat12 : type;
+}
+
+/** Initializes the instance.
+
+    Support tools are not detected here, but for each file system type on first use.
+    @see ensureInitialized
+*/
 void FileSystemFactory::init()
 {
+    QMutexLocker locker(&initMutex);
+    while (initializing)
+        initCondition.wait(&initMutex);
+
     qDeleteAll(m_FileSystems);
     m_FileSystems.clear();
+    initializedTypes.clear();
 
     m_FileSystems.insert(FileSystem::Type::Apfs, new FS::apfs(-1, -1, -1, QString()));
     m_FileSystems.insert(FileSystem::Type::BitLocker, new FS::bitlocker(-1, -1, -1, QString()));
@@ -98,8 +165,7 @@ void FileSystemFactory::init()
     m_FileSystems.insert(FileSystem::Type::Xfs, new FS::xfs(-1, -1, -1, QString()));
     m_FileSystems.insert(FileSystem::Type::Zfs, new FS::zfs(-1, -1, -1, QString()));
 
-    for (const auto &fs : FileSystemFactory::map())
-        fs->init();
+    locker.unlock();
 
     CoreBackendManager::self()->backend()->initFSSupport();
 }
@@ -114,6 +180,8 @@ void FileSystemFactory::init()
 */
 FileSystem* FileSystemFactory::create(FileSystem::Type t, qint64 firstsector, qint64 lastsector, qint64 sectorSize, qint64 sectorsused, const QString& label, const QString& uuid)
 {
+    ensureInitialized({ t });
+
     FileSystem* fs = nullptr;
 
     switch (t) {
@@ -172,9 +240,73 @@ FileSystem* FileSystemFactory::create(const FileSystem& other)
 /** @return the map of FileSystems */
 const FileSystemFactory::FileSystems& FileSystemFactory::map()
 {
+    ensureInitialized(m_FileSystems.keys());
     return m_FileSystems;
 }
 
+/** Detects the support tools of the given file system types unless already done.
+
+    Detection runs each file system's init() and mostly waits for probe processes,
+    so several types are detected in parallel. Types that share an init() or its
+    static support flags, like ext2, ext3 and ext4, are detected once and never
+    at the same time.
+    @param types the file system types that are about to be used
+*/
+void FileSystemFactory::ensureInitialized(const QList<FileSystem::Type>& types)
+{
+    QMutexLocker locker(&initMutex);
+    while (initializing)
+        initCondition.wait(&initMutex);
+
+    QList<FileSystem::Type> pendingTypes;
+    QMap<FileSystem::Type, QList<FileSystem*>> groups; // key: flagsOwner(), value: sorted by type
+    for (const auto &type : types) {
+        if (initializedTypes.contains(type) || !m_FileSystems.contains(type))
+            continue;
+
+        pendingTypes.append(type);
+
+        const FileSystem::Type owner = initOwner(type);
+        FileSystem* fs = m_FileSystems.value(owner);
+        QList<FileSystem*>& group = groups[flagsOwner(type)];
+        if (fs && !initializedTypes.contains(owner) && !group.contains(fs)) {
+            group.append(fs);
+            std::sort(group.begin(), group.end(), [] (const FileSystem* a, const FileSystem* b) { return a->type() < b->type(); });
+        }
+    }
+
+    if (groups.isEmpty()) {
+        for (const auto &type : qAsConst(pendingTypes))
+            initializedTypes.insert(type);
+        return;
+    }
+
+    initializing = true;
+    locker.unlock();
+
+    if (groups.size() == 1)
+        FileSystemInitializer(groups.first()).run();
+    else {
+        // Authorize the helper on this thread rather than on one of the workers
+        ExternalCommand().startHelper();
+
+        // Every worker opens its own helper channel, so do not use more of them than needed
+        QThreadPool pool;
+        pool.setMaxThreadCount(qMin(QThread::idealThreadCount(), 8));
+        for (const auto &group : qAsConst(groups))
+            pool.start(new FileSystemInitializer(group));
+        pool.waitForDone();
+    }
+
+    locker.relock();
+    for (const auto &type : qAsConst(pendingTypes)) {
+        initializedTypes.insert(type);
+        initializedTypes.insert(initOwner(type));
+    }
+    initializing = false;
+    initCondition.wakeAll();
+}
+
 /** Clones a FileSystem from another one, but with a new type.
     @param newType the new FileSystem's type
     @param other the old FileSystem to clone
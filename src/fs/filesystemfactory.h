@@ -22,6 +22,7 @@
 
 #include "util/libpartitionmanagerexport.h"
 
+#include <QList>
 #include <QMap>
 #include <QtGlobal>
 
@@ -46,6 +47,9 @@ public:
     static FileSystem* cloneWithNewType(FileSystem::Type newType, const FileSystem& other);
     static const FileSystems& map();
 
+private:
+    static void ensureInitialized(const QList<FileSystem::Type>& types);
+
 private:
     static FileSystems m_FileSystems;
 };
@@ -22,6 +22,8 @@
 
 #include "fs/filesystemfactory.h"
 
+#include "core/devicepropertycache.h"
+
 #include "util/externalcommand.h"
 #include "util/capacity.h"
 #include "util/helpers.h"
@@ -31,9 +33,6 @@
 
 #include <QDebug>
 #include <QDialog>
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QJsonDocument>
 #include <QRegularExpression>
 #include <QPointer>
 #include <QStorageInfo>
@@ -564,28 +563,7 @@ bool luks::updateUUID(Report& report, const QString& deviceNode) const
 
 void luks::getMapperName(const QString& deviceNode)
 {
-    ExternalCommand cmd(QStringLiteral("lsblk"),
-                        { QStringLiteral("--list"),
-                          QStringLiteral("--noheadings"),
-                          QStringLiteral("--paths"),
-                          QStringLiteral("--json"),
-                          QStringLiteral("--output"),
-                          QStringLiteral("type,name"),
-                          deviceNode });
-    m_MapperName = QString();
-
-    if (cmd.run(-1) && cmd.exitCode() == 0) {
-        const QJsonDocument jsonDocument = QJsonDocument::fromJson(cmd.rawOutput());
-        QJsonObject jsonObject = jsonDocument.object();
-        const QJsonArray jsonArray = jsonObject[QLatin1String("blockdevices")].toArray();
-        for (const auto &deviceLine : jsonArray) {
-            QJsonObject deviceObject = deviceLine.toObject();
-            if (deviceObject[QLatin1String("type")].toString() == QLatin1String("crypt")) {
-                m_MapperName = deviceObject[QLatin1String("name")].toString();
-                break;
-            }
-        }
-    }
+    m_MapperName = DevicePropertyCache::mapperName(deviceNode);
 }
 
 void luks::getLuksInfo(const QString& deviceNode)
@@ -18,6 +18,7 @@
 
 #include "fs/lvm2_pv.h"
 #include "core/device.h"
+#include "core/lvmtopology.h"
 
 #include "util/externalcommand.h"
 #include "util/capacity.h"
@@ -73,9 +74,11 @@ void lvm2_pv::init()
 
 void lvm2_pv::scan(const QString& deviceNode)
 {
-    getPESize(deviceNode);
-    m_AllocatedPE = getAllocatedPE(deviceNode);
-    m_TotalPE = getTotalPE(deviceNode);
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    m_PESize = pv ? pv->extentSize : -1;
+    m_AllocatedPE = pv ? pv->allocatedExtents : -1;
+    m_TotalPE = pv ? pv->extentCount : -1;
 }
 
 bool lvm2_pv::supportToolFound() const
@@ -104,9 +107,9 @@ qint64 lvm2_pv::maxCapacity() const
 
 qint64 lvm2_pv::readUsedCapacity(const QString& deviceNode) const
 {
-    QString pvUsed = getpvField(QStringLiteral("pv_used"), deviceNode);
-    QString metadataOffset = getpvField(QStringLiteral("pe_start"), deviceNode);
-    return pvUsed.isEmpty() ? -1 : pvUsed.toLongLong() + metadataOffset.toLongLong();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    return !pv || pv->used < 0 ? -1 : pv->used + qMax<qint64>(0, pv->extentStart);
 }
 
 bool lvm2_pv::check(Report& report, const QString& deviceNode) const
@@ -131,13 +134,15 @@ bool lvm2_pv::resize(Report& report, const QString& deviceNode, qint64 length) c
 {
     bool rval = true;
 
-    qint64 metadataOffset = getpvField(QStringLiteral("pe_start"), deviceNode).toLongLong();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    const qint64 metadataOffset = pv ? qMax<qint64>(0, pv->extentStart) : 0;
 
-    qint64 lastPE = getTotalPE(deviceNode) - 1; // starts from 0
+    qint64 lastPE = (pv ? pv->extentCount : -1) - 1; // starts from 0
     if (lastPE > 0) { // make sure that the PV is already in a VG
         qint64 targetPE = (length - metadataOffset) / peSize() - 1; // starts from 0
         if (targetPE < lastPE) { //shrinking FS
-            qint64 firstMovedPE = qMax(targetPE + 1, getAllocatedPE(deviceNode)); // starts from 1
+            qint64 firstMovedPE = qMax(targetPE + 1, pv->allocatedExtents); // starts from 1
             ExternalCommand moveCmd(report,
                                     QStringLiteral("lvm"), {
                                     QStringLiteral("pvmove"),
@@ -173,7 +178,9 @@ bool lvm2_pv::updateUUID(Report& report, const QString& deviceNode) const
 
 QString lvm2_pv::readUUID(const QString& deviceNode) const
 {
-    return getpvField(QStringLiteral("pv_uuid"), deviceNode);
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    return pv ? pv->uuid : QString();
 }
 
 bool lvm2_pv::mount(Report& report, const QString& deviceNode, const QString& mountPoint)
@@ -206,20 +213,23 @@ bool lvm2_pv::canUnmount(const QString& deviceNode) const
 
 qint64 lvm2_pv::getTotalPE(const QString& deviceNode)
 {
-    QString pvPeCount = getpvField(QStringLiteral("pv_pe_count"), deviceNode);
-    return pvPeCount.isEmpty() ? -1 : pvPeCount.toLongLong();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    return pv ? pv->extentCount : -1;
 }
 
 qint64 lvm2_pv::getAllocatedPE(const QString& deviceNode)
 {
-    QString pvPeAllocCount = getpvField(QStringLiteral("pv_pe_alloc_count"), deviceNode);
-    return pvPeAllocCount.isEmpty() ? -1 : pvPeAllocCount.toLongLong();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    return pv ? pv->allocatedExtents : -1;
 }
 
 void lvm2_pv::getPESize(const QString& deviceNode)
 {
-    QString vgExtentSize = getpvField(QStringLiteral("vg_extent_size"), deviceNode);
-    m_PESize = vgExtentSize.isEmpty() ? -1 : vgExtentSize.toLongLong();
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    m_PESize = pv ? pv->extentSize : -1;
 }
 
 /** Get pvs command output with field name
@@ -251,7 +261,9 @@ QString  lvm2_pv::getpvField(const QString& fieldName, const QString& deviceNode
 
 QString lvm2_pv::getVGName(const QString& deviceNode)
 {
-    return getpvField(QStringLiteral("vg_name"), deviceNode);
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(deviceNode);
+    return pv ? pv->vgName : QString();
 }
 
 QList<LvmPV> lvm2_pv::getPVinNode(const PartitionNode* parent)
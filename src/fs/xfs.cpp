@@ -143,7 +143,14 @@ bool xfs::check(Report& report, const QString& deviceNode) const
 
 bool xfs::create(Report& report, const QString& deviceNode)
 {
-    ExternalCommand cmd(report, QStringLiteral("mkfs.xfs"), { QStringLiteral("-f"), deviceNode });
+    QStringList args = { QStringLiteral("-f") };
+
+    // Stripe unit and width of the data section, mkfs.xfs takes the unit in bytes
+    if (stripeCount() > 1 && stripeSize() >= 512)
+        args << QStringLiteral("-d") << QStringLiteral("su=%1,sw=%2").arg(stripeSize()).arg(stripeCount());
+
+    args << deviceNode;
+    ExternalCommand cmd(report, QStringLiteral("mkfs.xfs"), args);
     return cmd.run(-1) && cmd.exitCode() == 0;
 }
 
@@ -0,0 +1,64 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "jobs/attachcachejob.h"
+
+#include "core/partition.h"
+
+#include "util/capacity.h"
+#include "util/report.h"
+
+#include <KLocalizedString>
+
+/** Creates a new AttachCacheJob
+    @param dev the Volume Group of the Logical Volume
+    @param p the Logical Volume to cache
+    @param cachePV Physical Volume to allocate the cache on
+    @param cacheExtents size of the cache in extents
+    @param settings type and options of the cache
+*/
+AttachCacheJob::AttachCacheJob(LvmDevice& dev, const Partition& p, const QString& cachePV, qint64 cacheExtents, const LvmDevice::CacheSettings& settings) :
+    Job(),
+    m_Device(dev),
+    m_Partition(p),
+    m_CachePV(cachePV),
+    m_CacheExtents(cacheExtents),
+    m_Settings(settings)
+{
+}
+
+bool AttachCacheJob::run(Report& parent)
+{
+    Report* report = jobStarted(parent);
+
+    const bool rval = LvmDevice::attachCache(*report, device(), partition(), cachePV(), cacheExtents(), settings());
+    if (rval)
+        device().setCacheSettings(partition().partitionPath(), settings());
+
+    jobFinished(*report, rval);
+
+    return rval;
+}
+
+QString AttachCacheJob::description() const
+{
+    const QString size = Capacity::formatByteSize(cacheExtents() * device().peSize());
+    if (settings().type == LvmDevice::CacheType::WriteCache)
+        return xi18nc("@info/plain", "Attach a %1 write cache on <filename>%2</filename> to <filename>%3</filename>", size, cachePV(), partition().partitionPath());
+    return xi18nc("@info/plain", "Attach a %1 cache on <filename>%2</filename> to <filename>%3</filename>", size, cachePV(), partition().partitionPath());
+}
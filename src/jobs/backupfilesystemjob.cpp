@@ -20,15 +20,102 @@
 
 #include "core/partition.h"
 #include "core/device.h"
+#include "core/copysource.h"
 #include "core/copysourcedevice.h"
 #include "core/copytargetfile.h"
+#include "core/lvmdevice.h"
+#include "core/lvmtopology.h"
 
 #include "fs/filesystem.h"
 #include "util/externalcommand.h"
 #include "util/report.h"
 
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QThread>
+
 #include <KLocalizedString>
 
+namespace
+{
+
+/** Copies from the start of a block device that has no Device object, e.g. a snapshot.
+    The copy engine opens it with the privileges it needs. */
+class CopySourceSnapshot : public CopySource
+{
+public:
+    CopySourceSnapshot(const QString& path, qint64 length) :
+        CopySource(),
+        m_Path(path),
+        m_Length(length)
+    {
+    }
+
+    bool open() override {
+        return true;
+    }
+    QString path() const override {
+        return m_Path;
+    }
+    qint64 length() const override {
+        return m_Length;
+    }
+    bool overlaps(const CopyTarget&) const override {
+        return false;
+    }
+    qint64 firstByte() const override {
+        return 0;
+    }
+    qint64 lastByte() const override {
+        return m_Length - 1;
+    }
+
+private:
+    QString m_Path;
+    qint64 m_Length;
+};
+
+}
+
+static bool fsfreeze(Report& report, const QString& mountPoint, bool freeze)
+{
+    ExternalCommand cmd(report, QStringLiteral("fsfreeze"), { freeze ? QStringLiteral("--freeze") : QStringLiteral("--unfreeze"), mountPoint });
+    return cmd.run(-1) && cmd.exitCode() == 0;
+}
+
+/** Thaws a frozen file system, trying again a few times because it blocks every writer until it succeeds */
+static bool thaw(Report& report, const QString& mountPoint)
+{
+    for (int attempt = 0; attempt < 5; ++attempt) {
+        if (attempt > 0)
+            QThread::sleep(1);
+        if (fsfreeze(report, mountPoint, false))
+            return true;
+    }
+    return false;
+}
+
+/** Reports snapshots of a LV that earlier backups left behind, e.g. when they crashed.
+    They are not removed because only the user knows whether something still uses them. */
+static void reportStaleSnapshots(Report& report, const QString& lvPath, const QString& prefix)
+{
+    const QRegularExpression snapshotName(QStringLiteral("^%1_\\d+$").arg(QRegularExpression::escape(prefix)));
+
+    const LvmTopology topology = LvmTopology::read();
+    const LvmTopology::LogicalVolume* origin = topology.logicalVolume(lvPath);
+    if (origin == nullptr)
+        return;
+
+    for (const auto &lv : topology.logicalVolumes(origin->vgName)) {
+        if (lv.origin != origin->name || lv.path.isEmpty() || !snapshotName.match(lv.name).hasMatch())
+            continue;
+
+        report.line() << xi18nc("@info:progress", "The snapshot <filename>%1</filename> was left behind by an earlier backup. "
+                                "Remove it with <command>lvremove %1</command> if nothing uses it any more.", lv.path);
+    }
+}
+
 /** Creates a new BackupFileSystemJob
     @param sourcedevice the device the FileSystem to back up is on
     @param sourcepartition the Partition the FileSystem to back up is on
@@ -53,7 +140,9 @@ bool BackupFileSystemJob::run(Report& parent)
 
     Report* report = jobStarted(parent);
 
-    if (sourcePartition().fileSystem().supportBackup() == FileSystem::cmdSupportFileSystem)
+    if (sourceDevice().type() == Device::Type::LVM_Device && sourcePartition().isMounted())
+        rval = backupSnapshot(*report);
+    else if (sourcePartition().fileSystem().supportBackup() == FileSystem::cmdSupportFileSystem)
         rval = sourcePartition().fileSystem().backup(*report, sourceDevice(), sourcePartition().deviceNode(), fileName());
     else if (sourcePartition().fileSystem().supportBackup() == FileSystem::cmdSupportCore) {
         CopySourceDevice copySource(sourceDevice(), sourcePartition().fileSystem().firstByte(), sourcePartition().fileSystem().lastByte());
@@ -72,6 +161,73 @@ bool BackupFileSystemJob::run(Report& parent)
     return rval;
 }
 
+/** Backs up a mounted LV without taking it offline.
+
+    The file system is frozen only while LVM creates a snapshot, which makes
+    the snapshot consistent. The backup is then read from the snapshot while
+    the file system stays in use, and the snapshot is removed afterwards.
+    Snapshots of thin LVs are thin snapshots, others are classic snapshots
+    sized for a fifth of the LV being rewritten during the backup.
+*/
+bool BackupFileSystemJob::backupSnapshot(Report& report)
+{
+    const QString lvPath = sourcePartition().partitionPath();
+    const QString prefix = lvPath.section(QLatin1Char('/'), -1) + QStringLiteral("_backup");
+    const QString snapshotName = prefix + QLatin1Char('_') + QString::number(QDateTime::currentMSecsSinceEpoch());
+    const QString snapshotPath = lvPath.section(QLatin1Char('/'), 0, -2) + QLatin1Char('/') + snapshotName;
+    const QString mountPoint = sourcePartition().mountPoint();
+
+    reportStaleSnapshots(report, lvPath, prefix);
+
+    // Decided before freezing, reading the LVM metadata could wait for the frozen file system.
+    const bool thin = static_cast<const LvmDevice&>(sourceDevice()).volumeLayout(lvPath).type == LvmDevice::LayoutType::Thin;
+
+    QElapsedTimer frozenTime;
+    frozenTime.start();
+
+    const bool frozen = fsfreeze(report, mountPoint, true);
+    if (!frozen)
+        report.line() << xi18nc("@info:progress", "Could not freeze the file system on <filename>%1</filename>, relying on LVM to suspend it.", sourcePartition().deviceNode());
+
+    const bool created = thin ? LvmDevice::createThinSnapshot(report, sourcePartition(), snapshotName, frozen)
+                              : LvmDevice::createLVSnapshot(report, sourcePartition(), snapshotName, qMax<qint64>(1, sourcePartition().length() / 5), frozen);
+
+    if (frozen) {
+        if (!thaw(report, mountPoint)) {
+            report.line() << xi18nc("@info:progress", "<warning>The file system mounted at <filename>%1</filename> is still frozen and blocks all writes. "
+                                    "Run <command>fsfreeze --unfreeze %1</command> to thaw it.</warning>", mountPoint);
+            if (created && !LvmDevice::removeLV(report, snapshotPath))
+                report.line() << xi18nc("@info:progress", "Could not remove the snapshot <filename>%1</filename>.", snapshotPath);
+            return false;
+        }
+        report.line() << xi18nc("@info:progress", "File system on <filename>%1</filename> was frozen for %2 ms.", sourcePartition().deviceNode(), frozenTime.elapsed());
+    }
+
+    if (!created) {
+        report.line() << xi18nc("@info:progress", "Could not create a snapshot of <filename>%1</filename> for backup.", sourcePartition().deviceNode());
+        return false;
+    }
+
+    bool rval = false;
+    const FileSystem& fs = sourcePartition().fileSystem();
+    if (fs.supportBackup() == FileSystem::cmdSupportFileSystem)
+        rval = sourcePartition().fileSystem().backup(report, sourceDevice(), snapshotPath, fileName());
+    else if (fs.supportBackup() == FileSystem::cmdSupportCore) {
+        CopySourceSnapshot copySource(snapshotPath, fs.length() * fs.sectorSize());
+        CopyTargetFile copyTarget(fileName());
+
+        if (!copyTarget.open())
+            report.line() << xi18nc("@info:progress", "Could not create backup file <filename>%1</filename>.", fileName());
+        else
+            rval = copyBlocks(report, copyTarget, copySource);
+    }
+
+    if (!LvmDevice::removeLV(report, snapshotPath))
+        report.line() << xi18nc("@info:progress", "Could not remove the snapshot <filename>%1</filename>.", snapshotPath);
+
+    return rval;
+}
+
 QString BackupFileSystemJob::description() const
 {
     return xi18nc("@info:progress", "Back up file system on partition <filename>%1</filename> to <filename>%2</filename>", sourcePartition().deviceNode(), fileName());
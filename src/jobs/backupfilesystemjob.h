@@ -30,6 +30,7 @@ class Report;
 /** Back up a FileSystem.
 
     Backs up a FileSystem from a given Device and Partition to a file with the given filename.
+    Mounted logical volumes are backed up from a temporary LVM snapshot.
 
     @author Volker Lanz <vl@fidra.de>
 */
@@ -62,6 +63,8 @@ protected:
         return m_FileName;
     }
 
+    bool backupSnapshot(Report& report);
+
 private:
     Device& m_SourceDevice;
     Partition& m_SourcePartition;
@@ -24,6 +24,7 @@
 #include "backend/corebackendpartitiontable.h"
 
 #include "core/device.h"
+#include "core/lvmdevice.h"
 #include "core/partition.h"
 
 #include "fs/filesystem.h"
@@ -52,6 +53,14 @@ bool CreateFileSystemJob::run(Report& parent)
     if (partition().fileSystem().type() == FileSystem::Type::Unformatted)
         return true;
 
+    // Align file systems on striped and raid LVs to the stripes
+    if (device().type() == Device::Type::LVM_Device) {
+        const LvmDevice& lvm = static_cast<const LvmDevice&>(device());
+        const LvmDevice::VolumeLayout layout = lvm.volumeLayout(partition().partitionPath());
+        if (layout.type != LvmDevice::LayoutType::Linear && layout.stripes > 1)
+            partition().fileSystem().setStripeGeometry(layout.stripeSize > 0 ? layout.stripeSize : lvm.optimalStripeSize(), layout.stripes);
+    }
+
     bool createResult;
     if (partition().fileSystem().supportCreate() == FileSystem::cmdSupportFileSystem) {
         if (partition().fileSystem().supportCreateWithLabel() == FileSystem::cmdSupportFileSystem)
@@ -34,11 +34,13 @@
 /** Creates a new CreatePartitionJob
     @param d the Device the Partition to be created will be on
     @param p the Partition to create
+    @param layout how the extents are spread over the Physical Volumes if p is a Logical Volume
 */
-CreatePartitionJob::CreatePartitionJob(Device& d, Partition& p) :
+CreatePartitionJob::CreatePartitionJob(Device& d, Partition& p, const LvmDevice::VolumeLayout& layout) :
     Job(),
     m_Device(d),
-    m_Partition(p)
+    m_Partition(p),
+    m_VolumeLayout(layout)
 {
 }
 
@@ -76,7 +78,7 @@ bool CreatePartitionJob::run(Report& parent)
 
         QString partPath = partition().partitionPath();
         QString lvname   = partPath.right(partPath.length() - partPath.lastIndexOf(QStringLiteral("/")) - 1);
-        rval = LvmDevice::createLV(*report, dev, partition(), lvname);
+        rval = LvmDevice::createLV(*report, dev, partition(), lvname, m_VolumeLayout);
     }
 
     jobFinished(*report, rval);
@@ -19,6 +19,7 @@
 
 #define KPMCORE_CREATEPARTITIONJOB_H
 
+#include "core/lvmdevice.h"
 #include "jobs/job.h"
 
 class Partition;
@@ -33,7 +34,7 @@ class QString;
 class CreatePartitionJob : public Job
 {
 public:
-    CreatePartitionJob(Device& d, Partition& p);
+    CreatePartitionJob(Device& d, Partition& p, const LvmDevice::VolumeLayout& layout = LvmDevice::VolumeLayout());
 
 public:
     bool run(Report& parent) override;
@@ -57,6 +58,7 @@ protected:
 private:
     Device& m_Device;
     Partition& m_Partition;
+    LvmDevice::VolumeLayout m_VolumeLayout; /**< of new Logical Volumes */
 };
 
 #endif
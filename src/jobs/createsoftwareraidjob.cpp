@@ -0,0 +1,67 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "jobs/createsoftwareraidjob.h"
+
+#include "util/report.h"
+
+#include <KLocalizedString>
+
+/** Creates a new CreateSoftwareRAIDJob
+ * @param name name of the array, e.g. md0
+ * @param memberList partitions or disks the array is made of
+ * @param raidLevel RAID level
+ * @param chunkSize chunk size in KiB, 0 to derive it from the members
+ * @param options bitmap, consistency policy and stripe cache settings
+*/
+CreateSoftwareRAIDJob::CreateSoftwareRAIDJob(const QString& name, const QVector<const Partition*>& memberList, qint32 raidLevel, qint32 chunkSize, const SoftwareRAID::CreateOptions& options) :
+    Job(),
+    m_Name(name),
+    m_MemberList(memberList),
+    m_RaidLevel(raidLevel),
+    m_ChunkSize(chunkSize),
+    m_Options(options)
+{
+}
+
+bool CreateSoftwareRAIDJob::run(Report& parent)
+{
+    bool rval = false;
+
+    Report* report = jobStarted(parent);
+
+    QStringList devicePathList;
+    for (const auto &p : memberList())
+        devicePathList << p->partitionPath();
+
+    rval = SoftwareRAID::createSoftwareRAID(*report, name(), devicePathList, raidLevel(), chunkSize(), options());
+
+    jobFinished(*report, rval);
+
+    return rval;
+}
+
+QString CreateSoftwareRAIDJob::description() const
+{
+    QString tmp = QString();
+    for (const auto &p : memberList()) {
+        tmp += p->deviceNode() + QStringLiteral(", ");
+    }
+    tmp.chop(2);
+    return xi18nc("@info/plain", "Create a new RAID %1 array: <filename>%2</filename> with devices: %3", raidLevel(), QStringLiteral("/dev/") + name(), tmp);
+}
@@ -0,0 +1,67 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#if !defined(KPMCORE_CREATESOFTWARERAIDJOB_H)
+
+#define KPMCORE_CREATESOFTWARERAIDJOB_H
+
+#include "core/partition.h"
+#include "core/raid/softwareraid.h"
+#include "jobs/job.h"
+
+#include <QVector>
+
+class Report;
+
+class QString;
+
+class CreateSoftwareRAIDJob : public Job
+{
+public:
+    CreateSoftwareRAIDJob(const QString& name, const QVector<const Partition*>& memberList, qint32 raidLevel, qint32 chunkSize, const SoftwareRAID::CreateOptions& options);
+
+public:
+    bool run(Report& parent) override;
+    QString description() const override;
+
+protected:
+    const QString& name() const {
+        return m_Name;
+    }
+    const QVector<const Partition*>& memberList() const {
+        return m_MemberList;
+    }
+    qint32 raidLevel() const {
+        return m_RaidLevel;
+    }
+    qint32 chunkSize() const {
+        return m_ChunkSize;
+    }
+    const SoftwareRAID::CreateOptions& options() const {
+        return m_Options;
+    }
+
+private:
+    QString m_Name;
+    QVector<const Partition*> m_MemberList;
+    qint32 m_RaidLevel;
+    qint32 m_ChunkSize;
+    SoftwareRAID::CreateOptions m_Options;
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "jobs/detachcachejob.h"
+
+#include "core/partition.h"
+
+#include "util/report.h"
+
+#include <KLocalizedString>
+
+/** Creates a new DetachCacheJob
+    @param dev the Volume Group of the Logical Volume
+    @param p the cached Logical Volume
+*/
+DetachCacheJob::DetachCacheJob(LvmDevice& dev, const Partition& p) :
+    Job(),
+    m_Device(dev),
+    m_Partition(p),
+    m_Settings(dev.cacheSettings(p.partitionPath()))
+{
+}
+
+bool DetachCacheJob::run(Report& parent)
+{
+    Report* report = jobStarted(parent);
+
+    const bool rval = LvmDevice::detachCache(*report, partition(), settings());
+    if (rval)
+        device().setCacheSettings(partition().partitionPath(), LvmDevice::CacheSettings());
+
+    jobFinished(*report, rval);
+
+    return rval;
+}
+
+QString DetachCacheJob::description() const
+{
+    if (settings().type == LvmDevice::CacheType::WriteCache || settings().mode == LvmDevice::CacheMode::WriteBack)
+        return xi18nc("@info/plain", "Write back and detach the cache of <filename>%1</filename>", partition().partitionPath());
+    return xi18nc("@info/plain", "Detach the cache of <filename>%1</filename>", partition().partitionPath());
+}
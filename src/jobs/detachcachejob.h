@@ -0,0 +1,64 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#if !defined(KPMCORE_DETACHCACHEJOB_H)
+
+#define KPMCORE_DETACHCACHEJOB_H
+
+#include "core/lvmdevice.h"
+#include "jobs/job.h"
+
+class Partition;
+class Report;
+
+class QString;
+
+/** Write back and remove the cache of a Logical Volume.
+*/
+class DetachCacheJob : public Job
+{
+public:
+    DetachCacheJob(LvmDevice& dev, const Partition& p);
+
+public:
+    bool run(Report& parent) override;
+    QString description() const override;
+
+protected:
+    LvmDevice& device() {
+        return m_Device;
+    }
+    const LvmDevice& device() const {
+        return m_Device;
+    }
+
+    const Partition& partition() const {
+        return m_Partition;
+    }
+
+    const LvmDevice::CacheSettings& settings() const {
+        return m_Settings;
+    }
+
+private:
+    LvmDevice& m_Device;
+    const Partition& m_Partition;
+    const LvmDevice::CacheSettings m_Settings;
+};
+
+#endif
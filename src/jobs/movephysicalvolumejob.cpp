@@ -19,19 +19,116 @@
 #include "jobs/movephysicalvolumejob.h"
 
 #include "core/lvmdevice.h"
+#include "core/lvmsegmentmap.h"
+#include "core/lvmtopology.h"
+#include "core/operationrunner.h"
+#include "fs/luks.h"
 
+#include "util/capacity.h"
 #include "util/report.h"
 
+#include <QElapsedTimer>
+#include <QThread>
+
 #include <KLocalizedString>
 
 /** Creates a new MovePhysicalVolumeJob
  * @param d Device representing LVM Volume Group
 */
 MovePhysicalVolumeJob::MovePhysicalVolumeJob(LvmDevice& d, const QList <const Partition*>& partList) :
+    MovePhysicalVolumeJob(d, partList, d.planPVRemoval(partList))
+{
+}
+
+/** Creates a new MovePhysicalVolumeJob
+ * @param d Device representing LVM Volume Group
+ * @param plan moves predicted when the operation was created
+*/
+MovePhysicalVolumeJob::MovePhysicalVolumeJob(LvmDevice& d, const QList <const Partition*>& partList, const LvmMovePlanner::Plan& plan) :
     Job(),
     m_Device(d),
-    m_PartList(partList)
+    m_PartList(partList),
+    m_Plan(plan),
+    m_BandwidthLimit(0)
+{
+}
+
+/** Plans again with the layout of the volume group as it is now.
+
+    Operations that ran before this job may have changed where the extents are.
+*/
+static LvmMovePlanner::Plan currentPlan(const LvmDevice& d, const QList <const Partition*>& partList, const LvmMovePlanner::Plan& fallback, LvmSegmentMap& segmentMap)
+{
+    const LvmTopology topology = LvmTopology::read();
+    if (!topology.isValid() || !topology.volumeGroup(d.name()))
+        return fallback;
+
+    QStringList removed;
+    for (const auto &p : partList) {
+        if (p->roles().has(PartitionRole::Luks))
+            removed << static_cast<const FS::luks*>(&p->fileSystem())->mapperName();
+        else
+            removed << p->partitionPath();
+    }
+
+    QList<LvmMovePlanner::Volume> volumes;
+    for (const auto &pv : topology.physicalVolumes()) {
+        if (pv.vgName != d.name())
+            continue;
+
+        LvmMovePlanner::Volume volume;
+        volume.name = pv.name;
+        volume.extentCount = pv.extentCount;
+        volume.allocatedExtents = pv.allocatedExtents;
+        volume.remove = removed.contains(pv.name);
+        volumes.append(volume);
+    }
+
+    segmentMap = LvmSegmentMap(topology, d.name());
+    return LvmMovePlanner::plan(volumes, segmentMap, topology.volumeGroup(d.name())->extentSize);
+}
+
+/** @return true if the move shares a PV or a LV with one of the running moves */
+static bool conflicts(const LvmMovePlanner::Move& move, const QList<LvmMovePlanner::Move>& running, const LvmSegmentMap& segmentMap)
+{
+    const QStringList volumes = QStringList(move.source) << move.destinations;
+    const QStringList logicalVolumes = LvmMovePlanner::logicalVolumes(move, segmentMap);
+
+    for (const auto &other : running) {
+        const QStringList otherVolumes = QStringList(other.source) << other.destinations;
+        for (const auto &volume : otherVolumes)
+            if (volumes.contains(volume))
+                return true;
+        for (const auto &uuid : LvmMovePlanner::logicalVolumes(other, segmentMap))
+            if (logicalVolumes.contains(uuid))
+                return true;
+    }
+    return false;
+}
+
+/** @return true if the user asked to cancel the operations this job runs in */
+static bool isCancelling()
 {
+    const OperationRunner* runner = qobject_cast<const OperationRunner*>(QThread::currentThread());
+    return runner && runner->isCancelling();
+}
+
+/** Aborts the running moves, the extents copied so far stay where they are now */
+static void abortMoves(Report& report, const QList<LvmMovePlanner::Move>& running)
+{
+    QStringList sources;
+    for (const auto &move : running)
+        if (!sources.contains(move.source))
+            sources.append(move.source);
+
+    for (const auto &source : qAsConst(sources))
+        if (!LvmDevice::abortMovePV(report, source))
+            report.line() << xi18nc("@info:progress", "Could not abort moving the extents off <filename>%1</filename>.", source);
+}
+
+qint32 MovePhysicalVolumeJob::numSteps() const
+{
+    return 100;
 }
 
 bool MovePhysicalVolumeJob::run(Report& parent)
@@ -40,18 +137,96 @@ bool MovePhysicalVolumeJob::run(Report& parent)
 
     Report* report = jobStarted(parent);
 
-    QStringList destinations = device().deviceNodes();
-    for (const auto &p : partList()) {
-        if (destinations.contains(p->partitionPath())) {
-            destinations.removeAll(p->partitionPath());
-        }
+    LvmSegmentMap segmentMap;
+    const LvmMovePlanner::Plan moves = currentPlan(device(), partList(), plan(), segmentMap);
+    if (!moves.possible) {
+        report->line() << xi18nc("@info:progress", "Not enough free space on the remaining Physical Volumes of %1.", device().name());
+        jobFinished(*report, rval);
+        return rval;
     }
 
-    for (const auto &p : partList()) {
-        rval = LvmDevice::movePV(*report, p->partitionPath(), destinations);
-        if (rval == false) {
+    report->line() << xi18ncp("@info:progress", "Moving %2 in one step.", "Moving %2 in %1 steps.",
+                              moves.moves.size(), Capacity::formatByteSize(moves.bytesMoved));
+
+    // Throttled moves are split into pieces of about ten seconds each
+    const qint64 extentSize = moves.extentsMoved > 0 ? moves.bytesMoved / moves.extentsMoved : 1;
+    const qint64 maxExtents = bandwidthLimit() > 0 ? qMax<qint64>(1, bandwidthLimit() * 10 / extentSize) : 0;
+
+    QList<LvmMovePlanner::Move> pending;
+    for (const auto &move : moves.moves)
+        pending.append(LvmMovePlanner::split(move, maxExtents));
+
+    if (bandwidthLimit() > 0)
+        report->line() << xi18nc("@info:progress", "Limiting the move to %1 per second.", Capacity::formatByteSize(bandwidthLimit()));
+
+    // Moves run in the background, as many at once as touch disjoint PVs and LVs
+    QList<LvmMovePlanner::Move> running;
+    qint64 finishedExtents = 0;
+    qint64 startedBytes = 0;
+    int failedPolls = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    rval = true;
+    while (!running.isEmpty() || (rval && !pending.isEmpty())) {
+        if (isCancelling()) {
+            report->line() << xi18nc("@info:progress", "Cancelled moving the extents, the Physical Volumes of %1 keep what was moved so far.", device().name());
+            abortMoves(*report, running);
+            rval = false;
             break;
         }
+
+        for (auto it = pending.begin(); rval && it != pending.end();) {
+            if (bandwidthLimit() > 0 && startedBytes > bandwidthLimit() * timer.elapsed() / 1000)
+                break;
+            if (conflicts(*it, running, segmentMap)) {
+                ++it;
+                continue;
+            }
+
+            rval = LvmDevice::startMovePV(*report, *it);
+            if (rval) {
+                startedBytes += it->extents * extentSize;
+                running.append(*it);
+                it = pending.erase(it);
+            }
+        }
+
+        QThread::sleep(1);
+
+        // A single failed lvs is not fatal, the moves are only aborted if it keeps failing
+        QMap<QString, qreal> copied;
+        if (!LvmDevice::movePVProgress(device().name(), copied)) {
+            if (++failedPolls < 5)
+                continue;
+
+            report->line() << xi18nc("@info:progress", "Could not read the progress of moving the extents off the Physical Volumes of %1.", device().name());
+            abortMoves(*report, running);
+            rval = false;
+            break;
+        }
+        failedPolls = 0;
+
+        qint64 movedExtents = finishedExtents;
+        for (auto it = running.begin(); it != running.end();) {
+            if (copied.contains(it->source)) {
+                movedExtents += qRound64(it->extents * copied.value(it->source) / 100);
+                ++it;
+            } else {
+                finishedExtents += it->extents;
+                movedExtents += it->extents;
+                it = running.erase(it);
+            }
+        }
+
+        if (moves.extentsMoved > 0)
+            emit progress(movedExtents * 100 / moves.extentsMoved);
+    }
+
+    // An aborted background move is only noticed by what is left behind
+    if (rval && currentPlan(device(), partList(), LvmMovePlanner::Plan(), segmentMap).extentsMoved > 0) {
+        report->line() << xi18nc("@info:progress", "Not all used PE could be moved off the Physical Volumes of %1.", device().name());
+        rval = false;
     }
 
     jobFinished(*report, rval);
@@ -65,5 +240,5 @@ QString MovePhysicalVolumeJob::description() const
     for (const auto &p : partList())
         movedPartitions += p->deviceNode() + QStringLiteral(", ");
     movedPartitions.chop(2);
-    return xi18nc("@info/plain", "Move used PE in %1 on %2 to other available Physical Volumes", movedPartitions, device().name());
+    return xi18nc("@info/plain", "Move used PE in %1 on %2 to other available Physical Volumes (%3)", movedPartitions, device().name(), Capacity::formatByteSize(plan().bytesMoved));
 }
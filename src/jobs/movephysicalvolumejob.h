@@ -19,6 +19,7 @@
 
 #define KPMCORE_MOVEPHYSICALVOLUMEJOB_H
 
+#include "core/lvmmoveplanner.h"
 #include "core/partition.h"
 #include "jobs/job.h"
 
@@ -31,11 +32,20 @@ class MovePhysicalVolumeJob : public Job
 {
 public:
     MovePhysicalVolumeJob(LvmDevice& dev, const QList <const Partition*>& partlist);
+    MovePhysicalVolumeJob(LvmDevice& dev, const QList <const Partition*>& partlist, const LvmMovePlanner::Plan& plan);
 
 public:
     bool run(Report& parent) override;
+    qint32 numSteps() const override;
     QString description() const override;
 
+    /** @return the average bytes per second the move is limited to, or 0 for no limit */
+    qint64 bandwidthLimit() const {
+        return m_BandwidthLimit;
+    }
+    void setBandwidthLimit(qint64 bytesPerSecond) {
+        m_BandwidthLimit = bytesPerSecond;
+    }
 
 protected:
     LvmDevice& device() {
@@ -48,9 +58,16 @@ protected:
         return m_PartList;
     }
 
+    /** @return the plan made when the job was created */
+    const LvmMovePlanner::Plan& plan() const {
+        return m_Plan;
+    }
+
 private:
     LvmDevice& m_Device;
     const QList <const Partition*> m_PartList;
+    LvmMovePlanner::Plan m_Plan;
+    qint64 m_BandwidthLimit;
 };
 
 #endif
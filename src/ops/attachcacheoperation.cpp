@@ -0,0 +1,136 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "ops/attachcacheoperation.h"
+
+#include "core/lvmtopology.h"
+#include "core/partition.h"
+#include "core/partitiontable.h"
+
+#include "fs/luks.h"
+
+#include "jobs/attachcachejob.h"
+
+#include "util/capacity.h"
+
+#include <QString>
+
+#include <KLocalizedString>
+
+#include <algorithm>
+
+/** Creates a new AttachCacheOperation.
+    @param d the Volume Group of the Logical Volume
+    @param p the Logical Volume to cache
+    @param cachePV Physical Volume of d to allocate the cache on
+    @param cacheSize size of the cache in bytes, rounded up to whole extents
+    @param settings type and options of the cache
+*/
+AttachCacheOperation::AttachCacheOperation(LvmDevice& d, Partition& p, const QString& cachePV, qint64 cacheSize, const LvmDevice::CacheSettings& settings) :
+    Operation(),
+    m_Device(d),
+    m_Partition(p),
+    m_CachePV(cachePV),
+    m_CacheExtents((cacheSize + d.peSize() - 1) / d.peSize()),
+    m_Settings(settings),
+    m_OldSettings(d.cacheSettings(p.partitionPath())),
+    m_AttachCacheJob(new AttachCacheJob(d, p, m_CachePV, m_CacheExtents, m_Settings))
+{
+    addJob(attachCacheJob());
+}
+
+bool AttachCacheOperation::targets(const Device& d) const
+{
+    return d == device();
+}
+
+bool AttachCacheOperation::targets(const Partition& p) const
+{
+    return p == partition();
+}
+
+void AttachCacheOperation::preview()
+{
+    device().setCacheSettings(partition().partitionPath(), m_Settings);
+    device().setFreePE(device().freePE() - m_CacheExtents);
+    device().setHiddenExtents(device().hiddenExtents() + m_CacheExtents);
+    device().partitionTable()->setLastUsableSector(PartitionTable::defaultLastUsable(device(), PartitionTable::vmd));
+    device().partitionTable()->updateUnallocated(device());
+}
+
+void AttachCacheOperation::undo()
+{
+    device().setCacheSettings(partition().partitionPath(), m_OldSettings);
+    device().setFreePE(device().freePE() + m_CacheExtents);
+    device().setHiddenExtents(device().hiddenExtents() - m_CacheExtents);
+    device().partitionTable()->setLastUsableSector(PartitionTable::defaultLastUsable(device(), PartitionTable::vmd));
+    device().partitionTable()->updateUnallocated(device());
+}
+
+QString AttachCacheOperation::description() const
+{
+    const QString size = Capacity::formatByteSize(m_CacheExtents * device().peSize());
+    if (m_Settings.type == LvmDevice::CacheType::WriteCache)
+        return xi18nc("@info:status", "Attach a %1 write cache on <filename>%2</filename> to <filename>%3</filename>", size, m_CachePV, partition().deviceNode());
+    return xi18nc("@info:status", "Attach a %1 cache on <filename>%2</filename> to <filename>%3</filename>", size, m_CachePV, partition().deviceNode());
+}
+
+/** Can a cache be attached to a Partition?
+    @param d the Volume Group of the Partition
+    @param p the Partition in question, may be nullptr.
+    @return true if @p p is a Logical Volume without cache
+*/
+bool AttachCacheOperation::canAttachCache(const LvmDevice& d, const Partition* p)
+{
+    if (p == nullptr || !p->roles().has(PartitionRole::Lvm_Lv))
+        return false;
+
+    return d.cacheSettings(p->partitionPath()).type == LvmDevice::CacheType::None && d.freePE() > 0;
+}
+
+/** Can a cache of the given size be allocated on a Physical Volume and attached to a Partition?
+    @param d the Volume Group of the Partition
+    @param p the Partition in question, may be nullptr.
+    @param cachePV the Physical Volume to allocate the cache on
+    @param cacheSize size of the cache in bytes, rounded up to whole extents
+    @return true if @p cachePV belongs to @p d and has enough free extents
+*/
+bool AttachCacheOperation::canAttachCache(const LvmDevice& d, const Partition* p, const QString& cachePV, qint64 cacheSize)
+{
+    if (!canAttachCache(d, p) || cacheSize <= 0)
+        return false;
+
+    const qint64 cacheExtents = (cacheSize + d.peSize() - 1) / d.peSize();
+    if (cacheExtents > d.freePE())
+        return false;
+
+    // LVM knows encrypted PVs by their mapper
+    const auto pvs = d.physicalVolumes();
+    const bool inVG = std::any_of(pvs.begin(), pvs.end(), [&cachePV] (const Partition* pv) {
+        if (pv->roles().has(PartitionRole::Luks))
+            return static_cast<const FS::luks*>(&pv->fileSystem())->mapperName() == cachePV;
+        return pv->partitionPath() == cachePV;
+    });
+    if (!inVG)
+        return false;
+
+    // PVs added by pending operations are not known to LVM yet, but they are empty
+    const LvmTopology topology = LvmTopology::current();
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(cachePV);
+    return pv == nullptr || pv->extentCount < 0 || pv->allocatedExtents < 0 || pv->extentCount - pv->allocatedExtents >= cacheExtents;
+}
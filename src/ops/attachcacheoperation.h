@@ -0,0 +1,93 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#if !defined(KPMCORE_ATTACHCACHEOPERATION_H)
+
+#define KPMCORE_ATTACHCACHEOPERATION_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include "core/lvmdevice.h"
+#include "ops/operation.h"
+
+#include <QString>
+
+class AttachCacheJob;
+class OperationStack;
+class Partition;
+
+/** Attach a cache to a Logical Volume.
+
+    Allocates a dm-cache pool or a dm-writecache volume on a fast Physical
+    Volume of the same Volume Group and puts it in front of the Logical Volume.
+*/
+class LIBKPMCORE_EXPORT AttachCacheOperation : public Operation
+{
+    Q_DISABLE_COPY(AttachCacheOperation)
+
+    friend class OperationStack;
+
+public:
+    AttachCacheOperation(LvmDevice& d, Partition& p, const QString& cachePV, qint64 cacheSize, const LvmDevice::CacheSettings& settings);
+
+public:
+    QString iconName() const override {
+        return QStringLiteral("speedometer");
+    }
+
+    QString description() const override;
+
+    bool targets(const Device& d) const override;
+    bool targets(const Partition& p) const override;
+
+    void preview() override;
+    void undo() override;
+
+    static bool canAttachCache(const LvmDevice& d, const Partition* p);
+    static bool canAttachCache(const LvmDevice& d, const Partition* p, const QString& cachePV, qint64 cacheSize);
+
+protected:
+    LvmDevice& device() {
+        return m_Device;
+    }
+    const LvmDevice& device() const {
+        return m_Device;
+    }
+
+    Partition& partition() {
+        return m_Partition;
+    }
+    const Partition& partition() const {
+        return m_Partition;
+    }
+
+    AttachCacheJob* attachCacheJob() {
+        return m_AttachCacheJob;
+    }
+
+private:
+    LvmDevice& m_Device;
+    Partition& m_Partition;
+    QString m_CachePV;
+    qint64 m_CacheExtents;
+    LvmDevice::CacheSettings m_Settings;
+    LvmDevice::CacheSettings m_OldSettings;
+    AttachCacheJob* m_AttachCacheJob;
+};
+
+#endif
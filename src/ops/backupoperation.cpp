@@ -58,7 +58,8 @@ bool BackupOperation::canBackup(const Partition* p)
     if (p == nullptr)
         return false;
 
-    if (p->isMounted())
+    // Mounted logical volumes are backed up from a snapshot
+    if (p->isMounted() && !p->roles().has(PartitionRole::Lvm_Lv))
         return false;
 
     if (p->state() == Partition::State::New || p->state() == Partition::State::Copy || p->state() == Partition::State::Restore)
@@ -0,0 +1,92 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "ops/createsoftwareraidoperation.h"
+
+#include "core/partition.h"
+
+#include "jobs/createsoftwareraidjob.h"
+
+#include <QString>
+
+#include <KLocalizedString>
+
+/** Creates a new CreateSoftwareRAIDOperation.
+ * @param name name of the array, e.g. md0
+ * @param memberList partitions or disks the array is made of
+ * @param raidLevel RAID level
+ * @param chunkSize chunk size in KiB, 0 to derive it from the members
+ * @param options bitmap, consistency policy and stripe cache settings
+*/
+CreateSoftwareRAIDOperation::CreateSoftwareRAIDOperation(const QString& name, const QVector<const Partition*>& memberList, qint32 raidLevel, qint32 chunkSize,
+                                                         const SoftwareRAID::CreateOptions& options) :
+    Operation(),
+    m_CreateSoftwareRAIDJob(new CreateSoftwareRAIDJob(name, memberList, raidLevel, chunkSize, options)),
+    m_MemberList(memberList),
+    m_Name(name),
+    m_RaidLevel(raidLevel)
+{
+    addJob(createSoftwareRAIDJob());
+}
+
+QString CreateSoftwareRAIDOperation::description() const
+{
+    return xi18nc("@info/plain", "Create a new RAID %1 array named \'%2\'.", m_RaidLevel, m_Name);
+}
+
+bool CreateSoftwareRAIDOperation::targets(const Partition& partition) const
+{
+    for (const auto &p : memberList()) {
+        if (partition == *p)
+            return true;
+    }
+    return false;
+}
+
+void CreateSoftwareRAIDOperation::preview()
+{
+    SoftwareRAID::s_DirtyMembers << memberList();
+}
+
+void CreateSoftwareRAIDOperation::undo()
+{
+    for (const auto &p : memberList())
+        SoftwareRAID::s_DirtyMembers.removeAll(p);
+}
+
+/** Checks if the options can be used with a RAID level.
+ * @param raidLevel RAID level of the new array
+ * @param options options of the new array
+ * @return true if mdadm accepts the combination
+*/
+bool CreateSoftwareRAIDOperation::canCreate(qint32 raidLevel, const SoftwareRAID::CreateOptions& options)
+{
+    switch (options.consistencyPolicy) {
+    case SoftwareRAID::ConsistencyPolicy::Ppl:
+        return raidLevel == 5;
+    case SoftwareRAID::ConsistencyPolicy::Journal:
+        return (raidLevel == 4 || raidLevel == 5 || raidLevel == 6) && !options.journalDevice.isEmpty();
+    case SoftwareRAID::ConsistencyPolicy::Bitmap:
+        return raidLevel != 0 && options.bitmap != SoftwareRAID::WriteIntentBitmap::None;
+    default:
+        break;
+    }
+
+    // RAID 0 has no redundancy to track
+    return raidLevel != 0 || options.bitmap != SoftwareRAID::WriteIntentBitmap::Internal;
+}
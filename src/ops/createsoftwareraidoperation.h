@@ -0,0 +1,82 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#if !defined(KPMCORE_CREATESOFTWARERAIDOPERATION_H)
+
+#define KPMCORE_CREATESOFTWARERAIDOPERATION_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include "ops/operation.h"
+
+#include "core/raid/softwareraid.h"
+
+#include <QString>
+
+class CreateSoftwareRAIDJob;
+class OperationStack;
+
+/** Create a software RAID array.
+
+    Creates a new md array from partitions or disks with mdadm. The members
+    cannot be deleted or resized while the operation is pending.
+*/
+class LIBKPMCORE_EXPORT CreateSoftwareRAIDOperation : public Operation
+{
+    Q_DISABLE_COPY(CreateSoftwareRAIDOperation)
+
+    friend class OperationStack;
+
+public:
+    CreateSoftwareRAIDOperation(const QString& name, const QVector<const Partition*>& memberList, qint32 raidLevel, qint32 chunkSize = 0,
+                                const SoftwareRAID::CreateOptions& options = SoftwareRAID::CreateOptions());
+
+public:
+    QString iconName() const override {
+        return QStringLiteral("document-new");
+    }
+
+    QString description() const override;
+
+    virtual bool targets(const Device&) const override {
+        return true;
+    }
+    virtual bool targets(const Partition&) const override;
+
+    virtual void preview() override;
+    virtual void undo() override;
+
+    static bool canCreate(qint32 raidLevel, const SoftwareRAID::CreateOptions& options);
+
+protected:
+    CreateSoftwareRAIDJob* createSoftwareRAIDJob() {
+        return m_CreateSoftwareRAIDJob;
+    }
+
+    const QVector<const Partition*>& memberList() const {
+        return m_MemberList;
+    }
+
+private:
+    CreateSoftwareRAIDJob* m_CreateSoftwareRAIDJob;
+    const QVector<const Partition*> m_MemberList;
+    QString m_Name;
+    qint32 m_RaidLevel;
+};
+
+#endif
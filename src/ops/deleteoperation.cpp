@@ -120,6 +120,9 @@ bool DeleteOperation::canDelete(const Partition* p)
     if (p->isMounted())
         return false;
 
+    if (SoftwareRAID::s_DirtyMembers.contains(p))
+        return false;
+
     if (p->fileSystem().type() == FileSystem::Type::Lvm2_PV) {
         if (LvmDevice::s_DirtyPVs.contains(p))
             return false;
@@ -0,0 +1,76 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#include "ops/detachcacheoperation.h"
+
+#include "core/partition.h"
+
+#include "jobs/detachcachejob.h"
+
+#include <QString>
+
+#include <KLocalizedString>
+
+/** Creates a new DetachCacheOperation.
+    @param d the Volume Group of the Logical Volume
+    @param p the cached Logical Volume
+*/
+DetachCacheOperation::DetachCacheOperation(LvmDevice& d, Partition& p) :
+    Operation(),
+    m_Device(d),
+    m_Partition(p),
+    m_OldSettings(d.cacheSettings(p.partitionPath())),
+    m_DetachCacheJob(new DetachCacheJob(d, p))
+{
+    addJob(detachCacheJob());
+}
+
+bool DetachCacheOperation::targets(const Device& d) const
+{
+    return d == device();
+}
+
+bool DetachCacheOperation::targets(const Partition& p) const
+{
+    return p == partition();
+}
+
+void DetachCacheOperation::preview()
+{
+    device().setCacheSettings(partition().partitionPath(), LvmDevice::CacheSettings());
+}
+
+void DetachCacheOperation::undo()
+{
+    device().setCacheSettings(partition().partitionPath(), m_OldSettings);
+}
+
+QString DetachCacheOperation::description() const
+{
+    return xi18nc("@info:status", "Detach the cache of <filename>%1</filename>", partition().deviceNode());
+}
+
+/** Can the cache of a Partition be detached?
+    @param d the Volume Group of the Partition
+    @param p the Partition in question, may be nullptr.
+    @return true if @p p is a cached Logical Volume
+*/
+bool DetachCacheOperation::canDetachCache(const LvmDevice& d, const Partition* p)
+{
+    return p != nullptr && d.cacheSettings(p->partitionPath()).type != LvmDevice::CacheType::None;
+}
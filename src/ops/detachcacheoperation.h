@@ -0,0 +1,88 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+
+#if !defined(KPMCORE_DETACHCACHEOPERATION_H)
+
+#define KPMCORE_DETACHCACHEOPERATION_H
+
+#include "util/libpartitionmanagerexport.h"
+
+#include "core/lvmdevice.h"
+#include "ops/operation.h"
+
+#include <QString>
+
+class DetachCacheJob;
+class OperationStack;
+class Partition;
+
+/** Detach the cache of a Logical Volume.
+
+    Data that is only in a write back cache is written to the Logical Volume first.
+*/
+class LIBKPMCORE_EXPORT DetachCacheOperation : public Operation
+{
+    Q_DISABLE_COPY(DetachCacheOperation)
+
+    friend class OperationStack;
+
+public:
+    DetachCacheOperation(LvmDevice& d, Partition& p);
+
+public:
+    QString iconName() const override {
+        return QStringLiteral("edit-delete");
+    }
+
+    QString description() const override;
+
+    bool targets(const Device& d) const override;
+    bool targets(const Partition& p) const override;
+
+    void preview() override;
+    void undo() override;
+
+    static bool canDetachCache(const LvmDevice& d, const Partition* p);
+
+protected:
+    LvmDevice& device() {
+        return m_Device;
+    }
+    const LvmDevice& device() const {
+        return m_Device;
+    }
+
+    Partition& partition() {
+        return m_Partition;
+    }
+    const Partition& partition() const {
+        return m_Partition;
+    }
+
+    DetachCacheJob* detachCacheJob() {
+        return m_DetachCacheJob;
+    }
+
+private:
+    LvmDevice& m_Device;
+    Partition& m_Partition;
+    LvmDevice::CacheSettings m_OldSettings;
+    DetachCacheJob* m_DetachCacheJob;
+};
+
+#endif
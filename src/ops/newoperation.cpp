@@ -40,12 +40,14 @@
 /** Creates a new NewOperation.
     @param d the Device to create a new Partition on
     @param p pointer to the new Partition to create. May not be nullptr.
+    @param layout how the extents are spread over the Physical Volumes if d is a LVM Volume Group
 */
-NewOperation::NewOperation(Device& d, Partition* p) :
+NewOperation::NewOperation(Device& d, Partition* p, const LvmDevice::VolumeLayout& layout) :
     Operation(),
     m_TargetDevice(d),
     m_NewPartition(p),
-    m_CreatePartitionJob(new CreatePartitionJob(targetDevice(), newPartition())),
+    m_VolumeLayout(layout),
+    m_CreatePartitionJob(new CreatePartitionJob(targetDevice(), newPartition(), volumeLayout())),
     m_CreateFileSystemJob(nullptr),
     m_SetPartFlagsJob(nullptr),
     m_SetFileSystemLabelJob(nullptr),
@@ -96,12 +98,19 @@ bool NewOperation::targets(const Partition& p) const
 
 void NewOperation::preview()
 {
+    // The layout decides how many extents the new LV takes
+    if (targetDevice().type() == Device::Type::LVM_Device)
+        static_cast<LvmDevice&>(targetDevice()).setVolumeLayout(newPartition().partitionPath(), volumeLayout());
+
     insertPreviewPartition(targetDevice(), newPartition());
 }
 
 void NewOperation::undo()
 {
     removePreviewPartition(targetDevice(), newPartition());
+
+    if (targetDevice().type() == Device::Type::LVM_Device)
+        static_cast<LvmDevice&>(targetDevice()).setVolumeLayout(newPartition().partitionPath(), LvmDevice::VolumeLayout());
 }
 
 QString NewOperation::description() const
@@ -20,6 +20,7 @@
 
 #define KPMCORE_NEWOPERATION_H
 
+#include "core/lvmdevice.h"
 #include "fs/filesystem.h"
 #include "ops/operation.h"
 #include "util/libpartitionmanagerexport.h"
@@ -48,7 +49,7 @@ class LIBKPMCORE_EXPORT NewOperation : public Operation
     Q_DISABLE_COPY(NewOperation)
 
 public:
-    NewOperation(Device& d, Partition* p);
+    NewOperation(Device& d, Partition* p, const LvmDevice::VolumeLayout& layout = LvmDevice::VolumeLayout());
     ~NewOperation();
 
 public:
@@ -80,6 +81,10 @@ protected:
         return m_TargetDevice;
     }
 
+    const LvmDevice::VolumeLayout& volumeLayout() const {
+        return m_VolumeLayout;
+    }
+
     CreatePartitionJob* createPartitionJob() {
         return m_CreatePartitionJob;
     }
@@ -99,6 +104,7 @@ protected:
 private:
     Device& m_TargetDevice;
     Partition* m_NewPartition;
+    LvmDevice::VolumeLayout m_VolumeLayout;
     CreatePartitionJob* m_CreatePartitionJob;
     CreateFileSystemJob* m_CreateFileSystemJob;
     SetPartFlagsJob* m_SetPartFlagsJob;
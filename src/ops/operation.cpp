@@ -21,6 +21,7 @@
 #include "core/partition.h"
 #include "core/device.h"
 #include "core/lvmdevice.h"
+#include "core/partitiontable.h"
 
 #include "jobs/job.h"
 
@@ -53,8 +54,16 @@ void Operation::insertPreviewPartition(Device& device, Partition& p)
 
     if (p.parent()->insert(&p)) {
         if (device.type() == Device::Type::LVM_Device) {
-            const LvmDevice& lvm = static_cast<const LvmDevice&>(device);
-            lvm.setFreePE(lvm.freePE() - p.length());
+            LvmDevice& lvm = static_cast<LvmDevice&>(device);
+            const LvmDevice::VolumeLayout layout = lvm.volumeLayout(p.partitionPath());
+            const qint64 required = LvmDevice::requiredExtents(layout, p.length());
+            lvm.setFreePE(lvm.freePE() - required);
+            // The table only has room for the size of the LV, the rest of its extents is hidden
+            if (layout.type == LvmDevice::LayoutType::Thin)
+                lvm.setThinExtents(lvm.thinExtents() + p.length());
+            else
+                lvm.setHiddenExtents(lvm.hiddenExtents() + required - p.length());
+            device.partitionTable()->setLastUsableSector(PartitionTable::defaultLastUsable(device, PartitionTable::vmd));
         }
     }
     else
@@ -69,8 +78,15 @@ void Operation::removePreviewPartition(Device& device, Partition& p)
 
     if (p.parent()->remove(&p)) {
         if (device.type() == Device::Type::LVM_Device) {
-            const LvmDevice& lvm = static_cast<const LvmDevice&>(device);
-            lvm.setFreePE(lvm.freePE() + p.length());
+            LvmDevice& lvm = static_cast<LvmDevice&>(device);
+            const LvmDevice::VolumeLayout layout = lvm.volumeLayout(p.partitionPath());
+            const qint64 required = LvmDevice::requiredExtents(layout, p.length());
+            lvm.setFreePE(lvm.freePE() + required);
+            if (layout.type == LvmDevice::LayoutType::Thin)
+                lvm.setThinExtents(lvm.thinExtents() - p.length());
+            else
+                lvm.setHiddenExtents(lvm.hiddenExtents() - required + p.length());
+            device.partitionTable()->setLastUsableSector(PartitionTable::defaultLastUsable(device, PartitionTable::vmd));
         }
 
         device.partitionTable()->updateUnallocated(device);
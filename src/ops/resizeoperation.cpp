@@ -21,11 +21,13 @@
 #include "core/partition.h"
 #include "core/device.h"
 #include "core/lvmdevice.h"
+#include "core/raid/softwareraid.h"
 #include "core/partitiontable.h"
 #include "core/copysourcedevice.h"
 #include "core/copytargetdevice.h"
 
 #include "jobs/checkfilesystemjob.h"
+#include "jobs/detachcachejob.h"
 #include "jobs/setpartgeometryjob.h"
 #include "jobs/resizefilesystemjob.h"
 #include "jobs/movefilesystemjob.h"
@@ -57,6 +59,8 @@ ResizeOperation::ResizeOperation(Device& d, Partition& p, qint64 newfirst, qint6
     m_OrigLastSector(partition().lastSector()),
     m_NewFirstSector(newfirst),
     m_NewLastSector(newlast),
+    m_OldCacheSettings(),
+    m_DetachCacheJob(nullptr),
     m_CheckOriginalJob(new CheckFileSystemJob(partition())),
     m_MoveExtendedJob(nullptr),
     m_ShrinkResizeJob(nullptr),
@@ -67,6 +71,16 @@ ResizeOperation::ResizeOperation(Device& d, Partition& p, qint64 newfirst, qint6
     m_GrowSetGeomJob(nullptr),
     m_CheckResizedJob(nullptr)
 {
+    // Cached LVs are resized without their cache, after it is written back
+    if (d.type() == Device::Type::LVM_Device) {
+        LvmDevice& lvm = static_cast<LvmDevice&>(d);
+        m_OldCacheSettings = lvm.cacheSettings(partition().partitionPath());
+        if (m_OldCacheSettings.type != LvmDevice::CacheType::None) {
+            m_DetachCacheJob = new DetachCacheJob(lvm, partition());
+            addJob(detachCacheJob());
+        }
+    }
+
     if (CheckOperation::canCheck(&partition()))
         addJob(checkOriginalJob());
 
@@ -135,6 +149,10 @@ void ResizeOperation::preview()
     partition().setLastSector(newLastSector());
 
     insertPreviewPartition(targetDevice(), partition());
+
+    // The LV stays without its cache, like after a DetachCacheOperation
+    if (detachCacheJob())
+        static_cast<LvmDevice&>(targetDevice()).setCacheSettings(partition().partitionPath(), LvmDevice::CacheSettings());
 }
 
 void ResizeOperation::undo()
@@ -143,6 +161,9 @@ void ResizeOperation::undo()
     partition().setFirstSector(origFirstSector());
     partition().setLastSector(origLastSector());
     insertPreviewPartition(targetDevice(), partition());
+
+    if (detachCacheJob())
+        static_cast<LvmDevice&>(targetDevice()).setCacheSettings(partition().partitionPath(), m_OldCacheSettings);
 }
 
 bool ResizeOperation::execute(Report& parent)
@@ -151,7 +172,10 @@ bool ResizeOperation::execute(Report& parent)
 
     Report* report = parent.newChild(description());
 
-    if (CheckOperation::canCheck(&partition()))
+    if (detachCacheJob() && !(rval = detachCacheJob()->run(*report)))
+        report->line() << xi18nc("@info:status", "Detaching the cache of <filename>%1</filename> before resize/move failed.", partition().deviceNode());
+
+    if (rval && CheckOperation::canCheck(&partition()))
         rval = checkOriginalJob()->run(*report);
 
     if (rval) {
@@ -334,7 +358,7 @@ bool ResizeOperation::canGrow(const Partition* p)
     if (p == nullptr)
         return false;
 
-    if (isLVMPVinNewlyVG(p))
+    if (isLVMPVinNewlyVG(p) || SoftwareRAID::s_DirtyMembers.contains(p))
         return false;
 
     // we can always grow, shrink or move a partition not yet written to disk
@@ -356,7 +380,7 @@ bool ResizeOperation::canShrink(const Partition* p)
     if (p == nullptr)
         return false;
 
-    if (isLVMPVinNewlyVG(p))
+    if (isLVMPVinNewlyVG(p) || SoftwareRAID::s_DirtyMembers.contains(p))
         return false;
 
     // we can always grow, shrink or move a partition not yet written to disk
@@ -381,7 +405,7 @@ bool ResizeOperation::canMove(const Partition* p)
     if (p == nullptr)
         return false;
 
-    if (isLVMPVinNewlyVG(p))
+    if (isLVMPVinNewlyVG(p) || SoftwareRAID::s_DirtyMembers.contains(p))
         return false;
 
     // we can always grow, shrink or move a partition not yet written to disk
@@ -24,6 +24,7 @@
 
 #include "ops/operation.h"
 
+#include "core/lvmdevice.h"
 #include "core/partition.h"
 
 #include <QString>
@@ -33,6 +34,7 @@ class OperationStack;
 class Report;
 
 class CheckFileSystemJob;
+class DetachCacheJob;
 class SetPartGeometryJob;
 class ResizeFileSystemJob;
 class SetPartGeometryJob;
@@ -130,6 +132,9 @@ protected:
         return newLastSector() - newFirstSector() + 1;
     }
 
+    DetachCacheJob* detachCacheJob() {
+        return m_DetachCacheJob;
+    }
     CheckFileSystemJob* checkOriginalJob() {
         return m_CheckOriginalJob;
     }
@@ -168,6 +173,8 @@ private:
     const qint64 m_OrigLastSector;
     qint64 m_NewFirstSector;
     qint64 m_NewLastSector;
+    LvmDevice::CacheSettings m_OldCacheSettings;
+    DetachCacheJob* m_DetachCacheJob;
     CheckFileSystemJob* m_CheckOriginalJob;
     SetPartGeometryJob* m_MoveExtendedJob;
     ResizeFileSystemJob* m_ShrinkResizeJob;
@@ -19,16 +19,39 @@
 #include "ops/resizevolumegroupoperation.h"
 
 #include "core/lvmdevice.h"
+#include "core/lvmtopology.h"
 #include "core/partition.h"
-#include "fs/lvm2_pv.h"
+#include "core/partitiontable.h"
+#include "jobs/detachcachejob.h"
 #include "jobs/resizevolumegroupjob.h"
 #include "jobs/movephysicalvolumejob.h"
-#include "util/helpers.h"
 
+#include <QSet>
 #include <QString>
+#include <QStringList>
 
 #include <KLocalizedString>
 
+static QString hiddenName(QString name)
+{
+    return name.remove(QLatin1Char('[')).remove(QLatin1Char(']'));
+}
+
+/** @return UUIDs of a cached LV, of the hidden LV with its data and of its cache pool or cache volume */
+static QSet<QString> cacheComponents(const LvmTopology& topology, const LvmTopology::LogicalVolume& cached)
+{
+    QStringList names = { cached.name, cached.name + QStringLiteral("_corig"), cached.name + QStringLiteral("_wcorig") };
+    const QString pool = hiddenName(cached.poolLv);
+    if (!pool.isEmpty())
+        names << pool << pool + QStringLiteral("_cdata") << pool + QStringLiteral("_cmeta");
+
+    QSet<QString> uuids;
+    for (const auto &lv : topology.logicalVolumes(cached.vgName))
+        if (names.contains(hiddenName(lv.name)))
+            uuids.insert(lv.uuid);
+    return uuids;
+}
+
 /** Creates a new ResizeVolumeGroupOperation.
     @param d the Device to create the new PartitionTable on
     @param partList list of LVM Physical Volumes that should be in LVM Volume Group
@@ -40,6 +63,7 @@ ResizeVolumeGroupOperation::ResizeVolumeGroupOperation(LvmDevice& d, const QVect
     , m_CurrentList(d.physicalVolumes())
     , m_TargetSize(0)
     , m_CurrentSize(0)
+    , m_BytesToMove(0)
     , m_GrowVolumeGroupJob(nullptr)
     , m_ShrinkVolumeGroupJob(nullptr)
     , m_MovePhysicalVolumeJob(nullptr)
@@ -59,31 +83,11 @@ ResizeVolumeGroupOperation::ResizeVolumeGroupOperation(LvmDevice& d, const QVect
         if (!currentList().contains(p))
             toInsertList.append(p);
 
-    qint64 currentFreePE = 0;
-    for (const auto &p : currentList()) {
-        FS::lvm2_pv *lvm2PVFs;
-        innerFS(p, lvm2PVFs);
-        currentFreePE += lvm2PVFs->freePE();
-    }
-    qint64 removedFreePE = 0;
-    for (const auto &p : qAsConst(toRemoveList)) {
-        FS::lvm2_pv *lvm2PVFs;
-        innerFS(p, lvm2PVFs);
-        removedFreePE += lvm2PVFs->freePE();
-    }
-    qint64 freePE = currentFreePE - removedFreePE;
-    qint64 movePE = 0;
-    for (const auto &p : qAsConst(toRemoveList)) {
-        FS::lvm2_pv *lvm2PVFs;
-        innerFS(p, lvm2PVFs);
-        movePE += lvm2PVFs->allocatedPE();
-    }
-    qint64 growPE = 0;
-    for (const auto &p : qAsConst(toInsertList)) {
-        growPE += p->capacity() / device().peSize();
-    }
+    // Predict before anything runs how much data pvmove has to copy
+    const LvmMovePlanner::Plan plan = d.planPVRemoval(toRemoveList, toInsertList);
+    m_BytesToMove = plan.bytesMoved;
 
-    if ( movePE > (freePE + growPE)) {
+    if (!plan.possible) {
         // *ABORT* can't move
     } else if (partList == currentList()) {
         // *DO NOTHING*
@@ -93,8 +97,31 @@ ResizeVolumeGroupOperation::ResizeVolumeGroupOperation(LvmDevice& d, const QVect
             addJob(growVolumeGroupJob());
         }
         if (!toRemoveList.isEmpty()) {
-            m_MovePhysicalVolumeJob = new MovePhysicalVolumeJob(d, toRemoveList);
+            m_MovePhysicalVolumeJob = new MovePhysicalVolumeJob(d, toRemoveList, plan);
             m_ShrinkVolumeGroupJob = new ResizeVolumeGroupJob(d, toRemoveList, ResizeVolumeGroupJob::Type::Shrink);
+
+            // pvmove does not move cache pools or cache volumes, write back and detach the caches it would touch
+            if (plan.extentsMoved > 0) {
+                QSet<QString> touched;
+                for (const auto &move : plan.moves)
+                    for (const auto &uuid : LvmMovePlanner::logicalVolumes(move, d.segmentMap()))
+                        touched.insert(uuid);
+
+                const LvmTopology topology = LvmTopology::current();
+                for (const auto &p : d.partitionTable()->children()) {
+                    const LvmDevice::CacheSettings settings = d.cacheSettings(p->partitionPath());
+                    if (settings.type == LvmDevice::CacheType::None)
+                        continue;
+
+                    // Without a report detach to be safe
+                    const LvmTopology::LogicalVolume* lv = topology.logicalVolume(p->partitionPath());
+                    if (lv && !touched.intersects(cacheComponents(topology, *lv)))
+                        continue;
+
+                    m_DetachedCaches.insert(p->partitionPath(), settings);
+                    addJob(new DetachCacheJob(d, *p));
+                }
+            }
             addJob(movePhysicalVolumeJob());
             addJob(shrinkvolumegroupjob());
         }
@@ -139,12 +166,27 @@ void ResizeVolumeGroupOperation::preview()
     device().partitionTable()->setFirstUsableSector(PartitionTable::defaultFirstUsable(device(), PartitionTable::vmd));
     device().partitionTable()->setLastUsableSector(PartitionTable::defaultLastUsable(device(), PartitionTable::vmd));
     device().partitionTable()->updateUnallocated(device());
+
+    for (auto it = m_DetachedCaches.cbegin(); it != m_DetachedCaches.cend(); ++it)
+        device().setCacheSettings(it.key(), LvmDevice::CacheSettings());
 }
 
 void ResizeVolumeGroupOperation::undo()
 {
+    for (auto it = m_DetachedCaches.cbegin(); it != m_DetachedCaches.cend(); ++it)
+        device().setCacheSettings(it.key(), it.value());
+
     device().setTotalLogical(currentSize() / device().logicalSize());
     device().partitionTable()->setFirstUsableSector(PartitionTable::defaultFirstUsable(device(), PartitionTable::vmd));
     device().partitionTable()->setLastUsableSector(PartitionTable::defaultLastUsable(device(), PartitionTable::vmd));
     device().partitionTable()->updateUnallocated(device());
 }
+
+/** Limits how fast extents are moved off the removed Physical Volumes.
+    @param bytesPerSecond average bytes per second, or 0 for no limit
+*/
+void ResizeVolumeGroupOperation::setMoveBandwidthLimit(qint64 bytesPerSecond)
+{
+    if (movePhysicalVolumeJob())
+        movePhysicalVolumeJob()->setBandwidthLimit(bytesPerSecond);
+}
@@ -26,6 +26,7 @@
 
 #include "core/lvmdevice.h"
 
+#include <QMap>
 #include <QString>
 
 class ResizeVolumeGroupJob;
@@ -58,6 +59,13 @@ public:
     QStringList getToRemoveList();
     QStringList getToInsertList();
 
+    /** @return bytes that have to be moved off the removed Physical Volumes */
+    qint64 bytesToMove() const {
+        return m_BytesToMove;
+    }
+
+    void setMoveBandwidthLimit(qint64 bytesPerSecond);
+
 protected:
     LvmDevice& device() {
         return m_Device;
@@ -100,6 +108,8 @@ private:
     QVector<const Partition*> m_CurrentList;
     qint64 m_TargetSize;
     qint64 m_CurrentSize;
+    qint64 m_BytesToMove;
+    QMap<QString, LvmDevice::CacheSettings> m_DetachedCaches; /**< settings before the resize, keyed by LV path */
 
     ResizeVolumeGroupJob *m_GrowVolumeGroupJob;
     ResizeVolumeGroupJob *m_ShrinkVolumeGroupJob;
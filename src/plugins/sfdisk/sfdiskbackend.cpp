@@ -21,11 +21,11 @@
 #include "plugins/sfdisk/sfdiskbackend.h"
 #include "plugins/sfdisk/sfdiskdevice.h"
 
-#include "core/copysourcedevice.h"
-#include "core/copytargetbytearray.h"
+#include "core/devicepropertycache.h"
 #include "core/diskdevice.h"
 #include "core/lvmdevice.h"
 #include "core/partitiontable.h"
+#include "core/partitiontableparser.h"
 #include "core/partitionalignment.h"
 #include "core/raid/softwareraid.h"
 
@@ -39,20 +39,104 @@
 
 #include <QDataStream>
 #include <QDebug>
-#include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QRegularExpression>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QStorageInfo>
 #include <QString>
 #include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
 
 #include <KLocalizedString>
 #include <KPluginFactory>
 
+#include <functional>
+
 K_PLUGIN_FACTORY_WITH_JSON(SfdiskBackendFactory, "pmsfdiskbackendplugin.json", registerPlugin<SfdiskBackend>();)
 
+class ScanTask : public QRunnable
+{
+public:
+    explicit ScanTask(const std::function<void()>& task) : m_Task(task) {}
+
+    void run() override {
+        m_Task();
+    }
+
+private:
+    std::function<void()> m_Task;
+};
+
+/** Scanning mostly waits for external commands, so use more threads than cores. */
+static int maxScanThreads()
+{
+    return qMax(QThread::idealThreadCount(), 4);
+}
+
+/** Pool for scanning whole disks. */
+static QThreadPool* devicePool()
+{
+    static QThreadPool pool;
+    pool.setMaxThreadCount(maxScanThreads());
+    return &pool;
+}
+
+/** Pool for probing partitions. Separate from devicePool(), whose tasks wait for these. */
+static QThreadPool* partitionPool()
+{
+    static QThreadPool pool;
+    pool.setMaxThreadCount(maxScanThreads() * 2);
+    return &pool;
+}
+
+/** Runs task(0) to task(count - 1) on the pool and waits until all of them are done.
+    A single task is run in the calling thread. The tasks take part in the scan of the calling thread.
+    @param done called in the calling thread with the index of each task that finished and the number of finished tasks
+*/
+static void runParallel(QThreadPool& pool, int count, const std::function<void(int)>& task,
+                        const std::function<void(int, int)>& done = std::function<void(int, int)>())
+{
+    if (count == 1) {
+        task(0);
+        if (done)
+            done(0, 1);
+        return;
+    }
+
+    const quint64 generation = DevicePropertyCache::scanGeneration();
+    QMutex finishedMutex;
+    QList<int> finishedTasks;
+    QSemaphore finished;
+    for (int i = 0; i < count; ++i)
+        pool.start(new ScanTask([&task, &finishedMutex, &finishedTasks, &finished, generation, i] {
+            {
+                DevicePropertyCache::Scope scan(generation);
+                task(i);
+            }
+            QMutexLocker locker(&finishedMutex);
+            finishedTasks.append(i);
+            finished.release();
+        }));
+
+    for (int n = 1; n <= count; ++n) {
+        finished.acquire();
+        int i;
+        {
+            QMutexLocker locker(&finishedMutex);
+            i = finishedTasks.takeFirst();
+        }
+        if (done)
+            done(i, n);
+    }
+}
+
 SfdiskBackend::SfdiskBackend(QObject*, const QList<QVariant>&) :
     CoreBackend()
 {
@@ -72,52 +156,37 @@ QList<Device*> SfdiskBackend::scanDevices(const ScanFlags scanFlags)
     const bool includeReadOnly = scanFlags.testFlag(ScanFlag::includeReadOnly);
     const bool includeLoopback = scanFlags.testFlag(ScanFlag::includeLoopback);
 
+    DevicePropertyCache::Scope propertyCache;
+
     QList<Device*> result;
-    QStringList deviceNodes;
-
-    ExternalCommand cmd(QStringLiteral("lsblk"),
-                        { QStringLiteral("--nodeps"),
-                          QStringLiteral("--paths"),
-                          QStringLiteral("--sort"), QStringLiteral("name"),
-                          QStringLiteral("--json"),
-                          QStringLiteral("--output"),
-                          QStringLiteral("type,name") });
-
-    if (cmd.run(-1) && cmd.exitCode() == 0) {
-        const QJsonDocument jsonDocument = QJsonDocument::fromJson(cmd.rawOutput());
-        const QJsonObject jsonObject = jsonDocument.object();
-        const QJsonArray jsonArray = jsonObject[QLatin1String("blockdevices")].toArray();
-        for (const auto &deviceLine : jsonArray) {
-            QJsonObject deviceObject = deviceLine.toObject();
-            if (! (deviceObject[QLatin1String("type")].toString() == QLatin1String("disk")
-                || (includeLoopback && deviceObject[QLatin1String("type")].toString() == QLatin1String("loop")) ))
-            {
-                continue;
-            }
+    QList<BlockDevice> blockDevices;
 
-            const QString deviceNode = deviceObject[QLatin1String("name")].toString();
-            if (!includeReadOnly) {
-                QString deviceName = deviceNode;
-                deviceName.remove(QStringLiteral("/dev/"));
-                QFile f(QStringLiteral("/sys/block/%1/ro").arg(deviceName));
-                if (f.open(QIODevice::ReadOnly))
-                    if (f.readLine().trimmed().toInt() == 1)
-                        continue;
-            }
-            deviceNodes << deviceNode;
-        }
+    const QList<BlockDevice> allBlockDevices = readBlockDevices();
+    for (const auto &blockDevice : allBlockDevices) {
+        if (!(blockDevice.type == QLatin1String("disk") || (includeLoopback && blockDevice.type == QLatin1String("loop"))))
+            continue;
 
-        int totalDevices = deviceNodes.length();
-        for (int i = 0; i < totalDevices; ++i) {
-            const QString deviceNode = deviceNodes[i];
+        if (!includeReadOnly && blockDevice.readOnly)
+            continue;
 
-            emitScanProgress(deviceNode, i * 100 / totalDevices);
-            Device* device = scanDevice(deviceNode);
-            if (device != nullptr) {
-                result.append(device);
-            }
+        blockDevices << blockDevice;
+    }
+
+    // Disks are independent, scan them in parallel and keep the sorted order of lsblk
+    const int totalDevices = blockDevices.length();
+    QVector<Device*> devices(totalDevices, nullptr);
+    Device** scanned = devices.data();
+    runParallel(*devicePool(), totalDevices, [&] (int i) {
+        scanned[i] = scanDevice(blockDevices.at(i), scanFlags);
+    }, [&] (int i, int devicesScanned) {
+        // Reported from this thread in the order the disks finish, so progress only grows
+        emitScanProgress(blockDevices.at(i).node, devicesScanned * 100 / totalDevices);
+    });
+
+    for (Device *device : qAsConst(devices)) {
+        if (device != nullptr) {
+            result.append(device);
         }
-        
     }
 
     VolumeManagerDevice::scanDevices(result); // scan all types of VolumeManagerDevices
@@ -125,6 +194,49 @@ QList<Device*> SfdiskBackend::scanDevices(const ScanFlags scanFlags)
     return result;
 }
 
+/** Lists whole disks with everything needed to create their Device objects.
+
+    A single lsblk call reads all of it from sysfs, so no per-disk processes are needed.
+    @param deviceNode the disk to list or an empty string to list all of them
+*/
+QList<SfdiskBackend::BlockDevice> SfdiskBackend::readBlockDevices(const QString& deviceNode)
+{
+    QStringList args = { QStringLiteral("--nodeps"),
+                         QStringLiteral("--paths"),
+                         QStringLiteral("--bytes"),
+                         QStringLiteral("--sort"), QStringLiteral("name"),
+                         QStringLiteral("--json"),
+                         QStringLiteral("--output"),
+                         QStringLiteral("name,kname,type,size,log-sec,model,tran,ro,rm") };
+    if (!deviceNode.isEmpty())
+        args << deviceNode;
+
+    QList<BlockDevice> blockDevices;
+    ExternalCommand cmd(QStringLiteral("lsblk"), args);
+    if (!cmd.run(-1) || cmd.exitCode() != 0)
+        return blockDevices;
+
+    // Older lsblk versions print every value as a string, newer ones use numbers and booleans
+    const QJsonDocument jsonDocument = QJsonDocument::fromJson(cmd.rawOutput());
+    const QJsonArray jsonArray = jsonDocument.object()[QLatin1String("blockdevices")].toArray();
+    for (const auto &deviceLine : jsonArray) {
+        const QJsonObject deviceObject = deviceLine.toObject();
+
+        BlockDevice blockDevice;
+        blockDevice.node = deviceObject[QLatin1String("name")].toString();
+        blockDevice.kernelName = deviceObject[QLatin1String("kname")].toString();
+        blockDevice.type = deviceObject[QLatin1String("type")].toString();
+        blockDevice.model = deviceObject[QLatin1String("model")].toString().trimmed().replace(QLatin1Char('_'), QLatin1Char(' '));
+        blockDevice.transport = deviceObject[QLatin1String("tran")].toString();
+        blockDevice.size = deviceObject[QLatin1String("size")].toVariant().toLongLong();
+        blockDevice.logicalSectorSize = deviceObject[QLatin1String("log-sec")].toVariant().toLongLong();
+        blockDevice.readOnly = deviceObject[QLatin1String("ro")].toVariant().toBool();
+        blockDevice.removable = deviceObject[QLatin1String("rm")].toVariant().toBool();
+        blockDevices << blockDevice;
+    }
+
+    return blockDevices;
+}
 
 /** Create a Device for the given device_node and scan it for partitions.
     @param deviceNode the device node (e.g. "/dev/sda")
@@ -132,104 +244,86 @@ QList<Device*> SfdiskBackend::scanDevices(const ScanFlags scanFlags)
 */
 Device* SfdiskBackend::scanDevice(const QString& deviceNode)
 {
-    ExternalCommand modelCommand(QStringLiteral("lsblk"),
-                        { QStringLiteral("--nodeps"),
-                          QStringLiteral("--noheadings"),
-                          QStringLiteral("--output"), QStringLiteral("model"),
-                          deviceNode });
-    ExternalCommand sizeCommand(QStringLiteral("blockdev"), { QStringLiteral("--getsize64"), deviceNode });
-    ExternalCommand sizeCommand2(QStringLiteral("blockdev"), { QStringLiteral("--getss"), deviceNode });
-    ExternalCommand jsonCommand(QStringLiteral("sfdisk"), { QStringLiteral("--json"), deviceNode }, QProcess::ProcessChannelMode::SeparateChannels );
-
-    if ( sizeCommand.run(-1) && sizeCommand.exitCode() == 0
-         && sizeCommand2.run(-1) && sizeCommand2.exitCode() == 0
-         && jsonCommand.run(-1) )
-    {
-        Device* d = nullptr;
-        qint64 deviceSize = sizeCommand.output().trimmed().toLongLong();
-        int logicalSectorSize = sizeCommand2.output().trimmed().toLongLong();
+    DevicePropertyCache::Scope propertyCache;
 
-        QFile mdstat(QStringLiteral("/proc/mdstat"));
+    const QList<BlockDevice> blockDevices = readBlockDevices(deviceNode);
+    if (blockDevices.size() == 1)
+        return scanDevice(blockDevices.first());
 
-        if (mdstat.open(QIODevice::ReadOnly)) {
-            QTextStream stream(&mdstat);
+    // Look if this device is a LVM VG
+    ExternalCommand checkVG(QStringLiteral("lvm"), { QStringLiteral("vgdisplay"), deviceNode });
 
-            QString content = stream.readAll();
+    if (checkVG.run(-1) && checkVG.exitCode() == 0)
+    {
+        QList<Device *> availableDevices = scanDevices();
 
-            mdstat.close();
+        for (Device *device : qAsConst(availableDevices))
+            if (device->deviceNode() == deviceNode)
+                return device;
+    }
 
-            QRegularExpression re(QStringLiteral("md([\\/\\w]+)\\s+:"));
-            QRegularExpressionMatchIterator i  = re.globalMatch(content);
+    return nullptr;
+}
 
-            while (i.hasNext()) {
-                QRegularExpressionMatch reMatch = i.next();
-                QString name = reMatch.captured(1);
+/** @overload
+    GPT and MBR tables are read directly from the disk, sfdisk only runs for anything else.
+*/
+Device* SfdiskBackend::scanDevice(const BlockDevice& blockDevice, const ScanFlags scanFlags)
+{
+    const QString& deviceNode = blockDevice.node;
 
-                if ((QStringLiteral("/dev/md") + name) == deviceNode) {
-                    Log(Log::Level::information) << xi18nc("@info:status", "Software RAID Device found: %1", deviceNode);
-                    d = new SoftwareRAID( QStringLiteral("md") + name, SoftwareRAID::Status::Active );
-                    break;
-                }
-            }
-        }
+    if (blockDevice.size <= 0 || blockDevice.logicalSectorSize <= 0)
+        return nullptr;
 
-        if ( d == nullptr && modelCommand.run(-1) && modelCommand.exitCode() == 0 )
-        {
-            QString name = modelCommand.output();
-            name = name.left(name.length() - 1).replace(QLatin1Char('_'), QLatin1Char(' '));
-
-            if (name.trimmed().isEmpty()) {
-                // Get 'lsblk --output kname' in the cases where the model name is not available.
-                // As lsblk doesn't have an option to include a separator in its output, it is
-                // necessary to run it again getting only the kname as output.
-                ExternalCommand kname(QStringLiteral("lsblk"), {QStringLiteral("--nodeps"), QStringLiteral("--noheadings"), QStringLiteral("--output"), QStringLiteral("kname"),
-                                                                deviceNode});
-
-                if (kname.run(-1) && kname.exitCode() == 0)
-                    name = kname.output().trimmed();
-            }
+    QJsonObject partitionTable;
+    ExternalCommand readCommand;
+    auto readDevice = [&readCommand, &deviceNode] (QByteArray& buffer, qint64 offset, qint64 size) {
+        return readCommand.readData(buffer, deviceNode, offset, size);
+    };
 
-            ExternalCommand transport(QStringLiteral("lsblk"), {QStringLiteral("--nodeps"), QStringLiteral("--noheadings"), QStringLiteral("--output"), QStringLiteral("tran"),
-                                                                deviceNode});
-            QString icon;
-            if (transport.run(-1) && transport.exitCode() == 0)
-                if (transport.output().trimmed() == QStringLiteral("usb"))
-                    icon = QStringLiteral("drive-removable-media-usb");
+    if (!PartitionTableParser::parse(readDevice, deviceNode, blockDevice.logicalSectorSize, blockDevice.size / blockDevice.logicalSectorSize, partitionTable)) {
+        ExternalCommand jsonCommand(QStringLiteral("sfdisk"), { QStringLiteral("--json"), deviceNode }, QProcess::ProcessChannelMode::SeparateChannels );
+        if (!jsonCommand.run(-1))
+            return nullptr;
 
-            Log(Log::Level::information) << xi18nc("@info:status", "Device found: %1", name);
+        if (jsonCommand.exitCode() == 0)
+            partitionTable = QJsonDocument::fromJson(jsonCommand.rawOutput()).object()[QLatin1String("partitiontable")].toObject();
+    }
 
-            d = new DiskDevice(name, deviceNode, 255, 63, deviceSize / logicalSectorSize / 255 / 63, logicalSectorSize, icon);
-        }
+    Device* d = nullptr;
+    const qint64 deviceSize = blockDevice.size;
+    const int logicalSectorSize = blockDevice.logicalSectorSize;
 
-        if ( d )
-        {
-            if (jsonCommand.exitCode() != 0)
-                return d;
+    if (SoftwareRAID::isArrayInMdstat(deviceNode)) {
+        Log(Log::Level::information) << xi18nc("@info:status", "Software RAID Device found: %1", deviceNode);
+        d = new SoftwareRAID( deviceNode.mid(QStringLiteral("/dev/").length()), SoftwareRAID::Status::Active );
+    }
 
-            const QJsonObject jsonObject = QJsonDocument::fromJson(jsonCommand.rawOutput()).object();
-            const QJsonObject partitionTable = jsonObject[QLatin1String("partitiontable")].toObject();
+    if ( d == nullptr )
+    {
+        // Use the kernel name in the cases where the model name is not available.
+        const QString name = blockDevice.model.isEmpty() ? blockDevice.kernelName : blockDevice.model;
 
-            if (!updateDevicePartitionTable(*d, partitionTable))
-                return nullptr;
+        QString icon;
+        if (blockDevice.transport == QStringLiteral("usb"))
+            icon = QStringLiteral("drive-removable-media-usb");
+        else if (blockDevice.removable)
+            icon = QStringLiteral("drive-removable-media");
 
-            return d;
-        }
+        Log(Log::Level::information) << xi18nc("@info:status", "Device found: %1", name);
+
+        d = new DiskDevice(name, deviceNode, 255, 63, deviceSize / logicalSectorSize / 255 / 63, logicalSectorSize, icon);
     }
-    else
-    {
-        // Look if this device is a LVM VG
-        ExternalCommand checkVG(QStringLiteral("lvm"), { QStringLiteral("vgdisplay"), deviceNode });
 
-        if (checkVG.run(-1) && checkVG.exitCode() == 0)
-        {
-            QList<Device *> availableDevices = scanDevices();
+    if (partitionTable.isEmpty())
+        return d;
 
-            for (Device *device : qAsConst(availableDevices))
-                if (device->deviceNode() == deviceNode)
-                    return device;
-        }
+    if (!updateDevicePartitionTable(*d, partitionTable, scanFlags)) {
+        delete d;
+        return nullptr;
     }
-    return nullptr;
+
+    return d;
 }
 
 /** Scans a Device for Partitions.
@@ -238,13 +332,58 @@ Device* SfdiskBackend::scanDevice(const QString& deviceNode)
     try to determine the FileSystem usage, read the FileSystem label and store it all in newly created
     objects that are in the end added to the Device's PartitionTable.
 */
-void SfdiskBackend::scanDevicePartitions(Device& d, const QJsonArray& jsonPartitions)
+void SfdiskBackend::scanDevicePartitions(Device& d, const QJsonArray& jsonPartitions, const ScanFlags scanFlags)
 {
     Q_ASSERT(d.partitionTable());
 
+    const bool msdos = d.partitionTable()->type() == PartitionTable::msdos || d.partitionTable()->type() == PartitionTable::msdos_sectorbased;
+
+    // Probing the file systems is independent for every partition, so it runs in parallel
+    QVector<PartitionProbe> probes(jsonPartitions.size());
+    PartitionProbe* probed = probes.data();
+    runParallel(*partitionPool(), jsonPartitions.size(), [&] (int i) {
+        const QJsonObject partitionObject = jsonPartitions[i].toObject();
+        const QString partitionNode = partitionObject[QLatin1String("node")].toString();
+        const qint64 start = partitionObject[QLatin1String("start")].toVariant().toLongLong();
+        const qint64 size = partitionObject[QLatin1String("size")].toVariant().toLongLong();
+        const QString partitionType = partitionObject[QLatin1String("type")].toString();
+
+        PartitionProbe& probe = probed[i];
+
+        FileSystem::Type type = FileSystem::Type::Unknown;
+        if (msdos && ( partitionType == QStringLiteral("5") || partitionType == QStringLiteral("f") ))
+            type = FileSystem::Type::Extended;
+        else
+            type = detectFileSystem(partitionNode);
+
+        FileSystem* fs = FileSystemFactory::create(type, start, start + size - 1, d.logicalSize());
+        fs->scan(partitionNode);
+        probe.fileSystem = fs;
+
+        // sfdisk does not handle LUKS partitions
+        if (fs->type() == FileSystem::Type::Luks || fs->type() == FileSystem::Type::Luks2) {
+            FS::luks* luksFs = static_cast<FS::luks*>(fs);
+            luksFs->initLUKS();
+            QString mapperNode = luksFs->mapperName();
+            probe.mountPoint = FileSystem::detectMountPoint(fs, mapperNode);
+            probe.mounted    = FileSystem::detectMountStatus(fs, mapperNode);
+        } else {
+            probe.mountPoint = FileSystem::detectMountPoint(fs, partitionNode);
+            probe.mounted = FileSystem::detectMountStatus(fs, partitionNode);
+            readSectorsUsed(d, *fs, partitionNode, probe.mountPoint, probe.mounted, scanFlags.testFlag(ScanFlag::deferUsedCapacity));
+        }
+
+        if (fs->supportGetLabel() != FileSystem::cmdSupportNone)
+            fs->setLabel(fs->readLabel(partitionNode));
+
+        if (fs->supportGetUUID() != FileSystem::cmdSupportNone)
+            fs->setUUID(fs->readUUID(partitionNode));
+    });
+
+    // Logical partitions need their extended partition, so the tree is built in order
     QList<Partition*> partitions;
-    for (const auto &partition : jsonPartitions) {
-        const QJsonObject partitionObject = partition.toObject();
+    for (int i = 0; i < jsonPartitions.size(); ++i) {
+        const QJsonObject partitionObject = jsonPartitions[i].toObject();
         const QString partitionNode = partitionObject[QLatin1String("node")].toString();
         const qint64 start = partitionObject[QLatin1String("start")].toVariant().toLongLong();
         const qint64 size = partitionObject[QLatin1String("size")].toVariant().toLongLong();
@@ -256,15 +395,12 @@ void SfdiskBackend::scanDevicePartitions(Device& d, const QJsonArray& jsonPartit
         else if (partitionType == QStringLiteral("21686148-6449-6E6F-744E-656564454649"))
             activeFlags |= PartitionTable::Flag::BiosGrub;
 
-        FileSystem::Type type = FileSystem::Type::Unknown;
-        type = detectFileSystem(partitionNode);
+        const PartitionProbe& probe = probes[i];
+        FileSystem* fs = probe.fileSystem;
         PartitionRole::Roles r = PartitionRole::Primary;
 
-        if ( (d.partitionTable()->type() == PartitionTable::msdos || d.partitionTable()->type() == PartitionTable::msdos_sectorbased) &&
-            ( partitionType == QStringLiteral("5") || partitionType == QStringLiteral("f") ) ) {
+        if (fs->type() == FileSystem::Type::Extended)
             r = PartitionRole::Extended;
-            type = FileSystem::Type::Extended;
-        }
 
         // Find an extended partition this partition is in.
         PartitionNode* parent = d.partitionTable()->findPartitionBySector(start, PartitionRole(PartitionRole::Extended));
@@ -275,40 +411,16 @@ void SfdiskBackend::scanDevicePartitions(Device& d, const QJsonArray& jsonPartit
         else
             r = PartitionRole::Logical;
 
-        FileSystem* fs = FileSystemFactory::create(type, start, start + size - 1, d.logicalSize());
-        fs->scan(partitionNode);
-
-        QString mountPoint;
-        bool mounted;
-        // sfdisk does not handle LUKS partitions
-        if (fs->type() == FileSystem::Type::Luks || fs->type() == FileSystem::Type::Luks2) {
+        if (fs->type() == FileSystem::Type::Luks || fs->type() == FileSystem::Type::Luks2)
             r |= PartitionRole::Luks;
-            FS::luks* luksFs = static_cast<FS::luks*>(fs);
-            luksFs->initLUKS();
-            QString mapperNode = luksFs->mapperName();
-            mountPoint = FileSystem::detectMountPoint(fs, mapperNode);
-            mounted    = FileSystem::detectMountStatus(fs, mapperNode);
-        } else {
-            mountPoint = FileSystem::detectMountPoint(fs, partitionNode);
-            mounted = FileSystem::detectMountStatus(fs, partitionNode);
-        }
 
-        Partition* part = new Partition(parent, d, PartitionRole(r), fs, start, start + size - 1, partitionNode, availableFlags(d.partitionTable()->type()), mountPoint, mounted, activeFlags);
-
-        if (!part->roles().has(PartitionRole::Luks))
-            readSectorsUsed(d, *part, mountPoint);
-
-        if (fs->supportGetLabel() != FileSystem::cmdSupportNone)
-            fs->setLabel(fs->readLabel(part->deviceNode()));
+        Partition* part = new Partition(parent, d, PartitionRole(r), fs, start, start + size - 1, partitionNode, availableFlags(d.partitionTable()->type()), probe.mountPoint, probe.mounted, activeFlags);
 
         if (d.partitionTable()->type() == PartitionTable::TableType::gpt) {
             part->setLabel(partitionObject[QLatin1String("name")].toString());
             part->setUUID(partitionObject[QLatin1String("uuid")].toString());
         }
 
-        if (fs->supportGetUUID() != FileSystem::cmdSupportNone)
-            fs->setUUID(fs->readUUID(part->deviceNode()));
-
         parent->append(part);
         partitions.append(part);
     }
@@ -322,7 +434,7 @@ void SfdiskBackend::scanDevicePartitions(Device& d, const QJsonArray& jsonPartit
         PartitionAlignment::isAligned(d, *part);
 }
 
-bool SfdiskBackend::updateDevicePartitionTable(Device &d, const QJsonObject &jsonPartitionTable)
+bool SfdiskBackend::updateDevicePartitionTable(Device &d, const QJsonObject &jsonPartitionTable, const ScanFlags scanFlags)
 {
     QString tableType = jsonPartitionTable[QLatin1String("label")].toString();
     const PartitionTable::TableType type = PartitionTable::nameToTableType(tableType);
@@ -354,14 +466,14 @@ bool SfdiskBackend::updateDevicePartitionTable(Device &d, const QJsonObject &jso
     switch (type) {
     case PartitionTable::gpt:
     {
-        // Read the maximum number of GPT partitions
+        // Read the maximum number of GPT partitions from the GPT header in LBA 1
         qint32 maxEntries;
         QByteArray gptHeader;
-        CopySourceDevice source(d, 512, 1023);
-        CopyTargetByteArray target(gptHeader);
 
-        ExternalCommand copyCmd;
-        if (copyCmd.copyBlocks(source, target)) {
+        ExternalCommand readCmd;
+        if (jsonPartitionTable.contains(QLatin1String("maxentries")))
+            maxEntries = jsonPartitionTable[QLatin1String("maxentries")].toInt();
+        else if (readCmd.readData(gptHeader, d.deviceNode(), d.logicalSize(), 512)) {
             QByteArray gptMaxEntries = gptHeader.mid(80, 4);
             QDataStream stream(&gptMaxEntries, QIODevice::ReadOnly);
             stream.setByteOrder(QDataStream::LittleEndian);
@@ -376,7 +488,7 @@ bool SfdiskBackend::updateDevicePartitionTable(Device &d, const QJsonObject &jso
         break;
     }
 
-    scanDevicePartitions(d, jsonPartitionTable[QLatin1String("partitions")].toArray());
+    scanDevicePartitions(d, jsonPartitionTable[QLatin1String("partitions")].toArray(), scanFlags);
 
     return true;
 }
@@ -384,42 +496,28 @@ bool SfdiskBackend::updateDevicePartitionTable(Device &d, const QJsonObject &jso
 /** Reads the sectors used in a FileSystem and stores the result in the Partition's FileSystem object.
     @param p the Partition the FileSystem is on
     @param mountPoint mount point of the partition in question
+    @param deferred leave the usage of unmounted file systems unknown instead of running the file system tools
 */
-void SfdiskBackend::readSectorsUsed(const Device& d, Partition& p, const QString& mountPoint)
+void SfdiskBackend::readSectorsUsed(const Device& d, FileSystem& fs, const QString& deviceNode, const QString& mountPoint, bool mounted, bool deferred)
 {
-    if (!mountPoint.isEmpty() && p.fileSystem().type() != FileSystem::Type::LinuxSwap && p.fileSystem().type() != FileSystem::Type::Lvm2_PV) {
+    if (!mountPoint.isEmpty() && fs.type() != FileSystem::Type::LinuxSwap && fs.type() != FileSystem::Type::Lvm2_PV) {
         const QStorageInfo storage = QStorageInfo(mountPoint);
-        if (p.isMounted() && storage.isValid())
-            p.fileSystem().setSectorsUsed( (storage.bytesTotal() - storage.bytesFree()) / d.logicalSize());
+        if (mounted && storage.isValid())
+            fs.setSectorsUsed( (storage.bytesTotal() - storage.bytesFree()) / d.logicalSize());
     }
-    else if (p.fileSystem().supportGetUsed() == FileSystem::cmdSupportFileSystem)
-        p.fileSystem().setSectorsUsed(p.fileSystem().readUsedCapacity(p.deviceNode()) / d.logicalSize());
+    else if (fs.supportGetUsed() == FileSystem::cmdSupportFileSystem && !deferred)
+        fs.setSectorsUsed(fs.readUsedCapacity(deviceNode) / d.logicalSize());
 }
 
 FileSystem::Type SfdiskBackend::detectFileSystem(const QString& partitionPath)
 {
     FileSystem::Type rval = FileSystem::Type::Unknown;
 
-    ExternalCommand udevCommand(QStringLiteral("udevadm"), {
-                                 QStringLiteral("info"),
-                                 QStringLiteral("--query=property"),
-                                 partitionPath });
-
-    if (udevCommand.run(-1) && udevCommand.exitCode() == 0) {
-        QRegularExpression re(QStringLiteral("ID_FS_TYPE=(\\w+)"));
-        QRegularExpression re2(QStringLiteral("ID_FS_VERSION=(\\w+)"));
-        QRegularExpressionMatch reFileSystemType = re.match(udevCommand.output());
-        QRegularExpressionMatch reFileSystemVersion = re2.match(udevCommand.output());
+    const QMap<QString, QString> properties = DevicePropertyCache::fileSystemProperties(partitionPath);
 
-        QString s;
-        if (reFileSystemType.hasMatch()) {
-            s = reFileSystemType.captured(1);
-        }
-
-        QString version;
-        if (reFileSystemVersion.hasMatch()) {
-            version = reFileSystemVersion.captured(1);
-        }
+    if (!properties.isEmpty()) {
+        const QString s = properties.value(QStringLiteral("ID_FS_TYPE"));
+        const QString version = properties.value(QStringLiteral("ID_FS_VERSION"));
 
         if (s == QStringLiteral("ext2")) rval = FileSystem::Type::Ext2;
         else if (s == QStringLiteral("ext3")) rval = FileSystem::Type::Ext3;
@@ -470,32 +568,12 @@ FileSystem::Type SfdiskBackend::detectFileSystem(const QString& partitionPath)
 
 QString SfdiskBackend::readLabel(const QString& deviceNode) const
 {
-    ExternalCommand udevCommand(QStringLiteral("udevadm"), {
-                                 QStringLiteral("info"),
-                                 QStringLiteral("--query=property"),
-                                 deviceNode });
-    udevCommand.run();
-    QRegularExpression re(QStringLiteral("ID_FS_LABEL=(.*)"));
-    QRegularExpressionMatch reFileSystemLabel = re.match(udevCommand.output());
-    if (reFileSystemLabel.hasMatch())
-        return reFileSystemLabel.captured(1);
-
-    return QString();
+    return DevicePropertyCache::fileSystemProperty(deviceNode, QStringLiteral("ID_FS_LABEL"));
 }
 
 QString SfdiskBackend::readUUID(const QString& deviceNode) const
 {
-    ExternalCommand udevCommand(QStringLiteral("udevadm"), {
-                                 QStringLiteral("info"),
-                                 QStringLiteral("--query=property"),
-                                 deviceNode });
-    udevCommand.run();
-    QRegularExpression re(QStringLiteral("ID_FS_UUID=(.*)"));
-    QRegularExpressionMatch reFileSystemUUID = re.match(udevCommand.output());
-    if (reFileSystemUUID.hasMatch())
-        return reFileSystemUUID.captured(1);
-
-    return QString();
+    return DevicePropertyCache::fileSystemProperty(deviceNode, QStringLiteral("ID_FS_UUID"));
 }
 
 PartitionTable::Flags SfdiskBackend::availableFlags(PartitionTable::TableType type)
@@ -24,11 +24,11 @@
 #include "fs/filesystem.h"
 
 #include <QList>
+#include <QString>
 #include <QVariant>
 
 class Device;
 class KPluginFactory;
-class QString;
 
 /** Backend plugin for sfdisk
 
@@ -57,9 +57,31 @@ public:
     QString readUUID(const QString& deviceNode) const override;
 
 private:
-    static void readSectorsUsed(const Device& d, Partition& p, const QString& mountPoint);
-    void scanDevicePartitions(Device& d, const QJsonArray& jsonPartitions);
-    bool updateDevicePartitionTable(Device& d, const QJsonObject& jsonPartitionTable);
+    /** A whole disk as listed by lsblk */
+    struct BlockDevice {
+        QString node;
+        QString kernelName;
+        QString type;
+        QString model;
+        QString transport;
+        qint64 size;
+        qint64 logicalSectorSize;
+        bool readOnly;
+        bool removable;
+    };
+
+    static QList<BlockDevice> readBlockDevices(const QString& deviceNode = QString());
+    Device* scanDevice(const BlockDevice& blockDevice, const ScanFlags scanFlags = ScanFlags());
+    /** What was found out about a partition before it is put into the partition table */
+    struct PartitionProbe {
+        FileSystem* fileSystem = nullptr;
+        QString mountPoint;
+        bool mounted = false;
+    };
+
+    static void readSectorsUsed(const Device& d, FileSystem& fs, const QString& deviceNode, const QString& mountPoint, bool mounted, bool deferred);
+    void scanDevicePartitions(Device& d, const QJsonArray& jsonPartitions, const ScanFlags scanFlags);
+    bool updateDevicePartitionTable(Device& d, const QJsonObject& jsonPartitionTable, const ScanFlags scanFlags = ScanFlags());
     static PartitionTable::Flags availableFlags(PartitionTable::TableType type);
 };
 
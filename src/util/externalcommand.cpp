@@ -25,22 +25,32 @@
 #include "core/copytargetdevice.h"
 #include "util/globallog.h"
 #include "util/externalcommand.h"
+#include "util/externalcommandchannel.h"
+#include "util/externalcommandengine.h"
 #include "util/report.h"
 
 #include "externalcommandhelper_interface.h"
 
+#include <QCoreApplication>
 #include <QCryptographicHash>
 #include <QDBusConnection>
 #include <QDBusInterface>
 #include <QDBusReply>
+#include <QDBusUnixFileDescriptor>
 #include <QEventLoop>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QtGlobal>
 #include <QStandardPaths>
 #include <QString>
 #include <QStringList>
 #include <QTimer>
 #include <QThread>
+#include <QThreadStorage>
 #include <QVariant>
+#include <QWaitCondition>
 
 #include <QtCrypto>
 
@@ -48,6 +58,14 @@
 #include <KJob>
 #include <KLocalizedString>
 
+#include <cerrno>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 struct ExternalCommandPrivate
 {
     Report *m_Report;
@@ -56,16 +74,105 @@ struct ExternalCommandPrivate
     int m_ExitCode;
     QByteArray m_Output;
     QByteArray m_Input;
-    DBusThread *m_thread;
     QProcess::ProcessChannelMode processChannelMode;
+    ExternalCommandChannel *m_Channel = nullptr; // helper channel while running, guarded by runningMutex
+    bool m_Cancelled = false; // guarded by runningMutex
 };
 
 KAuth::ExecuteJob* ExternalCommand::m_job;
 QCA::PrivateKey* ExternalCommand::privateKey;
 QCA::Initializer* ExternalCommand::init;
-bool ExternalCommand::helperStarted = false;
 QWidget* ExternalCommand::parent;
 
+enum class HelperState { NotStarted, GeneratingKey, KeyReady, Authorizing, Started };
+
+static QMutex helperMutex;
+static QWaitCondition helperCondition;
+static HelperState helperState = HelperState::NotStarted;
+static QThread *helperThread = nullptr;
+static DBusThread *dbusThread = nullptr;
+
+// Private helper channel of each thread, a null pointer once it turned out to be unusable
+static QThreadStorage<std::shared_ptr<ExternalCommandChannel>> channels;
+
+// Commands and copies in progress, so that other threads can pause or cancel them
+static QMutex runningMutex;
+static QWaitCondition runningResumed;
+static QList<ExternalCommand*> runningCommands;
+static bool runningPaused = false;
+
+/** Root callers such as installers do not need the helper at all.
+    @return true if commands and copies run inside this process
+*/
+static bool inProcess()
+{
+    static const bool root = ::geteuid() == 0;
+    return root;
+}
+
+static void closeChannel()
+{
+    channels.setLocalData(std::shared_ptr<ExternalCommandChannel>());
+}
+
+static bool preadFully(int fd, char* data, qint64 size, qint64 offset)
+{
+    while (size > 0) {
+        const ssize_t n = ::pread(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool pwriteFully(int fd, const char* data, qint64 size, qint64 offset)
+{
+    while (size > 0) {
+        const ssize_t n = ::pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+/** Waits for the reply to a request sent over the channel.
+    Progress and report messages that arrive before the reply are forwarded as signals.
+*/
+static bool receiveReply(ExternalCommand* command, ExternalCommandChannel* channel, QVariantMap& reply)
+{
+    using Message = ExternalCommandChannel::Message;
+
+    Message type;
+    QVariantMap payload;
+    while (channel->receive(type, payload)) {
+        switch (type) {
+        case Message::Progress:
+            emit command->progress(payload[QStringLiteral("percent")].toInt());
+            break;
+        case Message::Report:
+            command->emitReport(payload);
+            break;
+        case Message::Reply:
+            reply = payload;
+            return true;
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
+
 
 /** Creates a new ExternalCommand instance without Report.
     @param cmd the command to run
@@ -80,9 +187,7 @@ ExternalCommand::ExternalCommand(const QString& cmd, const QStringList& args, co
     d->m_ExitCode = -1;
     d->m_Output = QByteArray();
 
-    if (!helperStarted)
-        if(!startHelper())
-            Log(Log::Level::error) << xi18nc("@info:status", "Could not obtain administrator privileges.");
+    prestartHelper();
 
     d->processChannelMode = processChannelMode;
 }
@@ -101,6 +206,8 @@ ExternalCommand::ExternalCommand(Report& report, const QString& cmd, const QStri
     d->m_ExitCode = -1;
     d->m_Output = QByteArray();
 
+    prestartHelper();
+
     d->processChannelMode = processChannelMode;
 }
 
@@ -115,13 +222,11 @@ ExternalCommand::~ExternalCommand()
 // }
 
 /** Executes the external command.
-    @param timeout timeout to wait for the process to start
+    @param timeout milliseconds after which the process is killed, -1 to wait for it forever
     @return true on success
 */
 bool ExternalCommand::start(int timeout)
 {
-    Q_UNUSED(timeout)
-
     if (command().isEmpty())
         return false;
 
@@ -135,11 +240,58 @@ bool ExternalCommand::start(int timeout)
     if (cmd.isEmpty())
         cmd = QStandardPaths::findExecutable(command(), { QStringLiteral("/sbin/"), QStringLiteral("/usr/sbin/"), QStringLiteral("/usr/local/sbin/") });
 
+    auto finish = [this, timeout] (const QVariantMap& reply) {
+        d->m_Output = reply[QStringLiteral("output")].toByteArray();
+        setExitCode(reply[QStringLiteral("exitCode")].toInt());
+
+        if (report() && reply[QStringLiteral("timedOut")].toBool())
+            report()->line() << xi18nc("@info:status", "Command was killed after %1 seconds.", timeout / 1000);
+        else if (report() && reply[QStringLiteral("cancelled")].toBool())
+            report()->line() << xi18nc("@info:status", "Command was cancelled.");
+
+        return reply[QStringLiteral("success")].toBool();
+    };
+
+    if (inProcess()) {
+        setRunning(nullptr);
+        const QVariantMap reply = ExternalCommandEngine::run(cmd, args(), d->m_Input, d->processChannelMode,
+                                                             timeout, [this] { return isCancelled(false); });
+        setFinished();
+        return finish(reply);
+    }
+
     if (!QDBusConnection::systemBus().isConnected()) {
         qWarning() << "Could not connect to DBus system bus";
         return false;
     }
 
+    if (!startHelper())
+        return false;
+
+    if (ExternalCommandChannel *helper = channel()) {
+        QVariantMap request;
+        request[QStringLiteral("command")] = cmd;
+        request[QStringLiteral("arguments")] = args();
+        request[QStringLiteral("input")] = d->m_Input;
+        request[QStringLiteral("processChannelMode")] = d->processChannelMode;
+        request[QStringLiteral("timeout")] = timeout;
+
+        setRunning(helper);
+        if (helper->send(ExternalCommandChannel::Message::Start, request)) {
+            QVariantMap reply;
+            const bool received = receiveReply(this, helper, reply);
+            setFinished();
+
+            if (received)
+                return finish(reply);
+
+            closeChannel();
+            return false;
+        }
+        setFinished();
+        closeChannel();
+    }
+
     auto *interface = new org::kde::kpmcore::externalcommand(QStringLiteral("org.kde.kpmcore.externalcommand"),
                     QStringLiteral("/Helper"), QDBusConnection::systemBus(), this);
 
@@ -188,11 +340,76 @@ bool ExternalCommand::copyBlocks(const CopySource& source, CopyTarget& target)
     bool rval = true;
     const qint64 blockSize = 10 * 1024 * 1024; // number of bytes per block to copy
 
+    if (inProcess()) {
+        // Same engine as the helper, on a worker thread so the caller's event loop keeps running
+        QVariantMap reply;
+        QThread *worker = QThread::create([&] {
+            reply = ExternalCommandEngine::copyBlocks(source.path(), source.firstByte(), source.length(),
+                                                      target.path(), target.firstByte(), blockSize,
+                                                      [this] (int percent) { emit progress(percent); },
+                                                      [this] (const QVariantMap& report) { emitReport(report); },
+                                                      [this] { return isCancelled(true); });
+        });
+
+        setRunning(nullptr);
+        QEventLoop loop;
+        connect(worker, &QThread::finished, &loop, &QEventLoop::quit);
+        worker->start();
+        loop.exec();
+        worker->wait();
+        delete worker;
+        setFinished();
+
+        rval = reply[QStringLiteral("success")].toBool();
+        target.setBytesWritten(reply[QStringLiteral("bytesWritten")].toLongLong());
+
+        CopyTargetByteArray *byteArrayTarget = dynamic_cast<CopyTargetByteArray*>(&target);
+        if (rval && byteArrayTarget)
+            byteArrayTarget->m_Array = reply[QStringLiteral("targetByteArray")].toByteArray();
+
+        setExitCode(!rval);
+        return rval;
+    }
+
     if (!QDBusConnection::systemBus().isConnected()) {
         qWarning() << "Could not connect to DBus system bus";
         return false;
     }
 
+    if (!startHelper())
+        return false;
+
+    if (ExternalCommandChannel *helper = channel()) {
+        QVariantMap request;
+        request[QStringLiteral("sourceDevice")] = source.path();
+        request[QStringLiteral("sourceFirstByte")] = source.firstByte();
+        request[QStringLiteral("sourceLength")] = source.length();
+        request[QStringLiteral("targetDevice")] = target.path();
+        request[QStringLiteral("targetFirstByte")] = target.firstByte();
+        request[QStringLiteral("blockSize")] = blockSize;
+
+        setRunning(helper);
+        if (helper->send(ExternalCommandChannel::Message::CopyBlocks, request)) {
+            QVariantMap reply;
+            const bool received = receiveReply(this, helper, reply);
+            setFinished();
+            if (!received)
+                closeChannel();
+
+            rval = received && reply[QStringLiteral("success")].toBool();
+            target.setBytesWritten(reply[QStringLiteral("bytesWritten")].toLongLong());
+
+            CopyTargetByteArray *byteArrayTarget = dynamic_cast<CopyTargetByteArray*>(&target);
+            if (rval && byteArrayTarget)
+                byteArrayTarget->m_Array = reply[QStringLiteral("targetByteArray")].toByteArray();
+
+            setExitCode(!rval);
+            return rval;
+        }
+        setFinished();
+        closeChannel();
+    }
+
     // TODO KF6:Use new signal-slot syntax
     connect(m_job, SIGNAL(percent(KJob*, unsigned long)), this, SLOT(emitProgress(KJob*, unsigned long)));
     connect(m_job, &KAuth::ExecuteJob::newData, this, &ExternalCommand::emitReport);
@@ -227,6 +444,7 @@ bool ExternalCommand::copyBlocks(const CopySource& source, CopyTarget& target)
         else {
             QDBusPendingReply<QVariantMap> reply = *watcher;
             rval = reply.value()[QStringLiteral("success")].toBool();
+            target.setBytesWritten(reply.value()[QStringLiteral("bytesWritten")].toLongLong());
 
             CopyTargetByteArray *byteArrayTarget = dynamic_cast<CopyTargetByteArray*>(&target);
             if (byteArrayTarget)
@@ -249,11 +467,54 @@ bool ExternalCommand::writeData(Report& commandReport, const QByteArray& buffer,
 
     bool rval = true;
 
+    const int fd = openDevice(deviceNode, true);
+    if (fd >= 0) {
+        rval = pwriteFully(fd, buffer.constData(), buffer.size(), firstByte);
+
+        // A regular file such as fstab is replaced from firstByte on, do not leave an old tail behind,
+        // ExternalCommandEngine::writeData does the same in the helper.
+        // sysfs attributes look like regular files but cannot be truncated.
+        struct stat info;
+        if (rval && !deviceNode.startsWith(QStringLiteral("/sys/")) && ::fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+            rval = ::ftruncate(fd, firstByte + buffer.size()) == 0;
+
+        ::close(fd);
+        setExitCode(!rval);
+        return rval;
+    }
+
+    if (inProcess()) {
+        setExitCode(1);
+        return false;
+    }
+
     if (!QDBusConnection::systemBus().isConnected()) {
         qWarning() << "Could not connect to DBus system bus";
         return false;
     }
 
+    if (!startHelper())
+        return false;
+
+    if (ExternalCommandChannel *helper = channel()) {
+        QVariantMap request;
+        request[QStringLiteral("buffer")] = buffer;
+        request[QStringLiteral("targetDevice")] = deviceNode;
+        request[QStringLiteral("targetFirstByte")] = firstByte;
+
+        if (helper->send(ExternalCommandChannel::Message::WriteData, request)) {
+            QVariantMap reply;
+            const bool received = receiveReply(this, helper, reply);
+            if (!received)
+                closeChannel();
+
+            rval = received && reply[QStringLiteral("success")].toBool();
+            setExitCode(!rval);
+            return rval;
+        }
+        closeChannel();
+    }
+
     auto *interface = new org::kde::kpmcore::externalcommand(QStringLiteral("org.kde.kpmcore.externalcommand"),
                 QStringLiteral("/Helper"), QDBusConnection::systemBus(), this);
     interface->setTimeout(10 * 24 * 3600 * 1000); // 10 days
@@ -290,6 +551,83 @@ bool ExternalCommand::writeData(Report& commandReport, const QByteArray& buffer,
     return rval;
 }
 
+namespace
+{
+
+/** A range of bytes on a device node that has no Device object */
+class CopySourceNode : public CopySource
+{
+public:
+    CopySourceNode(const QString& deviceNode, qint64 firstByte, qint64 length) :
+        CopySource(),
+        m_DeviceNode(deviceNode),
+        m_FirstByte(firstByte),
+        m_Length(length)
+    {
+    }
+
+    bool open() override {
+        return true;
+    }
+    QString path() const override {
+        return m_DeviceNode;
+    }
+    qint64 length() const override {
+        return m_Length;
+    }
+    bool overlaps(const CopyTarget&) const override {
+        return false;
+    }
+    qint64 firstByte() const override {
+        return m_FirstByte;
+    }
+    qint64 lastByte() const override {
+        return m_FirstByte + m_Length - 1;
+    }
+
+private:
+    QString m_DeviceNode;
+    qint64 m_FirstByte;
+    qint64 m_Length;
+};
+
+}
+
+/** Reads data from a device into a buffer.
+
+    The helper only opens the device and passes the descriptor back, the data
+    itself never goes through D-Bus. If the descriptor cannot be passed, e.g.
+    with an older helper, the data is copied through the helper instead.
+    @param buffer buffer to store the bytes read in
+    @param deviceNode device to read from
+    @param firstByte offset where to begin reading
+    @param size the number of bytes to read
+    @return true on success
+*/
+bool ExternalCommand::readData(QByteArray& buffer, const QString& deviceNode, const quint64 firstByte, const qint64 size)
+{
+    const int fd = openDevice(deviceNode, false);
+    if (fd < 0) {
+        CopySourceNode source(deviceNode, firstByte, size);
+        CopyTargetByteArray target(buffer);
+        if (copyBlocks(source, target) && buffer.size() == size)
+            return true;
+
+        buffer.clear();
+        setExitCode(1);
+        return false;
+    }
+
+    buffer.resize(size);
+    const bool rval = preadFully(fd, buffer.data(), size, firstByte);
+    ::close(fd);
+
+    if (!rval)
+        buffer.clear();
+
+    setExitCode(!rval);
+    return rval;
+}
 
 bool ExternalCommand::write(const QByteArray& input)
 {
@@ -374,65 +712,159 @@ void ExternalCommand::setExitCode(int i)
     d->m_ExitCode = i;
 }
 
-bool ExternalCommand::startHelper()
+/** Starts generating the helper's key in the background and returns immediately.
+
+    The RSA key is generated on a worker thread, which is the slow part.
+    Callers can load plugins and do unprivileged work in the meantime, only
+    the first privileged call waits for the key and authorizes the helper.
+    Does nothing if running as root.
+*/
+void ExternalCommand::prestartHelper()
 {
-    if (!QDBusConnection::systemBus().isConnected()) {
-        qWarning() << "Could not connect to DBus system bus";
-        return false;
+    if (inProcess())
+        return;
+
+    QMutexLocker locker(&helperMutex);
+    if (helperState != HelperState::NotStarted)
+        return;
+
+    helperState = HelperState::GeneratingKey;
+
+    if (helperThread) { // previous attempt failed
+        helperThread->wait();
+        delete helperThread;
     }
-    QDBusInterface iface(QStringLiteral("org.kde.kpmcore.helperinterface"), QStringLiteral("/Helper"), QStringLiteral("org.kde.kpmcore.externalcommand"), QDBusConnection::systemBus());
-    if (iface.isValid()) {
-        exit(0);
+
+    helperThread = QThread::create([] {
+        const bool generated = generateKey();
+
+        QMutexLocker locker(&helperMutex);
+        helperState = generated ? HelperState::KeyReady : HelperState::NotStarted;
+        helperCondition.wakeAll();
+    });
+    helperThread->start();
+}
+
+/** Makes sure the helper is running, waiting for it if it is still starting.
+    @return true if the helper can be used
+*/
+bool ExternalCommand::startHelper()
+{
+    return waitForHelper();
+}
+
+/** The first thread that needs the helper authorizes it with an event loop of its own,
+    so it does not depend on any other thread, the GUI thread included, being responsive.
+    Other threads wait for its result.
+*/
+bool ExternalCommand::waitForHelper()
+{
+    prestartHelper();
+
+    QMutexLocker locker(&helperMutex);
+    while (helperState == HelperState::GeneratingKey || helperState == HelperState::Authorizing)
+        helperCondition.wait(&helperMutex);
+
+    if (helperState == HelperState::KeyReady) {
+        helperState = HelperState::Authorizing;
+        locker.unlock();
+        const bool started = authorizeHelper();
+        locker.relock();
+
+        if (!started)
+            Log(Log::Level::error) << xi18nc("@info:status", "Could not obtain administrator privileges.");
+
+        helperState = started ? HelperState::Started : HelperState::NotStarted;
+        helperCondition.wakeAll();
     }
 
-    d->m_thread = new DBusThread;
-    d->m_thread->start();
+    return helperState == HelperState::Started;
+}
+
+/** Generates the RSA key pair for signing external command requests. */
+bool ExternalCommand::generateKey()
+{
+    if (!init)
+        init = new QCA::Initializer;
 
-    init = new QCA::Initializer;
-    // Generate RSA key pair for signing external command requests
     if (!QCA::isSupported("pkey") || !QCA::PKey::supportedIOTypes().contains(QCA::PKey::RSA)) {
         qCritical() << xi18n("QCA does not support RSA.");
         return false;
     }
 
-    privateKey = new QCA::PrivateKey;
-    *privateKey = QCA::KeyGenerator().createRSA(4096);
-    if(privateKey->isNull()) {
+    QCA::PrivateKey key = QCA::KeyGenerator().createRSA(4096);
+    if(key.isNull()) {
         qCritical() << xi18n("Failed to make private RSA key.");
         return false;
     }
 
-    if (!privateKey->canSign()) {
+    if (!key.canSign()) {
         qCritical() << xi18n("Generated key cannot be used for signatures.");
         return false;
     }
 
-    QCA::PublicKey pubkey = privateKey->toPublicKey();
+    delete privateKey;
+    privateKey = new QCA::PrivateKey(key);
+    return true;
+}
+
+/** Runs the KAuth action that starts the helper and waits for it in a local event loop.
+    @return true if the helper is running
+*/
+bool ExternalCommand::authorizeHelper()
+{
+    if (!QDBusConnection::systemBus().isConnected()) {
+        qWarning() << "Could not connect to DBus system bus";
+        return false;
+    }
+    QDBusInterface iface(QStringLiteral("org.kde.kpmcore.helperinterface"), QStringLiteral("/Helper"), QStringLiteral("org.kde.kpmcore.externalcommand"), QDBusConnection::systemBus());
+    if (iface.isValid()) {
+        exit(0);
+    }
+
+    if (!dbusThread) {
+        dbusThread = new DBusThread;
+        dbusThread->start();
+    }
 
     KAuth::Action action = KAuth::Action(QStringLiteral("org.kde.kpmcore.externalcommand.init"));
     action.setHelperId(QStringLiteral("org.kde.kpmcore.externalcommand"));
     action.setTimeout(10 * 24 * 3600 * 1000); // 10 days
-    action.setParentWidget(parent);
+    // Widgets can only be used on the GUI thread
+    if (QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread())
+        action.setParentWidget(parent);
     QVariantMap arguments;
-    arguments.insert(QStringLiteral("pubkey"), pubkey.toDER());
+    arguments.insert(QStringLiteral("pubkey"), privateKey->toPublicKey().toDER());
     action.setArguments(arguments);
     m_job = action.execute();
-    m_job->start();
 
-    // Wait until ExternalCommand Helper is ready (helper sends newData signal just before it enters event loop)
+    bool started = false;
     QEventLoop loop;
-    auto exitLoop = [&] () { loop.exit(); };
-    auto conn = QObject::connect(m_job, &KAuth::ExecuteJob::newData, exitLoop);
-    QObject::connect(m_job, &KJob::finished, [=] () { if(m_job->error()) exitLoop(); } );
+    // The helper sends newData just before it enters its event loop
+    QObject::connect(m_job, &KAuth::ExecuteJob::newData, &loop, [&] {
+        started = true;
+        loop.quit();
+    });
+    QObject::connect(m_job, &KJob::finished, &loop, &QEventLoop::quit);
+    m_job->start();
     loop.exec();
-    QObject::disconnect(conn);
 
-    helperStarted = true;
-    return true;
+    return started;
 }
 
 void ExternalCommand::stopHelper()
 {
+    {
+        QMutexLocker locker(&helperMutex);
+        while (helperState == HelperState::GeneratingKey || helperState == HelperState::Authorizing)
+            helperCondition.wait(&helperMutex);
+
+        if (helperState != HelperState::Started)
+            return;
+
+        helperState = HelperState::NotStarted;
+    }
+
     auto *interface = new org::kde::kpmcore::externalcommand(QStringLiteral("org.kde.kpmcore.externalcommand"),
                     QStringLiteral("/Helper"), QDBusConnection::systemBus());
     QByteArray request;
@@ -441,8 +873,187 @@ void ExternalCommand::stopHelper()
     QByteArray hash = QCryptographicHash::hash(request, QCryptographicHash::Sha512);
     interface->exit(privateKey->signMessage(hash, QCA::EMSA3_Raw), nonce);
 
+    closeChannel();
+
+    helperThread->wait();
+    delete helperThread;
+    helperThread = nullptr;
+
     delete privateKey;
+    privateKey = nullptr;
     delete init;
+    init = nullptr;
+}
+
+/** Pauses all running copies.
+
+    Copies stop at the next block boundary and wait until resumeRunning() or
+    cancelRunning() is called. Copies started while paused wait before their first block.
+*/
+void ExternalCommand::pauseRunning()
+{
+    QMutexLocker locker(&runningMutex);
+    runningPaused = true;
+    for (const auto &command : qAsConst(runningCommands))
+        if (command->d->m_Channel)
+            command->d->m_Channel->send(ExternalCommandChannel::Message::Pause, QVariantMap());
+}
+
+void ExternalCommand::resumeRunning()
+{
+    QMutexLocker locker(&runningMutex);
+    runningPaused = false;
+    for (const auto &command : qAsConst(runningCommands))
+        if (command->d->m_Channel)
+            command->d->m_Channel->send(ExternalCommandChannel::Message::Resume, QVariantMap());
+    runningResumed.wakeAll();
+}
+
+/** Cancels all running commands and copies.
+
+    Commands are killed, copies stop at the next block boundary. The time until
+    they return is bounded by the helper's poll interval and the time to copy one block.
+*/
+void ExternalCommand::cancelRunning()
+{
+    QMutexLocker locker(&runningMutex);
+    for (const auto &command : qAsConst(runningCommands)) {
+        command->d->m_Cancelled = true;
+        if (command->d->m_Channel)
+            command->d->m_Channel->send(ExternalCommandChannel::Message::Cancel, QVariantMap());
+    }
+    runningResumed.wakeAll();
+}
+
+/** Registers this command as running, so that it can be paused or cancelled.
+    @param helper channel the request is sent over or nullptr if it runs in this process
+*/
+void ExternalCommand::setRunning(ExternalCommandChannel* helper)
+{
+    QMutexLocker locker(&runningMutex);
+    d->m_Channel = helper;
+    d->m_Cancelled = false;
+    runningCommands.append(this);
+
+    if (helper && runningPaused)
+        helper->send(ExternalCommandChannel::Message::Pause, QVariantMap());
+}
+
+void ExternalCommand::setFinished()
+{
+    QMutexLocker locker(&runningMutex);
+    runningCommands.removeOne(this);
+    d->m_Channel = nullptr;
+}
+
+/** Polled by commands and copies that run in this process.
+    @param canPause if true, blocks for as long as running copies are paused
+    @return true if the command or copy was cancelled
+*/
+bool ExternalCommand::isCancelled(bool canPause)
+{
+    QMutexLocker locker(&runningMutex);
+    while (canPause && runningPaused && !d->m_Cancelled)
+        runningResumed.wait(&runningMutex);
+
+    return d->m_Cancelled;
+}
+
+/** Returns the private helper channel of the calling thread, opening it on first use.
+
+    Each thread gets its own socketpair to the helper, which serves it on its own
+    thread. The channel is closed when the thread exits.
+    @return nullptr if no channel can be used, callers then fall back to D-Bus
+*/
+ExternalCommandChannel* ExternalCommand::channel()
+{
+    if (channels.hasLocalData())
+        return channels.localData().get();
+
+    if (!waitForHelper())
+        return nullptr;
+
+    closeChannel();
+
+    if (!(QDBusConnection::systemBus().connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing))
+        return nullptr;
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+        return nullptr;
+
+    org::kde::kpmcore::externalcommand interface(QStringLiteral("org.kde.kpmcore.externalcommand"),
+                    QStringLiteral("/Helper"), QDBusConnection::systemBus());
+    QByteArray request;
+    const quint64 nonce = interface.getNonce();
+    request.setNum(nonce);
+    request.append(QByteArrayLiteral("openChannel"));
+    QByteArray hash = QCryptographicHash::hash(request, QCryptographicHash::Sha512);
+
+    QDBusPendingReply<bool> reply = interface.openChannel(privateKey->signMessage(hash, QCA::EMSA3_Raw), nonce, QDBusUnixFileDescriptor(fds[1]));
+    reply.waitForFinished();
+    ::close(fds[1]);
+
+    if (reply.isError() || !reply.value()) {
+        ::close(fds[0]);
+        return nullptr;
+    }
+
+    channels.setLocalData(std::make_shared<ExternalCommandChannel>(fds[0]));
+    return channels.localData().get();
+}
+
+/** Asks the helper to open a device on our behalf.
+    @param deviceNode device node (or /etc/fstab) to open
+    @param writable open for reading and writing instead of read only
+    @return file descriptor owned by the caller or -1 on failure
+*/
+int ExternalCommand::openDevice(const QString& deviceNode, bool writable)
+{
+    if (inProcess())
+        return ::open(QFile::encodeName(deviceNode).constData(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+
+    if (!waitForHelper())
+        return -1;
+
+    if (ExternalCommandChannel *helper = channel()) {
+        QVariantMap request;
+        request[QStringLiteral("deviceNode")] = deviceNode;
+        request[QStringLiteral("writable")] = writable;
+
+        if (helper->send(ExternalCommandChannel::Message::OpenDevice, request)) {
+            ExternalCommandChannel::Message type;
+            QVariantMap reply;
+            int fd = -1;
+            if (helper->receive(type, reply, &fd) && type == ExternalCommandChannel::Message::Reply)
+                return fd;
+
+            if (fd >= 0)
+                ::close(fd);
+            closeChannel();
+            return -1;
+        }
+        closeChannel();
+    }
+
+    if (!(QDBusConnection::systemBus().connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing))
+        return -1;
+
+    org::kde::kpmcore::externalcommand interface(QStringLiteral("org.kde.kpmcore.externalcommand"),
+                    QStringLiteral("/Helper"), QDBusConnection::systemBus());
+    QByteArray request;
+    const quint64 nonce = interface.getNonce();
+    request.setNum(nonce);
+    request.append(deviceNode.toUtf8());
+    request.append(QByteArray::number(writable));
+    QByteArray hash = QCryptographicHash::hash(request, QCryptographicHash::Sha512);
+
+    QDBusPendingReply<QDBusUnixFileDescriptor> reply = interface.openDevice(privateKey->signMessage(hash, QCA::EMSA3_Raw), nonce, deviceNode, writable);
+    reply.waitForFinished();
+    if (reply.isError() || !reply.value().isValid())
+        return -1;
+
+    return ::fcntl(reply.value().fileDescriptor(), F_DUPFD_CLOEXEC, 0);
 }
 
 quint64 ExternalCommand::getNonce(QDBusInterface& iface)
@@ -38,6 +38,7 @@ class Report;
 class CopySource;
 class CopyTarget;
 class QDBusInterface;
+class ExternalCommandChannel;
 struct ExternalCommandPrivate;
 
 class DBusThread : public QThread
@@ -53,6 +54,9 @@ class DBusThread : public QThread
 
     Runs an external command as a child process.
 
+    Commands normally run through the KAuth helper. If the application
+    already runs as root they are started directly from this process.
+
     @author Volker Lanz <vl@fidra.de>
     @author Andrius Štikonas <andrius@stikonas.eu>
 */
@@ -70,6 +74,7 @@ public:
 public:
     bool copyBlocks(const CopySource& source, CopyTarget& target);
     bool writeData(Report& commandReport, const QByteArray& buffer, const QString& deviceNode, const quint64 firstByte); // same as copyBlocks but from QByteArray
+    bool readData(QByteArray& buffer, const QString& deviceNode, const quint64 firstByte, const qint64 size); // same as copyBlocks but into QByteArray
 
     /**< @param cmd the command to run */
     void setCommand(const QString& cmd);
@@ -87,8 +92,8 @@ public:
     bool write(const QByteArray& input); /**< @param input the input for the program */
 
     bool startCopyBlocks();
-    bool start(int timeout = 30000);
-    bool run(int timeout = 30000);
+    bool start(int timeout = -1);
+    bool run(int timeout = -1);
 
     /**< @return the exit code */
     int exitCode() const;
@@ -104,12 +109,32 @@ public:
     void emitReport(const QVariantMap& report) { emit reportSignal(report); }
 
     // KAuth
-    /**< start ExternalCommand Helper */
+    /**< start ExternalCommand Helper in the background */
+    static void prestartHelper();
+
+    /**< start ExternalCommand Helper and wait until it is ready */
     bool startHelper();
 
     /**< stop ExternalCommand Helper */
     static void stopHelper();
 
+    /**< Opens a device through the helper, or directly when running as root.
+     * Only paths below /dev/ (after resolving symlinks) and /etc/fstab can be opened.
+     * @param deviceNode device node to open
+     * @param writable open for reading and writing instead of read only
+     * @return file descriptor owned by the caller, or -1 on failure
+     */
+    static int openDevice(const QString& deviceNode, bool writable);
+
+    /**< pause all running copies at the next block boundary */
+    static void pauseRunning();
+
+    /**< resume copies paused by pauseRunning() */
+    static void resumeRunning();
+
+    /**< kill all running commands and stop all running copies */
+    static void cancelRunning();
+
     /**< Sets a parent widget for the authentication dialog.
      * @param p parent widget
      */
@@ -129,6 +154,14 @@ private:
 
     void onReadOutput();
     static quint64 getNonce(QDBusInterface& iface);
+    static bool waitForHelper();
+    static bool generateKey();
+    static bool authorizeHelper();
+    static ExternalCommandChannel* channel();
+
+    void setRunning(ExternalCommandChannel* helper);
+    void setFinished();
+    bool isCancelled(bool canPause);
 
 private:
     std::unique_ptr<ExternalCommandPrivate> d;
@@ -138,7 +171,6 @@ private:
     static KAuth::ExecuteJob *m_job;
     static QCA::Initializer *init;
     static QCA::PrivateKey *privateKey;
-    static bool helperStarted;
     static QWidget *parent;
 };
 
@@ -31,6 +31,7 @@ QStringLiteral("lvm"),
 QStringLiteral("mdadm"),
 QStringLiteral("mount"),
 QStringLiteral("umount"),
+QStringLiteral("fsfreeze"),
 QStringLiteral("smartctl"),
 
 // FileSystem utilties
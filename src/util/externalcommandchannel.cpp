@@ -0,0 +1,217 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "util/externalcommandchannel.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QtEndian>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Frames bigger than this are treated as a corrupted stream
+static const quint32 maxPayloadSize = 512 * 1024 * 1024;
+static const qint64 headerSize = sizeof(quint8) + sizeof(quint32);
+
+/** Takes ownership of an already connected socket.
+    @param fd socket file descriptor, closed on destruction
+*/
+ExternalCommandChannel::ExternalCommandChannel(int fd) :
+    m_fd(fd)
+{
+}
+
+ExternalCommandChannel::~ExternalCommandChannel()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+/** Sends one message. Safe to call from several threads.
+    @param type message type
+    @param payload message arguments
+    @param passedFd file descriptor to pass along with the message or -1
+    @return true on success
+*/
+bool ExternalCommandChannel::send(Message type, const QVariantMap& payload, int passedFd)
+{
+    QByteArray frame;
+    QDataStream stream(&frame, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_10);
+    stream << static_cast<quint8>(type) << quint32(0) << payload;
+
+    const quint32 payloadSize = frame.size() - headerSize;
+    if (payloadSize > maxPayloadSize)
+        return false;
+
+    qToBigEndian(payloadSize, frame.data() + sizeof(quint8));
+
+    QMutexLocker locker(&m_WriteMutex);
+    if (passedFd < 0)
+        return writeFully(frame.constData(), frame.size());
+
+    // Attach the descriptor to the first byte of the frame
+    iovec iov;
+    iov.iov_base = frame.data();
+    iov.iov_len = 1;
+
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &passedFd, sizeof(int));
+
+    ssize_t n;
+    do {
+        n = ::sendmsg(m_fd, &message, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n != 1)
+        return false;
+
+    return writeFully(frame.constData() + 1, frame.size() - 1);
+}
+
+/** Blocks until the next message arrives.
+    @param type message type that was received
+    @param payload message arguments that were received
+    @param passedFd set to the file descriptor passed along with the message or -1.
+           If nullptr, passed descriptors are closed.
+    @return false if the other end closed the channel or sent garbage
+*/
+bool ExternalCommandChannel::receive(Message& type, QVariantMap& payload, int* passedFd)
+{
+    if (passedFd)
+        *passedFd = -1;
+
+    char header[headerSize];
+    int fd = -1;
+    if (!readFirstByte(header, fd))
+        return false;
+
+    bool rval = readFully(header + 1, headerSize - 1);
+
+    const quint32 payloadSize = rval ? qFromBigEndian<quint32>(header + sizeof(quint8)) : 0;
+    rval = rval && payloadSize <= maxPayloadSize;
+
+    QByteArray data;
+    if (rval) {
+        data.resize(payloadSize);
+        rval = readFully(data.data(), payloadSize);
+    }
+
+    if (rval) {
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_5_10);
+        payload.clear();
+        stream >> payload;
+        rval = stream.status() == QDataStream::Ok;
+    }
+
+    if (rval && passedFd)
+        *passedFd = fd;
+    else if (fd >= 0)
+        ::close(fd);
+
+    if (rval)
+        type = static_cast<Message>(header[0]);
+
+    return rval;
+}
+
+bool ExternalCommandChannel::readFirstByte(char* data, int& passedFd)
+{
+    iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = 1;
+
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t n;
+    do {
+        n = ::recvmsg(m_fd, &message, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    if (n != 1)
+        return false;
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            std::memcpy(&passedFd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    return true;
+}
+
+bool ExternalCommandChannel::readFully(char* data, qint64 size)
+{
+    while (size > 0) {
+        const ssize_t n = ::read(m_fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool ExternalCommandChannel::writeFully(const char* data, qint64 size)
+{
+    while (size > 0) {
+        // MSG_NOSIGNAL: a dead peer should fail the call, not kill us with SIGPIPE
+        const ssize_t n = ::send(m_fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_EXTERNALCOMMANDCHANNEL_H
+#define KPMCORE_EXTERNALCOMMANDCHANNEL_H
+
+#include <QMutex>
+#include <QtGlobal>
+#include <QVariant>
+
+/** A private stream between the application and the KAuth helper.
+
+    The channel is one end of a socketpair whose other end was handed over
+    to the helper through a signed D-Bus call. Possession of the socket is
+    the authentication, so requests sent over it are not signed again.
+
+    Every message is a small binary frame: a one byte message type and a
+    32-bit big-endian payload length followed by a QDataStream serialized
+    QVariantMap. One request is in flight per channel at a time, its reply
+    may be preceded by any number of progress and report messages.
+*/
+class ExternalCommandChannel
+{
+    Q_DISABLE_COPY(ExternalCommandChannel)
+
+public:
+    enum class Message : quint8 {
+        Start = 1,
+        CopyBlocks,
+        WriteData,
+        Progress,
+        Report,
+        Reply,
+        OpenDevice,
+        Pause,
+        Resume,
+        Cancel
+    };
+
+    explicit ExternalCommandChannel(int fd);
+    ~ExternalCommandChannel();
+
+public:
+    bool send(Message type, const QVariantMap& payload, int passedFd = -1);
+    bool receive(Message& type, QVariantMap& payload, int* passedFd = nullptr);
+
+    int fd() const { return m_fd; } /**< @return the socket file descriptor */
+
+private:
+    bool readFirstByte(char* data, int& passedFd);
+    bool readFully(char* data, qint64 size);
+    bool writeFully(const char* data, qint64 size);
+
+private:
+    int m_fd;
+    QMutex m_WriteMutex;
+};
+
+#endif
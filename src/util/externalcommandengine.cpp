@@ -0,0 +1,264 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#include "util/externalcommandengine.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QTime>
+
+#include <KLocalizedString>
+
+// How often running commands are checked for timeouts and cancel requests (milliseconds)
+static const int pollInterval = 100;
+
+/** Runs a command and waits for it to finish.
+    @param command full path of the executable
+    @param arguments command line arguments
+    @param input data written to the standard input of the command
+    @param processChannelMode a QProcess::ProcessChannelMode
+    @param timeout milliseconds after which the command is killed, -1 to wait forever
+    @param cancelled polled while the command runs, the command is killed if it returns true
+    @return reply map with success flag, output and exitCode
+*/
+QVariantMap ExternalCommandEngine::run(const QString& command, const QStringList& arguments, const QByteArray& input, const int processChannelMode,
+                                       const int timeout, const std::function<bool()>& cancelled)
+{
+    QVariantMap reply;
+    reply[QStringLiteral("success")] = true;
+
+    QProcess cmd;
+    cmd.setEnvironment( { QStringLiteral("LVM_SUPPRESS_FD_WARNINGS=1") } );
+    cmd.setProcessChannelMode(static_cast<QProcess::ProcessChannelMode>(processChannelMode));
+    cmd.start(command, arguments);
+    cmd.write(input);
+    cmd.closeWriteChannel();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Wake up regularly, so timeouts and cancel requests are handled within a fraction of a second
+    while (!cmd.waitForFinished(pollInterval)) {
+        if (cmd.state() == QProcess::NotRunning)
+            break;
+
+        const bool timedOut = timeout >= 0 && timer.hasExpired(timeout);
+        if (timedOut || (cancelled && cancelled())) {
+            cmd.kill();
+            cmd.waitForFinished(-1);
+            reply[QStringLiteral("success")] = false;
+            reply[timedOut ? QStringLiteral("timedOut") : QStringLiteral("cancelled")] = true;
+            break;
+        }
+    }
+
+    QByteArray output = cmd.readAllStandardOutput();
+    reply[QStringLiteral("output")] = output;
+    reply[QStringLiteral("exitCode")] = cmd.exitCode();
+
+    return reply;
+}
+
+/** Reads the given number of bytes from the sourceDevice into the given buffer.
+    @param sourceDevice device or file to read from
+    @param buffer buffer to store the bytes read in
+    @param offset offset where to begin reading
+    @param size the number of bytes to read
+    @return true on success
+*/
+bool ExternalCommandEngine::readData(const QString& sourceDevice, QByteArray& buffer, const qint64 offset, const qint64 size)
+{
+    QFile device(sourceDevice);
+
+    if (!device.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        qCritical() << xi18n("Could not open device <filename>%1</filename> for reading.", sourceDevice);
+        return false;
+    }
+
+    if (!device.seek(offset)) {
+        qCritical() << xi18n("Could not seek position %1 on device <filename>%2</filename>.", offset, sourceDevice);
+        return false;
+    }
+
+    buffer = device.read(size);
+
+    if (size != buffer.size()) {
+        qCritical() << xi18n("Could not read from device <filename>%1</filename>.", sourceDevice);
+         return false;
+    }
+
+    return true;
+}
+
+/** Writes the data from buffer to a given device or file.
+    @param targetDevice device or file to write to
+    @param buffer the data that we write
+    @param offset offset where to begin writing
+    @return true on success
+*/
+bool ExternalCommandEngine::writeData(const QString &targetDevice, const QByteArray& buffer, const qint64 offset)
+{
+    QFile device(targetDevice);
+
+    // WriteOnly alone would truncate and Append ignores the offset, the tail is cut below instead
+    if (!device.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        qCritical() << xi18n("Could not open device <filename>%1</filename> for writing.", targetDevice);
+        return false;
+    }
+
+    if (!device.seek(offset)) {
+        qCritical() << xi18n("Could not seek position %1 on device <filename>%2</filename>.", offset, targetDevice);
+        return false;
+    }
+
+    if (device.write(buffer) != buffer.size()) {
+        qCritical() << xi18n("Could not write to device <filename>%1</filename>.", targetDevice);
+        return false;
+    }
+
+    // A regular file such as fstab is replaced from offset on, like ExternalCommand::writeData does
+    // with a descriptor. sysfs attributes look like regular files but cannot be truncated.
+    if (!targetDevice.startsWith(QStringLiteral("/sys/")) && QFileInfo(targetDevice).isFile() && !device.resize(offset + buffer.size())) {
+        qCritical() << xi18n("Could not truncate <filename>%1</filename>.", targetDevice);
+        return false;
+    }
+
+    return true;
+}
+
+/** Copies blocks from source to target.
+
+    The copy goes backwards if the target starts behind the source, so overlapping
+    ranges on the same device are handled. If targetDevice is empty then the data
+    that was read is returned in the reply as targetByteArray.
+    @param progress called with the percentage done
+    @param report called with report lines for the application
+    @param cancelled called before every block, copying stops if it returns true.
+           It may block for as long as copying is paused.
+    @return reply map with success flag, bytesWritten and, for an empty target, the data read
+*/
+QVariantMap ExternalCommandEngine::copyBlocks(const QString& sourceDevice, const qint64 sourceFirstByte, const qint64 sourceLength, const QString& targetDevice, const qint64 targetFirstByte, const qint64 blockSize,
+                                              const std::function<void(int)>& progress, const std::function<void(const QVariantMap&)>& report,
+                                              const std::function<bool()>& cancelled)
+{
+    QVariantMap reply;
+    reply[QStringLiteral("success")] = true;
+
+    const qint64 blocksToCopy = sourceLength / blockSize;
+    qint64 readOffset = sourceFirstByte;
+    qint64 writeOffset = targetFirstByte;
+    qint32 copyDirection = 1;
+
+    if (targetFirstByte > sourceFirstByte) {
+        readOffset = sourceFirstByte + sourceLength - blockSize;
+        writeOffset = targetFirstByte + sourceLength - blockSize;
+        copyDirection = -1;
+    }
+
+    const qint64 lastBlock = sourceLength % blockSize;
+
+    qint64 bytesWritten = 0;
+    qint64 blocksCopied = 0;
+
+    QByteArray buffer;
+    int percent = 0;
+    QTime t;
+
+    t.start();
+
+    QVariantMap reportLine;
+
+    reportLine[QStringLiteral("report")] = xi18nc("@info:progress", "Copying %1 blocks (%2 bytes) from %3 to %4, direction: %5.", blocksToCopy,
+                                              sourceLength, readOffset, writeOffset, copyDirection == 1 ? i18nc("direction: left", "left")
+                                              : i18nc("direction: right", "right"));
+
+    report(reportLine);
+
+    bool rval = true;
+    bool wasCancelled = false;
+
+    while (blocksCopied < blocksToCopy && !targetDevice.isEmpty()) {
+        if (cancelled && cancelled()) {
+            wasCancelled = true;
+            rval = false;
+            break;
+        }
+
+        if (!(rval = readData(sourceDevice, buffer, readOffset + blockSize * blocksCopied * copyDirection, blockSize)))
+            break;
+
+        if (!(rval = writeData(targetDevice, buffer, writeOffset + blockSize * blocksCopied * copyDirection)))
+            break;
+
+        bytesWritten += buffer.size();
+
+        if (++blocksCopied * 100 / blocksToCopy != percent) {
+            percent = blocksCopied * 100 / blocksToCopy;
+
+            if (percent % 5 == 0 && t.elapsed() > 1000) {
+                const qint64 mibsPerSec = (blocksCopied * blockSize / 1024 / 1024) / (t.elapsed() / 1000);
+                const qint64 estSecsLeft = (100 - percent) * t.elapsed() / percent / 1000;
+                reportLine[QStringLiteral("report")] =  xi18nc("@info:progress", "Copying %1 MiB/second, estimated time left: %2", mibsPerSec, QTime(0, 0).addSecs(estSecsLeft).toString());
+                report(reportLine);
+            }
+            progress(percent);
+        }
+    }
+
+    if (rval && lastBlock > 0 && cancelled && cancelled()) {
+        wasCancelled = true;
+        rval = false;
+    }
+
+    // copy the remainder
+    if (rval && lastBlock > 0) {
+        Q_ASSERT(lastBlock < blockSize);
+
+        const qint64 lastBlockReadOffset = copyDirection > 0 ? readOffset + blockSize * blocksCopied : sourceFirstByte;
+        const qint64 lastBlockWriteOffset = copyDirection > 0 ? writeOffset + blockSize * blocksCopied : targetFirstByte;
+        reportLine[QStringLiteral("report")] = xi18nc("@info:progress", "Copying remainder of block size %1 from %2 to %3.", lastBlock, lastBlockReadOffset, lastBlockWriteOffset);
+        report(reportLine);
+        rval = readData(sourceDevice, buffer, lastBlockReadOffset, lastBlock);
+
+        if (rval) {
+            if (targetDevice.isEmpty())
+                reply[QStringLiteral("targetByteArray")] = buffer;
+            else
+                rval = writeData(targetDevice, buffer, lastBlockWriteOffset);
+        }
+
+        if (rval) {
+            progress(100);
+            bytesWritten += buffer.size();
+        }
+    }
+
+    if (wasCancelled)
+        reportLine[QStringLiteral("report")] = xi18ncp("@info:progress argument 2 is a string such as 7 bytes (localized accordingly)", "Copying cancelled after 1 block (%2).", "Copying cancelled after %1 blocks (%2).", blocksCopied, i18np("1 byte", "%1 bytes", bytesWritten));
+    else
+        reportLine[QStringLiteral("report")] = xi18ncp("@info:progress argument 2 is a string such as 7 bytes (localized accordingly)", "Copying 1 block (%2) finished.", "Copying %1 blocks (%2) finished.", blocksCopied, i18np("1 byte", "%1 bytes", bytesWritten));
+    report(reportLine);
+
+    reply[QStringLiteral("success")] = rval;
+    reply[QStringLiteral("cancelled")] = wasCancelled;
+    reply[QStringLiteral("bytesWritten")] = bytesWritten;
+    return reply;
+}
+
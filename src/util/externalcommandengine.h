@@ -0,0 +1,45 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+#ifndef KPMCORE_EXTERNALCOMMANDENGINE_H
+#define KPMCORE_EXTERNALCOMMANDENGINE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+#include <functional>
+
+/** The code that does the actual work for ExternalCommand.
+
+    It is used by the KAuth helper and, when the application already runs
+    as root, directly by ExternalCommand in the application process.
+*/
+class ExternalCommandEngine
+{
+public:
+    static QVariantMap run(const QString& command, const QStringList& arguments, const QByteArray& input, const int processChannelMode,
+                           const int timeout = -1, const std::function<bool()>& cancelled = {});
+    static QVariantMap copyBlocks(const QString& sourceDevice, const qint64 sourceFirstByte, const qint64 sourceLength, const QString& targetDevice, const qint64 targetFirstByte, const qint64 blockSize,
+                                  const std::function<void(int)>& progress, const std::function<void(const QVariantMap&)>& report,
+                                  const std::function<bool()>& cancelled = {});
+    static bool readData(const QString& sourceDevice, QByteArray& buffer, const qint64 offset, const qint64 size);
+    static bool writeData(const QString& targetDevice, const QByteArray& buffer, const qint64 offset);
+};
+
+#endif
@@ -18,16 +18,26 @@
 #include "externalcommandhelper.h"
 #include "externalcommand_interface.h"
 #include "externalcommand_whitelist.h"
+#include "externalcommandchannel.h"
+#include "externalcommandengine.h"
 
 #include <QtDBus>
 #include <QDebug>
 #include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRegularExpression>
 #include <QString>
 #include <QTime>
 #include <QVariant>
 
 #include <KLocalizedString>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 /** Initialize ExternalCommandHelper Daemon and prepare DBus interface
  *
  * KAuth helper runs in the background until application exits.
@@ -64,6 +74,7 @@ ActionReply ExternalCommandHelper::init(const QVariantMap& args)
     }
 
     m_publicKey = QCA::PublicKey::fromDER(args[QStringLiteral("pubkey")].toByteArray());
+    QTextCodec::setCodecForLocale(QTextCodec::codecForName("UTF-8"));
 
     m_loop = std::make_unique<QEventLoop>();
     HelperSupport::progressStep(QVariantMap());
@@ -80,6 +91,20 @@ ActionReply ExternalCommandHelper::init(const QVariantMap& args)
     });
 
     m_loop->exec();
+
+    // Idle channels are woken up with EOF, busy ones finish their current request first.
+    QList<QThread*> channelThreads;
+    {
+        QMutexLocker locker(&m_ChannelMutex);
+        for (int fd : qAsConst(m_ChannelSockets))
+            ::shutdown(fd, SHUT_RD);
+        channelThreads = m_ChannelThreads;
+    }
+    for (QThread *thread : qAsConst(channelThreads)) {
+        thread->wait();
+        delete thread;
+    }
+
     reply.addData(QStringLiteral("success"), true);
 
     return reply;
@@ -95,65 +120,6 @@ quint64 ExternalCommandHelper::getNonce()
     return nonce;
 }
 
-/** Reads the given number of bytes from the sourceDevice into the given buffer.
-    @param sourceDevice device or file to read from
-    @param buffer buffer to store the bytes read in
-    @param offset offset where to begin reading
-    @param size the number of bytes to read
-    @return true on success
-*/
-bool ExternalCommandHelper::readData(const QString& sourceDevice, QByteArray& buffer, const qint64 offset, const qint64 size)
-{
-    QFile device(sourceDevice);
-
-    if (!device.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
-        qCritical() << xi18n("Could not open device <filename>%1</filename> for reading.", sourceDevice);
-        return false;
-    }
-
-    if (!device.seek(offset)) {
-        qCritical() << xi18n("Could not seek position %1 on device <filename>%2</filename>.", offset, sourceDevice);
-        return false;
-    }
-
-    buffer = device.read(size);
-
-    if (size != buffer.size()) {
-        qCritical() << xi18n("Could not read from device <filename>%1</filename>.", sourceDevice);
-         return false;
-    }
-
-    return true;
-}
-
-/** Writes the data from buffer to a given device or file.
-    @param targetDevice device or file to write to
-    @param buffer the data that we write
-    @param offset offset where to begin writing
-    @return true on success
-*/
-bool ExternalCommandHelper::writeData(const QString &targetDevice, const QByteArray& buffer, const qint64 offset)
-{
-    QFile device(targetDevice);
-
-    if (!device.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
-        qCritical() << xi18n("Could not open device <filename>%1</filename> for writing.", targetDevice);
-        return false;
-    }
-
-    if (!device.seek(offset)) {
-        qCritical() << xi18n("Could not seek position %1 on device <filename>%2</filename>.", offset, targetDevice);
-        return false;
-    }
-
-    if (device.write(buffer) != buffer.size()) {
-        qCritical() << xi18n("Could not write to device <filename>%1</filename>.", targetDevice);
-        return false;
-    }
-
-    return true;
-}
-
 // If targetDevice is empty then return QByteArray with data that was read from disk.
 QVariantMap ExternalCommandHelper::copyblocks(const QByteArray& signature, const quint64 nonce, const QString& sourceDevice, const qint64 sourceFirstByte, const qint64 sourceLength, const QString& targetDevice, const qint64 targetFirstByte, const qint64 blockSize)
 {
@@ -184,88 +150,9 @@ QVariantMap ExternalCommandHelper::copyblocks(const QByteArray& signature, const
         return reply;
     }
 
-    const qint64 blocksToCopy = sourceLength / blockSize;
-    qint64 readOffset = sourceFirstByte;
-    qint64 writeOffset = targetFirstByte;
-    qint32 copyDirection = 1;
-
-    if (targetFirstByte > sourceFirstByte) {
-        readOffset = sourceFirstByte + sourceLength - blockSize;
-        writeOffset = targetFirstByte + sourceLength - blockSize;
-        copyDirection = -1;
-    }
-
-    const qint64 lastBlock = sourceLength % blockSize;
-
-    qint64 bytesWritten = 0;
-    qint64 blocksCopied = 0;
-
-    QByteArray buffer;
-    int percent = 0;
-    QTime t;
-
-    t.start();
-
-    QVariantMap report;
-
-    report[QStringLiteral("report")] = xi18nc("@info:progress", "Copying %1 blocks (%2 bytes) from %3 to %4, direction: %5.", blocksToCopy,
-                                              sourceLength, readOffset, writeOffset, copyDirection == 1 ? i18nc("direction: left", "left")
-                                              : i18nc("direction: right", "right"));
-
-    HelperSupport::progressStep(report);
-
-    bool rval = true;
-
-    while (blocksCopied < blocksToCopy && !targetDevice.isEmpty()) {
-        if (!(rval = readData(sourceDevice, buffer, readOffset + blockSize * blocksCopied * copyDirection, blockSize)))
-            break;
-
-        if (!(rval = writeData(targetDevice, buffer, writeOffset + blockSize * blocksCopied * copyDirection)))
-            break;
-
-        bytesWritten += buffer.size();
-
-        if (++blocksCopied * 100 / blocksToCopy != percent) {
-            percent = blocksCopied * 100 / blocksToCopy;
-
-            if (percent % 5 == 0 && t.elapsed() > 1000) {
-                const qint64 mibsPerSec = (blocksCopied * blockSize / 1024 / 1024) / (t.elapsed() / 1000);
-                const qint64 estSecsLeft = (100 - percent) * t.elapsed() / percent / 1000;
-                report[QStringLiteral("report")]=  xi18nc("@info:progress", "Copying %1 MiB/second, estimated time left: %2", mibsPerSec, QTime(0, 0).addSecs(estSecsLeft).toString());
-                HelperSupport::progressStep(report);
-            }
-            HelperSupport::progressStep(percent);
-        }
-    }
-
-    // copy the remainder
-    if (rval && lastBlock > 0) {
-        Q_ASSERT(lastBlock < blockSize);
-
-        const qint64 lastBlockReadOffset = copyDirection > 0 ? readOffset + blockSize * blocksCopied : sourceFirstByte;
-        const qint64 lastBlockWriteOffset = copyDirection > 0 ? writeOffset + blockSize * blocksCopied : targetFirstByte;
-        report[QStringLiteral("report")]= xi18nc("@info:progress", "Copying remainder of block size %1 from %2 to %3.", lastBlock, lastBlockReadOffset, lastBlockWriteOffset);
-        HelperSupport::progressStep(report);
-        rval = readData(sourceDevice, buffer, lastBlockReadOffset, lastBlock);
-
-        if (rval) {
-            if (targetDevice.isEmpty())
-                reply[QStringLiteral("targetByteArray")] = buffer;
-            else
-                rval = writeData(targetDevice, buffer, lastBlockWriteOffset);
-        }
-
-        if (rval) {
-            HelperSupport::progressStep(100);
-            bytesWritten += buffer.size();
-        }
-    }
-
-    report[QStringLiteral("report")] = xi18ncp("@info:progress argument 2 is a string such as 7 bytes (localized accordingly)", "Copying 1 block (%2) finished.", "Copying %1 blocks (%2) finished.", blocksCopied, i18np("1 byte", "%1 bytes", bytesWritten));
-    HelperSupport::progressStep(report);
-
-    reply[QStringLiteral("success")] = rval;
-    return reply;
+    return ExternalCommandEngine::copyBlocks(sourceDevice, sourceFirstByte, sourceLength, targetDevice, targetFirstByte, blockSize,
+                                             [] (int percent) { HelperSupport::progressStep(percent); },
+                                             [] (const QVariantMap& report) { HelperSupport::progressStep(report); });
 }
 
 bool ExternalCommandHelper::writeData(const QByteArray& signature, const quint64 nonce, const QByteArray& buffer, const QString& targetDevice, const qint64 targetFirstByte)
@@ -281,23 +168,32 @@ bool ExternalCommandHelper::writeData(const QByteArray& signature, const quint64
     request.append(targetDevice.toUtf8());
     request.append(QByteArray::number(targetFirstByte));
 
-    // Do not allow using this helper for writing to arbitrary location
-    if ( targetDevice.left(5) != QStringLiteral("/dev/") && !targetDevice.contains(QStringLiteral("/etc/fstab")))
-        return false;
-
     QByteArray hash = QCryptographicHash::hash(request, QCryptographicHash::Sha512);
     if (!m_publicKey.verifyMessage(hash, signature, QCA::EMSA3_Raw)) {
         qCritical() << xi18n("Invalid cryptographic signature");
         return false;
     }
 
-    return writeData(targetDevice, buffer, targetFirstByte);
+    return writeDataAllowed(targetDevice, buffer, targetFirstByte);
+}
+
+bool ExternalCommandHelper::writeDataAllowed(const QString& targetDevice, const QByteArray& buffer, const qint64 targetFirstByte)
+{
+    // The stripe cache of RAID arrays is only tunable through sysfs
+    static const QRegularExpression stripeCache(QStringLiteral("^/sys/block/md\\d+/md/stripe_cache_size$"));
+    if (stripeCache.match(targetDevice).hasMatch())
+        return ExternalCommandEngine::writeData(targetDevice, buffer, targetFirstByte);
+
+    // Do not allow using this helper for writing to arbitrary location
+    if ( targetDevice.left(5) != QStringLiteral("/dev/") && !targetDevice.contains(QStringLiteral("/etc/fstab")))
+        return false;
+
+    return ExternalCommandEngine::writeData(targetDevice, buffer, targetFirstByte);
 }
 
 
 QVariantMap ExternalCommandHelper::start(const QByteArray& signature, const quint64 nonce, const QString& command, const QStringList& arguments, const QByteArray& input, const int processChannelMode)
 {
-    QTextCodec::setCodecForLocale(QTextCodec::codecForName("UTF-8"));
     QVariantMap reply;
     reply[QStringLiteral("success")] = true;
 
@@ -327,28 +223,220 @@ QVariantMap ExternalCommandHelper::start(const QByteArray& signature, const quin
         return reply;
     }
 
-    // Compare with command whitelist
+    return runCommand(command, arguments, input, processChannelMode);
+}
+
+/** Checks the command against the whitelist.
+    Requests for anything else mean the client misbehaves, so the helper shuts down.
+*/
+bool ExternalCommandHelper::isAllowedCommand(const QString& command) const
+{
     QString basename = command.mid(command.lastIndexOf(QLatin1Char('/')) + 1);
-    if (std::find(std::begin(allowedCommands), std::end(allowedCommands), basename) == std::end(allowedCommands)) {
-        // TODO: notify the user
-        m_loop->exit();
+    if (std::find(std::begin(allowedCommands), std::end(allowedCommands), basename) != std::end(allowedCommands))
+        return true;
+
+    // TODO: notify the user
+    QMetaObject::invokeMethod(m_loop.get(), "quit", Qt::QueuedConnection);
+    return false;
+}
+
+QVariantMap ExternalCommandHelper::runCommand(const QString& command, const QStringList& arguments, const QByteArray& input, const int processChannelMode,
+                                              const int timeout, const std::function<bool()>& cancelled)
+{
+    QVariantMap reply;
+    reply[QStringLiteral("success")] = true;
+
+    if (command.isEmpty() || !isAllowedCommand(command)) {
         reply[QStringLiteral("success")] = false;
         return reply;
     }
 
 //     connect(&cmd, &QProcess::readyReadStandardOutput, this, &ExternalCommandHelper::onReadOutput);
 
-    m_cmd.setEnvironment( { QStringLiteral("LVM_SUPPRESS_FD_WARNINGS=1") } );
-    m_cmd.setProcessChannelMode(static_cast<QProcess::ProcessChannelMode>(processChannelMode));
-    m_cmd.start(command, arguments);
-    m_cmd.write(input);
-    m_cmd.closeWriteChannel();
-    m_cmd.waitForFinished(-1);
-    QByteArray output = m_cmd.readAllStandardOutput();
-    reply[QStringLiteral("output")] = output;
-    reply[QStringLiteral("exitCode")] = m_cmd.exitCode();
+    return ExternalCommandEngine::run(command, arguments, input, processChannelMode, timeout, cancelled);
+}
 
-    return reply;
+/** Opens a device for the client, so it can read or write small amounts of
+    data directly instead of sending buffers through the helper.
+    @param deviceNode device node or /etc/fstab
+    @param writable open for reading and writing instead of read only
+    @return the opened file descriptor, invalid on failure
+*/
+QDBusUnixFileDescriptor ExternalCommandHelper::openDevice(const QByteArray& signature, const quint64 nonce, const QString& deviceNode, const bool writable)
+{
+    if (m_Nonces.find(nonce) != m_Nonces.end())
+        m_Nonces.erase( nonce );
+    else
+        return QDBusUnixFileDescriptor();
+
+    QByteArray request;
+    request.setNum(nonce);
+    request.append(deviceNode.toUtf8());
+    request.append(QByteArray::number(writable));
+    QByteArray hash = QCryptographicHash::hash(request, QCryptographicHash::Sha512);
+    if (!m_publicKey.verifyMessage(hash, signature, QCA::EMSA3_Raw)) {
+        qCritical() << xi18n("Invalid cryptographic signature");
+        return QDBusUnixFileDescriptor();
+    }
+
+    const int fd = openDeviceAllowed(deviceNode, writable);
+    if (fd < 0)
+        return QDBusUnixFileDescriptor();
+
+    QDBusUnixFileDescriptor descriptor(fd); // makes its own copy
+    ::close(fd);
+    return descriptor;
+}
+
+int ExternalCommandHelper::openDeviceAllowed(const QString& deviceNode, const bool writable)
+{
+    // Same rules as for writeData, but resolve symlinks and .. first because the
+    // client gets the descriptor itself.
+    const QString path = QFileInfo(deviceNode).canonicalFilePath();
+    if (!path.startsWith(QStringLiteral("/dev/")) && path != QStringLiteral("/etc/fstab"))
+        return -1;
+
+    const int fd = ::open(QFile::encodeName(path).constData(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0)
+        qCritical() << xi18n("Could not open device <filename>%1</filename>.", deviceNode);
+
+    return fd;
+}
+
+/** Accepts a private channel from the client.
+
+    The socket is served by its own thread until the client closes it, so
+    clients can keep one channel per thread and run commands concurrently.
+    @param socket one end of a socketpair created by the client
+    @return true if the channel was accepted
+*/
+bool ExternalCommandHelper::openChannel(const QByteArray& signature, const quint64 nonce, const QDBusUnixFileDescriptor& socket)
+{
+    if (m_Nonces.find(nonce) != m_Nonces.end())
+        m_Nonces.erase( nonce );
+    else
+        return false;
+
+    QByteArray request;
+    request.setNum(nonce);
+    request.append(QByteArrayLiteral("openChannel"));
+    QByteArray hash = QCryptographicHash::hash(request, QCryptographicHash::Sha512);
+    if (!m_publicKey.verifyMessage(hash, signature, QCA::EMSA3_Raw)) {
+        qCritical() << xi18n("Invalid cryptographic signature");
+        return false;
+    }
+
+    if (!socket.isValid())
+        return false;
+
+    const int fd = ::dup(socket.fileDescriptor());
+    if (fd < 0)
+        return false;
+
+    QThread *thread = QThread::create([this, fd] { serveChannel(fd); });
+    connect(thread, &QThread::finished, thread, [this, thread] {
+        QMutexLocker locker(&m_ChannelMutex);
+        m_ChannelThreads.removeOne(thread);
+        thread->deleteLater();
+    });
+
+    QMutexLocker locker(&m_ChannelMutex);
+    m_ChannelSockets.append(fd);
+    m_ChannelThreads.append(thread);
+    thread->start();
+
+    return true;
+}
+
+void ExternalCommandHelper::serveChannel(int fd)
+{
+    using Message = ExternalCommandChannel::Message;
+
+    ExternalCommandChannel channel(fd);
+    Message type;
+    QVariantMap request;
+    bool clientConnected = true;
+
+    /* Handles control messages sent while a request runs. Blocks while paused.
+       If the client goes away the request is finished anyway, so that we do not
+       leave partially moved data behind. */
+    auto cancelled = [&channel, &clientConnected] (bool canPause) {
+        bool paused = false;
+        while (clientConnected) {
+            if (!paused) {
+                pollfd pending { channel.fd(), POLLIN, 0 };
+                if (::poll(&pending, 1, 0) <= 0)
+                    return false;
+            }
+
+            Message control;
+            QVariantMap payload;
+            if (!channel.receive(control, payload)) {
+                clientConnected = false;
+                return false;
+            }
+
+            if (control == Message::Cancel)
+                return true;
+            if (control == Message::Pause)
+                paused = canPause;
+            else if (control == Message::Resume)
+                paused = false;
+        }
+        return false;
+    };
+
+    while (clientConnected && channel.receive(type, request)) {
+        QVariantMap reply;
+        int deviceFd = -1;
+
+        switch (type) {
+        case Message::Pause:
+        case Message::Resume:
+        case Message::Cancel:
+            continue; // arrived after the request it was meant for had finished
+        case Message::Start:
+            reply = runCommand(request[QStringLiteral("command")].toString(),
+                               request[QStringLiteral("arguments")].toStringList(),
+                               request[QStringLiteral("input")].toByteArray(),
+                               request[QStringLiteral("processChannelMode")].toInt(),
+                               request.value(QStringLiteral("timeout"), -1).toInt(),
+                               [&cancelled] { return cancelled(false); });
+            break;
+        case Message::CopyBlocks:
+            reply = ExternalCommandEngine::copyBlocks(request[QStringLiteral("sourceDevice")].toString(),
+                                                      request[QStringLiteral("sourceFirstByte")].toLongLong(),
+                                                      request[QStringLiteral("sourceLength")].toLongLong(),
+                                                      request[QStringLiteral("targetDevice")].toString(),
+                                                      request[QStringLiteral("targetFirstByte")].toLongLong(),
+                                                      request[QStringLiteral("blockSize")].toLongLong(),
+                                                      [&channel] (int percent) { channel.send(Message::Progress, { { QStringLiteral("percent"), percent } }); },
+                                                      [&channel] (const QVariantMap& report) { channel.send(Message::Report, report); },
+                                                      [&cancelled] { return cancelled(true); });
+            break;
+        case Message::OpenDevice:
+            deviceFd = openDeviceAllowed(request[QStringLiteral("deviceNode")].toString(),
+                                         request[QStringLiteral("writable")].toBool());
+            reply[QStringLiteral("success")] = deviceFd >= 0;
+            break;
+        case Message::WriteData:
+            reply[QStringLiteral("success")] = writeDataAllowed(request[QStringLiteral("targetDevice")].toString(),
+                                                                request[QStringLiteral("buffer")].toByteArray(),
+                                                                request[QStringLiteral("targetFirstByte")].toLongLong());
+            break;
+        default:
+            reply[QStringLiteral("success")] = false;
+        }
+
+        const bool sent = channel.send(Message::Reply, reply, deviceFd);
+        if (deviceFd >= 0)
+            ::close(deviceFd);
+        if (!sent)
+            break;
+    }
+
+    QMutexLocker locker(&m_ChannelMutex);
+    m_ChannelSockets.removeOne(fd);
 }
 
 void ExternalCommandHelper::exit(const QByteArray& signature, const quint64 nonce)
@@ -18,15 +18,20 @@
 #ifndef KPMCORE_EXTERNALCOMMANDHELPER_H
 #define KPMCORE_EXTERNALCOMMANDHELPER_H
 
+#include <functional>
 #include <memory>
 #include <unordered_set>
 
 #include <KAuth>
 
+#include <QDBusUnixFileDescriptor>
 #include <QEventLoop>
+#include <QList>
+#include <QMutex>
 #include <QRandomGenerator64>
 #include <QString>
 #include <QProcess>
+#include <QThread>
 
 #include <QtCrypto>
 
@@ -41,20 +46,24 @@ Q_SIGNALS:
     void progress(int);
     void quit();
 
-public:
-    bool readData(const QString& sourceDevice, QByteArray& buffer, const qint64 offset, const qint64 size);
-    bool writeData(const QString& targetDevice, const QByteArray& buffer, const qint64 offset);
-
 public Q_SLOTS:
     ActionReply init(const QVariantMap& args);
     Q_SCRIPTABLE quint64 getNonce();
     Q_SCRIPTABLE QVariantMap start(const QByteArray& signature, const quint64 nonce, const QString& command, const QStringList& arguments, const QByteArray& input, const int processChannelMode);
     Q_SCRIPTABLE QVariantMap copyblocks(const QByteArray& signature, const quint64 nonce, const QString& sourceDevice, const qint64 sourceFirstByte, const qint64 sourceLength, const QString& targetDevice, const qint64 targetFirstByte, const qint64 blockSize);
     Q_SCRIPTABLE bool writeData(const QByteArray& signature, const quint64 nonce, const QByteArray& buffer, const QString& targetDevice, const qint64 targetFirstByte);
+    Q_SCRIPTABLE QDBusUnixFileDescriptor openDevice(const QByteArray& signature, const quint64 nonce, const QString& deviceNode, const bool writable);
+    Q_SCRIPTABLE bool openChannel(const QByteArray& signature, const quint64 nonce, const QDBusUnixFileDescriptor& socket);
     Q_SCRIPTABLE void exit(const QByteArray& signature, const quint64 nonce);
 
 private:
     void onReadOutput();
+    void serveChannel(int fd);
+    bool isAllowedCommand(const QString& command) const;
+    QVariantMap runCommand(const QString& command, const QStringList& arguments, const QByteArray& input, const int processChannelMode,
+                           const int timeout = -1, const std::function<bool()>& cancelled = {});
+    bool writeDataAllowed(const QString& targetDevice, const QByteArray& buffer, const qint64 targetFirstByte);
+    int openDeviceAllowed(const QString& deviceNode, const bool writable);
 
     std::unique_ptr<QEventLoop> m_loop;
     QCA::Initializer initializer;
@@ -63,7 +72,10 @@ private:
     std::unordered_set<quint64> m_Nonces;
     QString m_command;
     QString m_sourceDevice;
-    QProcess m_cmd;
+
+    QMutex m_ChannelMutex;
+    QList<int> m_ChannelSockets;
+    QList<QThread*> m_ChannelThreads;
 
 //     QByteArray output;
 };
@@ -17,9 +17,10 @@
  *************************************************************************/
 
 #include "util/helpers.h"
-#include "util/externalcommand.h"
 #include "util/globallog.h"
 
+#include "core/devicepropertycache.h"
+
 #include "ops/operation.h"
 
 #include <KAboutData>
@@ -38,17 +39,7 @@ bool caseInsensitiveLessThan(const QString& s1, const QString& s2)
 
 bool isMounted(const QString& deviceNode)
 {
-    ExternalCommand cmd(QStringLiteral("lsblk"),
-                        { QStringLiteral("--noheadings"),
-                          QStringLiteral("--nodeps"),
-                          QStringLiteral("--output"),
-                          QStringLiteral("mountpoint"),
-                          deviceNode });
-
-    if (cmd.run(-1) && cmd.exitCode() == 0) {
-        return !cmd.output().trimmed().isEmpty();
-    }
-    return false;
+    return DevicePropertyCache::isMounted(deviceNode);
 }
 
 KAboutData aboutKPMcore()
@@ -32,6 +32,9 @@ KPMCoreInitializer::KPMCoreInitializer() :
 {
     if ( !s_initialized )
     {
+        // Authorize and start the helper while the backend plugin loads
+        ExternalCommand::prestartHelper();
+
         QByteArray env = qgetenv( "KPMCORE_BACKEND" );
         auto backendName = env.isEmpty() ? CoreBackendManager::defaultBackendName() : QString::fromLatin1( env );
 
@@ -47,6 +50,8 @@ KPMCoreInitializer::KPMCoreInitializer( const QString& backendName ) :
 {
     if ( !s_initialized )
     {
+        ExternalCommand::prestartHelper();
+
         if ( !CoreBackendManager::self()->load( backendName ) )
             qWarning() << "Failed to load backend plugin" << backendName;
         else
@@ -0,0 +1,352 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+//  SPDX-License-Identifier: GPL-3.0+
+
+// Builds LVM topologies and segment maps from generated fullreports and measures how long parsing and lookups take
+
+#include "core/lvmmoveplanner.h"
+#include "core/lvmsegmentmap.h"
+#include "core/lvmtopology.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVector>
+
+static const qint64 extentSize = 4 * 1024 * 1024;
+
+static QString vgName(int vg)
+{
+    return QStringLiteral("vg%1").arg(vg);
+}
+
+static QString lvUuid(int vg, int lv)
+{
+    return QStringLiteral("lv-%1-%2").arg(vg).arg(lv);
+}
+
+static QString pvName(int vg, int pv)
+{
+    return QStringLiteral("/dev/test/vg%1pv%2").arg(vg).arg(pv);
+}
+
+static QString pvUuid(int vg, int pv)
+{
+    return QStringLiteral("pv-%1-%2").arg(vg).arg(pv);
+}
+
+/** Generates a report like lvm fullreport --reportformat json --units B --nosuffix would print.
+
+    Every VG has pvCount PVs with lvCount LVs of extentsPerLv extents each, LVs are
+    spread over the PVs round robin. One orphan PV is added at the end.
+*/
+static QByteArray fullReport(int vgCount, int lvCount, int pvCount, int extentsPerLv)
+{
+    QJsonArray reports;
+    for (int vg = 0; vg < vgCount; ++vg) {
+        const int extentsPerPv = (lvCount + pvCount - 1) / pvCount * extentsPerLv + 10;
+
+        QJsonArray lvs, pvs, segs, pvsegs;
+        QVector<qint64> allocated(pvCount, 0);
+        for (int lv = 0; lv < lvCount; ++lv) {
+            const int pv = lv % pvCount;
+            lvs.append(QJsonObject {
+                { QStringLiteral("lv_name"), QStringLiteral("lv%1").arg(lv) },
+                { QStringLiteral("lv_path"), QStringLiteral("/dev/%1/lv%2").arg(vgName(vg)).arg(lv) },
+                { QStringLiteral("lv_uuid"), lvUuid(vg, lv) },
+                { QStringLiteral("lv_attr"), QStringLiteral("-wi-a-----") },
+                { QStringLiteral("lv_size"), QString::number(extentsPerLv * extentSize) } });
+            segs.append(QJsonObject {
+                { QStringLiteral("lv_uuid"), lvUuid(vg, lv) },
+                { QStringLiteral("segtype"), QStringLiteral("linear") },
+                { QStringLiteral("seg_start_pe"), QStringLiteral("0") },
+                { QStringLiteral("seg_size_pe"), QString::number(extentsPerLv) },
+                { QStringLiteral("stripes"), QStringLiteral("1") },
+                { QStringLiteral("devices"), QStringLiteral("%1(%2)").arg(pvName(vg, pv)).arg(allocated[pv]) } });
+            pvsegs.append(QJsonObject {
+                { QStringLiteral("pv_uuid"), pvUuid(vg, pv) },
+                { QStringLiteral("lv_uuid"), lvUuid(vg, lv) },
+                { QStringLiteral("pvseg_start"), QString::number(allocated[pv]) },
+                { QStringLiteral("pvseg_size"), QString::number(extentsPerLv) } });
+            allocated[pv] += extentsPerLv;
+        }
+
+        qint64 freeExtents = 0;
+        for (int pv = 0; pv < pvCount; ++pv) {
+            pvs.append(QJsonObject {
+                { QStringLiteral("pv_name"), pvName(vg, pv) },
+                { QStringLiteral("pv_uuid"), pvUuid(vg, pv) },
+                { QStringLiteral("pv_pe_count"), QString::number(extentsPerPv) },
+                { QStringLiteral("pv_pe_alloc_count"), QString::number(allocated[pv]) },
+                { QStringLiteral("pv_used"), QString::number(allocated[pv] * extentSize) },
+                { QStringLiteral("pe_start"), QStringLiteral("1048576") } });
+            pvsegs.append(QJsonObject {
+                { QStringLiteral("pv_uuid"), pvUuid(vg, pv) },
+                { QStringLiteral("lv_uuid"), QString() },
+                { QStringLiteral("pvseg_start"), QString::number(allocated[pv]) },
+                { QStringLiteral("pvseg_size"), QString::number(extentsPerPv - allocated[pv]) } });
+            freeExtents += extentsPerPv - allocated[pv];
+        }
+
+        const QJsonObject vgObject {
+            { QStringLiteral("vg_name"), vgName(vg) },
+            { QStringLiteral("vg_uuid"), QStringLiteral("vg-%1").arg(vg) },
+            { QStringLiteral("vg_extent_size"), QString::number(extentSize) },
+            { QStringLiteral("vg_extent_count"), QString::number(static_cast<qint64>(extentsPerPv) * pvCount) },
+            { QStringLiteral("vg_free_count"), QString::number(freeExtents) } };
+
+        reports.append(QJsonObject {
+            { QStringLiteral("vg"), QJsonArray { vgObject } },
+            { QStringLiteral("pv"), pvs },
+            { QStringLiteral("lv"), lvs },
+            { QStringLiteral("pvseg"), pvsegs },
+            { QStringLiteral("seg"), segs } });
+    }
+
+    const QJsonObject orphan {
+        { QStringLiteral("pv_name"), QStringLiteral("/dev/test/orphan") },
+        { QStringLiteral("pv_uuid"), QStringLiteral("pv-orphan") },
+        { QStringLiteral("pv_pe_count"), QStringLiteral("0") },
+        { QStringLiteral("pv_pe_alloc_count"), QStringLiteral("0") },
+        { QStringLiteral("pv_used"), QStringLiteral("0") },
+        { QStringLiteral("pe_start"), QStringLiteral("0") } };
+    reports.append(QJsonObject {
+        { QStringLiteral("vg"), QJsonArray() },
+        { QStringLiteral("pv"), QJsonArray { orphan } },
+        { QStringLiteral("lv"), QJsonArray() },
+        { QStringLiteral("pvseg"), QJsonArray() },
+        { QStringLiteral("seg"), QJsonArray() } });
+
+    return QJsonDocument(QJsonObject { { QStringLiteral("report"), reports } }).toJson(QJsonDocument::Compact);
+}
+
+static bool testTopology()
+{
+    const LvmTopology topology = LvmTopology::fromJson(fullReport(3, 5, 2, 10));
+    if (!topology.isValid() || topology.volumeGroupNames() != QStringList({ QStringLiteral("vg0"), QStringLiteral("vg1"), QStringLiteral("vg2") }))
+        return false;
+
+    const LvmTopology::VolumeGroup* vg = topology.volumeGroup(QStringLiteral("vg1"));
+    if (!vg || vg->extentSize != extentSize || vg->extentCount != 2 * 40 || vg->freeCount != 2 * 40 - 5 * 10 ||
+            vg->uuid != QStringLiteral("vg-1") || vg->logicalVolumes.size() != 5 || vg->physicalVolumes.size() != 2)
+        return false;
+
+    const LvmTopology::LogicalVolume* lv = topology.logicalVolume(QStringLiteral("/dev/vg1/lv3"));
+    if (!lv || lv->extents != 10 || lv->vgName != QStringLiteral("vg1") || lv->uuid != lvUuid(1, 3))
+        return false;
+
+    const QList<LvmTopology::Segment> segments = topology.segments(lvUuid(1, 3));
+    if (segments.size() != 1 || segments.first().extents != 10 || segments.first().devices != pvName(1, 1) + QStringLiteral("(10)"))
+        return false;
+
+    const LvmTopology::PhysicalVolume* pv = topology.physicalVolume(pvName(2, 0));
+    if (!pv || pv->vgName != QStringLiteral("vg2") || pv->extentCount != 40 || pv->allocatedExtents != 30 ||
+            pv->extentSize != extentSize || pv->extentStart != 1048576 || pv->uuid != pvUuid(2, 0))
+        return false;
+
+    if (topology.physicalSegments(pvUuid(2, 0)).size() != 4)
+        return false;
+
+    const LvmTopology::PhysicalVolume* orphan = topology.physicalVolume(QStringLiteral("/dev/test/orphan"));
+    if (!orphan || !orphan->vgName.isEmpty() || topology.physicalVolumes().size() != 3 * 2 + 1)
+        return false;
+
+    return topology.volumeGroup(QStringLiteral("missing")) == nullptr && topology.logicalVolume(QStringLiteral("/dev/vg0/missing")) == nullptr;
+}
+
+static bool testSegmentMap()
+{
+    const LvmTopology topology = LvmTopology::fromJson(fullReport(3, 5, 2, 10));
+    const LvmSegmentMap map(topology, QStringLiteral("vg1"));
+
+    const QList<LvmSegmentMap::Location> locations = map.physicalExtents(lvUuid(1, 3), 4);
+    if (locations.size() != 1 || locations.first().pvName != pvName(1, 1) || locations.first().extent != 14)
+        return false;
+
+    const LvmSegmentMap::Location location = map.logicalExtent(pvName(1, 1), 14);
+    if (location.lvUuid != lvUuid(1, 3) || location.extent != 4)
+        return false;
+
+    // Past the end of the LV, in free space and in another VG
+    if (!map.physicalExtents(lvUuid(1, 3), 10).isEmpty() || !map.logicalExtent(pvName(1, 0), 35).lvUuid.isEmpty() ||
+            !map.physicalExtents(lvUuid(0, 0), 0).isEmpty())
+        return false;
+
+    const QList<QPair<qint64, qint64>> freeRanges = map.freeRanges(pvName(1, 0));
+    if (freeRanges.size() != 1 || freeRanges.first() != qMakePair<qint64, qint64>(30, 10))
+        return false;
+
+    if (map.allocatedExtents(pvName(1, 0), 25, 35) != 5 || map.allocatedExtents(pvName(1, 0), 0, 39) != 30 ||
+            map.physicalVolumeAreas(pvName(1, 0)).size() != 3 || map.logicalVolumeAreas(lvUuid(1, 4)).size() != 1)
+        return false;
+
+    // A striped segment of 8 extents over both PVs
+    LvmSegmentMap striped;
+    for (int stripe = 0; stripe < 2; ++stripe) {
+        LvmSegmentMap::Area area;
+        area.lvUuid = QStringLiteral("striped");
+        area.pvName = pvName(9, stripe);
+        area.pvStart = 100;
+        area.extents = 4;
+        area.stripes = 2;
+        area.stripe = stripe;
+        striped.insert(area);
+    }
+
+    const LvmSegmentMap::Location stripeLocation = striped.logicalExtent(pvName(9, 1), 102);
+    return striped.physicalExtents(QStringLiteral("striped"), 5).size() == 2 &&
+           striped.physicalExtents(QStringLiteral("striped"), 5).first().extent == 102 &&
+           stripeLocation.lvUuid == QStringLiteral("striped") && stripeLocation.extent == 5;
+}
+
+static LvmMovePlanner::Volume volume(const QString& name, qint64 extentCount, qint64 allocatedExtents, bool remove)
+{
+    LvmMovePlanner::Volume v;
+    v.name = name;
+    v.extentCount = extentCount;
+    v.allocatedExtents = allocatedExtents;
+    v.remove = remove;
+    return v;
+}
+
+static bool testMovePlanner()
+{
+    // vg1pv0 has 30 of 40 extents allocated, vg1pv1 holds two LVs in extents 0 to 19
+    const LvmTopology topology = LvmTopology::fromJson(fullReport(3, 5, 2, 10));
+    const LvmSegmentMap map(topology, QStringLiteral("vg1"));
+    const QString added = QStringLiteral("/dev/test/added");
+
+    // Each LV fits into a different free range
+    LvmMovePlanner::Plan plan = LvmMovePlanner::plan({ volume(pvName(1, 0), 40, 30, false), volume(pvName(1, 1), 40, 20, true),
+                                                       volume(added, 15, 0, false) }, map, extentSize);
+    if (!plan.possible || plan.moves.size() != 2 || plan.extentsMoved != 20 || plan.bytesMoved != 20 * extentSize ||
+            plan.moves.first().destinations != QStringList { pvName(1, 0) } || plan.moves.last().destinations != QStringList { added } ||
+            LvmMovePlanner::destinationArguments(plan.moves.first()) != QStringList { pvName(1, 0) + QStringLiteral(":30-39") })
+        return false;
+
+    // Both PVs go, the less used one first and its LVs in one batch
+    plan = LvmMovePlanner::plan({ volume(pvName(1, 0), 40, 30, true), volume(pvName(1, 1), 40, 20, true),
+                                  volume(added, 100, 0, false) }, map, extentSize);
+    if (!plan.possible || plan.removalOrder != QStringList { pvName(1, 1), pvName(1, 0) } || plan.moves.size() != 2 ||
+            plan.extentsMoved != 50 || LvmMovePlanner::sourceArgument(plan.moves.first()) != pvName(1, 1) + QStringLiteral(":0-19"))
+        return false;
+
+    // Throttled moves are split into pieces, the first one touches both LVs
+    const QList<LvmMovePlanner::Move> parts = LvmMovePlanner::split(plan.moves.first(), 8);
+    if (parts.size() != 3 || parts.last().extents != 4 || LvmMovePlanner::sourceArgument(parts[1]) != pvName(1, 1) + QStringLiteral(":8-15") ||
+            LvmMovePlanner::logicalVolumes(parts.first(), map).size() != 1 || LvmMovePlanner::logicalVolumes(plan.moves.first(), map).size() != 2 ||
+            LvmMovePlanner::destinationArguments(parts[1]) != QStringList { added + QStringLiteral(":8-15") })
+        return false;
+
+    // The smallest fitting range is on the PV with the other stripe, so the stripe goes elsewhere
+    LvmSegmentMap striped;
+    for (int stripe = 0; stripe < 2; ++stripe) {
+        LvmSegmentMap::Area area;
+        area.lvUuid = QStringLiteral("striped");
+        area.pvName = pvName(9, stripe);
+        area.extents = 4;
+        area.stripes = 2;
+        area.stripe = stripe;
+        striped.insert(area);
+    }
+    plan = LvmMovePlanner::plan({ volume(pvName(9, 0), 20, 4, true), volume(pvName(9, 1), 10, 4, false),
+                                  volume(added, 50, 0, false) }, striped, extentSize);
+    if (!plan.possible || plan.moves.size() != 1 || plan.moves.first().destinations != QStringList { added })
+        return false;
+
+    // Not enough space left
+    plan = LvmMovePlanner::plan({ volume(pvName(1, 0), 40, 30, true), volume(pvName(1, 1), 40, 20, false) }, map, extentSize);
+    return !plan.possible;
+}
+
+static bool testInvalid()
+{
+    return !LvmTopology::fromJson("  WARNING: not JSON").isValid() && !LvmTopology().isValid() &&
+           LvmTopology().volumeGroup(QStringLiteral("vg0")) == nullptr;
+}
+
+static void benchmark(int vgCount, int lvCount, int pvCount)
+{
+    const QByteArray report = fullReport(vgCount, lvCount, pvCount, 16);
+    const int iterations = 20;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i)
+        LvmTopology::fromJson(report);
+    const qint64 parseTime = timer.nsecsElapsed() / iterations;
+
+    // What a scan asks for every LV and PV
+    const LvmTopology topology = LvmTopology::fromJson(report);
+    timer.restart();
+    for (const auto &name : topology.volumeGroupNames()) {
+        for (const auto &lvPath : topology.volumeGroup(name)->logicalVolumes)
+            topology.logicalVolume(lvPath);
+        for (const auto &pvPath : topology.volumeGroup(name)->physicalVolumes)
+            topology.physicalVolume(pvPath);
+    }
+    const qint64 lookupTime = timer.nsecsElapsed();
+
+    timer.restart();
+    const LvmSegmentMap map(topology);
+    const qint64 mapTime = timer.nsecsElapsed();
+
+    // Every allocated extent of the first PV of each VG, mapped to its LV and back
+    timer.restart();
+    qint64 mappedExtents = 0;
+    for (int vg = 0; vg < vgCount; ++vg) {
+        for (qint64 extent = 0; extent < topology.physicalVolume(pvName(vg, 0))->allocatedExtents; ++extent) {
+            const LvmSegmentMap::Location location = map.logicalExtent(pvName(vg, 0), extent);
+            map.physicalExtents(location.lvUuid, location.extent);
+            ++mappedExtents;
+        }
+    }
+
+    qDebug() << vgCount << "VGs," << vgCount * lvCount << "LVs," << vgCount * pvCount << "PVs:"
+             << report.size() / 1024 << "KiB parsed in" << parseTime / 1000000.0 << "ms, all volumes looked up in"
+             << lookupTime / 1000000.0 << "ms, segment map built in" << mapTime / 1000000.0 << "ms,"
+             << mappedExtents << "extents mapped both ways in" << timer.nsecsElapsed() / 1000000.0 << "ms";
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const struct { const char* name; bool (*test)(); } tests[] = {
+        { "topology", testTopology },
+        { "segment-map", testSegmentMap },
+        { "move-planner", testMovePlanner },
+        { "invalid", testInvalid },
+    };
+
+    for (const auto &test : tests) {
+        if (!test.test()) {
+            qWarning() << "test" << test.name << "failed";
+            return 1;
+        }
+    }
+
+    benchmark(20, 20, 4);
+    benchmark(100, 50, 8);
+    benchmark(500, 40, 16);
+
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+//  SPDX-License-Identifier: GPL-3.0+
+
+// Parses generated GPT and MBR disk images and measures how long parsing takes
+
+#include "core/partitiontableparser.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QList>
+#include <QUuid>
+#include <QtEndian>
+
+static const qint64 sectorSize = 512;
+static const qint64 totalSectors = 8192;
+static const QString deviceNode = QStringLiteral("/dev/sda");
+
+struct GptEntry
+{
+    QString type;
+    QString uuid;
+    qint64 first;
+    qint64 last;
+    QString name;
+};
+
+static void putLittleEndian32(QByteArray& data, qint64 offset, quint32 value)
+{
+    qToLittleEndian(value, reinterpret_cast<uchar*>(data.data() + offset));
+}
+
+static void putLittleEndian64(QByteArray& data, qint64 offset, quint64 value)
+{
+    qToLittleEndian(value, reinterpret_cast<uchar*>(data.data() + offset));
+}
+
+static void putGuid(QByteArray& data, qint64 offset, const QString& guid)
+{
+    const QUuid uuid(guid);
+    putLittleEndian32(data, offset, uuid.data1);
+    qToLittleEndian(uuid.data2, reinterpret_cast<uchar*>(data.data() + offset + 4));
+    qToLittleEndian(uuid.data3, reinterpret_cast<uchar*>(data.data() + offset + 6));
+    for (int i = 0; i < 8; ++i)
+        data[static_cast<int>(offset) + 8 + i] = uuid.data4[i];
+}
+
+static void putGptHeader(QByteArray& disk, qint64 lba, qint64 alternateLba, qint64 entriesLba, quint32 entriesCrc)
+{
+    QByteArray header(sectorSize, 0);
+    header.replace(0, 8, "EFI PART");
+    putLittleEndian32(header, 8, 0x00010000);
+    putLittleEndian32(header, 12, 92);
+    putLittleEndian64(header, 24, lba);
+    putLittleEndian64(header, 32, alternateLba);
+    putLittleEndian64(header, 40, 34);
+    putLittleEndian64(header, 48, totalSectors - 34);
+    putGuid(header, 56, QStringLiteral("{4d3f4e2a-1b6c-4f0e-9a57-3c2e8b1d0f11}"));
+    putLittleEndian64(header, 72, entriesLba);
+    putLittleEndian32(header, 80, 128);
+    putLittleEndian32(header, 84, 128);
+    putLittleEndian32(header, 88, entriesCrc);
+    putLittleEndian32(header, 16, PartitionTableParser::crc32(header.constData(), 92));
+
+    disk.replace(lba * sectorSize, sectorSize, header);
+}
+
+static void putMbrEntry(QByteArray& sector, qint64 sectorOffset, int entry, quint8 bootFlag, quint8 type, quint32 start, quint32 size)
+{
+    const qint64 offset = sectorOffset + 446 + entry * 16;
+    sector[static_cast<int>(offset)] = bootFlag;
+    sector[static_cast<int>(offset) + 4] = type;
+    putLittleEndian32(sector, offset + 8, start);
+    putLittleEndian32(sector, offset + 12, size);
+}
+
+static void putMbrSignature(QByteArray& disk, qint64 sectorOffset)
+{
+    disk[static_cast<int>(sectorOffset) + 510] = '\x55';
+    disk[static_cast<int>(sectorOffset) + 511] = '\xaa';
+}
+
+static QList<GptEntry> gptEntries()
+{
+    return {
+        { QStringLiteral("C12A7328-F81F-11D2-BA4B-00A0C93EC93B"), QStringLiteral("0B4D6F27-5A7E-4B4C-9E43-5E2C4F2E7A01"), 2048, 4095, QStringLiteral("EFI system") },
+        { QStringLiteral("0FC63DAF-8483-4772-8E79-3D69D8477DE4"), QStringLiteral("6E1A2C3D-4B5F-4C6D-8E7F-901A2B3C4D5E"), 4096, 6143, QStringLiteral("root") },
+        { QStringLiteral("0657FD6D-A4AB-43C4-84E5-0933C84B4F4F"), QStringLiteral("7F2B3D4E-5C6A-4D7E-9F80-A12B3C4D5E6F"), 6144, 8000, QString() },
+    };
+}
+
+/** Builds a GPT disk with valid primary and backup headers. */
+static QByteArray gptDisk()
+{
+    QByteArray disk(totalSectors * sectorSize, 0);
+
+    putMbrEntry(disk, 0, 0, 0, 0xee, 1, totalSectors - 1);
+    putMbrSignature(disk, 0);
+
+    QByteArray entries(128 * 128, 0);
+    const QList<GptEntry> list = gptEntries();
+    for (int i = 0; i < list.size(); ++i) {
+        putGuid(entries, i * 128, list[i].type);
+        putGuid(entries, i * 128 + 16, list[i].uuid);
+        putLittleEndian64(entries, i * 128 + 32, list[i].first);
+        putLittleEndian64(entries, i * 128 + 40, list[i].last);
+        for (int c = 0; c < list[i].name.size(); ++c)
+            qToLittleEndian(list[i].name[c].unicode(), reinterpret_cast<uchar*>(entries.data() + i * 128 + 56 + 2 * c));
+    }
+    const quint32 entriesCrc = PartitionTableParser::crc32(entries.constData(), entries.size());
+
+    disk.replace(2 * sectorSize, entries.size(), entries);
+    disk.replace((totalSectors - 33) * sectorSize, entries.size(), entries);
+    putGptHeader(disk, 1, totalSectors - 1, 2, entriesCrc);
+    putGptHeader(disk, totalSectors - 1, 1, totalSectors - 33, entriesCrc);
+
+    return disk;
+}
+
+/** Builds a MBR disk with two primary partitions, one of them extended with two logical partitions. */
+static QByteArray mbrDisk()
+{
+    QByteArray disk(totalSectors * sectorSize, 0);
+
+    putLittleEndian32(disk, 440, 0x1234abcd);
+    putMbrEntry(disk, 0, 0, 0x80, 0x83, 2048, 1024);
+    putMbrEntry(disk, 0, 1, 0, 0x05, 3072, 2048);
+    putMbrSignature(disk, 0);
+
+    putMbrEntry(disk, 3072 * sectorSize, 0, 0, 0x83, 1, 100);
+    putMbrEntry(disk, 3072 * sectorSize, 1, 0, 0x05, 228, 200);
+    putMbrSignature(disk, 3072 * sectorSize);
+
+    putMbrEntry(disk, 3300 * sectorSize, 0, 0, 0x82, 1, 50);
+    putMbrSignature(disk, 3300 * sectorSize);
+
+    return disk;
+}
+
+static bool parse(const QByteArray& disk, QJsonObject& partitionTable, int* reads = nullptr)
+{
+    auto read = [&disk, reads] (QByteArray& buffer, qint64 offset, qint64 size) {
+        if (reads)
+            ++*reads;
+        if (offset < 0 || offset + size > disk.size())
+            return false;
+        buffer = disk.mid(offset, size);
+        return true;
+    };
+
+    return PartitionTableParser::parse(read, deviceNode, sectorSize, totalSectors, partitionTable);
+}
+
+static bool checkGpt(const QJsonObject& partitionTable)
+{
+    const QJsonArray partitions = partitionTable[QLatin1String("partitions")].toArray();
+    const QList<GptEntry> list = gptEntries();
+
+    if (partitionTable[QLatin1String("label")].toString() != QStringLiteral("gpt")
+            || partitionTable[QLatin1String("firstlba")].toInt() != 34
+            || partitionTable[QLatin1String("lastlba")].toInt() != totalSectors - 34
+            || partitionTable[QLatin1String("maxentries")].toInt() != 128
+            || partitions.size() != list.size())
+        return false;
+
+    for (int i = 0; i < list.size(); ++i) {
+        const QJsonObject partition = partitions[i].toObject();
+        if (partition[QLatin1String("node")].toString() != deviceNode + QString::number(i + 1)
+                || partition[QLatin1String("start")].toInt() != list[i].first
+                || partition[QLatin1String("size")].toInt() != list[i].last - list[i].first + 1
+                || partition[QLatin1String("type")].toString() != list[i].type
+                || partition[QLatin1String("uuid")].toString() != list[i].uuid
+                || partition[QLatin1String("name")].toString() != list[i].name) {
+            qWarning() << "GPT entry" << i << "parsed as" << partition;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool testGpt()
+{
+    QJsonObject partitionTable;
+    int reads = 0;
+    if (!parse(gptDisk(), partitionTable, &reads) || !checkGpt(partitionTable))
+        return false;
+
+    // The MBR, the primary header and entries in one read, the backup header in another
+    if (reads != 2) {
+        qWarning() << "parsing GPT took" << reads << "reads";
+        return false;
+    }
+
+    return true;
+}
+
+static bool testGptBackup()
+{
+    QByteArray disk = gptDisk();
+    disk[static_cast<int>(sectorSize) + 40] = '\x01'; // breaks the primary header CRC
+
+    QJsonObject partitionTable;
+    return parse(disk, partitionTable) && checkGpt(partitionTable);
+}
+
+static bool testGptDamaged()
+{
+    QByteArray disk = gptDisk();
+    disk[static_cast<int>(2 * sectorSize) + 60] = '\x01'; // breaks the primary entries CRC
+    disk[static_cast<int>((totalSectors - 33) * sectorSize) + 60] = '\x01'; // and the backup entries CRC
+
+    QJsonObject partitionTable;
+    return !parse(disk, partitionTable);
+}
+
+static bool testMbr()
+{
+    QJsonObject partitionTable;
+    if (!parse(mbrDisk(), partitionTable))
+        return false;
+
+    struct { int number; qint64 start; qint64 size; QString type; bool bootable; } expected[] = {
+        { 1, 2048, 1024, QStringLiteral("83"), true },
+        { 2, 3072, 2048, QStringLiteral("5"), false },
+        { 5, 3073, 100, QStringLiteral("83"), false },
+        { 6, 3301, 50, QStringLiteral("82"), false },
+    };
+
+    const QJsonArray partitions = partitionTable[QLatin1String("partitions")].toArray();
+    if (partitionTable[QLatin1String("label")].toString() != QStringLiteral("dos")
+            || partitionTable[QLatin1String("id")].toString() != QStringLiteral("0x1234abcd")
+            || partitions.size() != 4)
+        return false;
+
+    for (int i = 0; i < 4; ++i) {
+        const QJsonObject partition = partitions[i].toObject();
+        if (partition[QLatin1String("node")].toString() != deviceNode + QString::number(expected[i].number)
+                || partition[QLatin1String("start")].toInt() != expected[i].start
+                || partition[QLatin1String("size")].toInt() != expected[i].size
+                || partition[QLatin1String("type")].toString() != expected[i].type
+                || partition[QLatin1String("bootable")].toBool() != expected[i].bootable) {
+            qWarning() << "MBR entry" << i << "parsed as" << partition;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool testNoTable()
+{
+    QJsonObject partitionTable;
+    return !parse(QByteArray(totalSectors * sectorSize, 0), partitionTable);
+}
+
+/** A FAT32 file system on the whole disk, whose boot sector has a MBR signature */
+static bool testFatBootSector()
+{
+    QByteArray disk(totalSectors * sectorSize, 0);
+    disk.replace(3, 8, "MSDOS5.0");
+    disk.replace(0x52, 8, "FAT32   ");
+    putMbrEntry(disk, 0, 0, 0, 0x0c, 32, 4096);
+    putMbrSignature(disk, 0);
+
+    QJsonObject partitionTable;
+    return !parse(disk, partitionTable);
+}
+
+static bool testHelpers()
+{
+    return PartitionTableParser::crc32("123456789", 9) == 0xcbf43926
+            && PartitionTableParser::partitionNode(QStringLiteral("/dev/sda"), 1) == QStringLiteral("/dev/sda1")
+            && PartitionTableParser::partitionNode(QStringLiteral("/dev/nvme0n1"), 2) == QStringLiteral("/dev/nvme0n1p2")
+            && PartitionTableParser::partitionNode(QStringLiteral("/dev/mmcblk0"), 3) == QStringLiteral("/dev/mmcblk0p3");
+}
+
+static void benchmark(const char* name, const QByteArray& disk)
+{
+    const int iterations = 2000;
+    QJsonObject partitionTable;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i)
+        parse(disk, partitionTable);
+
+    qDebug() << name << "parsed in" << timer.nsecsElapsed() / iterations / 1000.0 << "microseconds";
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const struct { const char* name; bool (*test)(); } tests[] = {
+        { "helpers", testHelpers },
+        { "gpt", testGpt },
+        { "gpt-backup", testGptBackup },
+        { "gpt-damaged", testGptDamaged },
+        { "mbr", testMbr },
+        { "no-table", testNoTable },
+        { "fat-boot-sector", testFatBootSector },
+    };
+
+    for (const auto &test : tests) {
+        if (!test.test()) {
+            qWarning() << "test" << test.name << "failed";
+            return 1;
+        }
+    }
+
+    benchmark("GPT", gptDisk());
+    benchmark("MBR", mbrDisk());
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*************************************************************************
+ *  Copyright (C) 2026 by KPMcore contributors                           *
+ *                                                                       *
+ *  This program is free software; you can redistribute it and/or        *
+ *  modify it under the terms of the GNU General Public License as       *
+ *  published by the Free Software Foundation; either version 3 of       *
+ *  the License, or (at your option) any later version.                  *
+ *                                                                       *
+ *  This program is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ *  GNU General Public License for more details.                         *
+ *                                                                       *
+ *  You should have received a copy of the GNU General Public License    *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ *************************************************************************/
+
+//  SPDX-License-Identifier: GPL-3.0+
+
+// Parses captured udev monitor messages and updates single devices of an OperationStack like DeviceScanner does
+
+#include "core/diskdevice.h"
+#include "core/operationstack.h"
+#include "core/uevent.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QList>
+#include <QMap>
+#include <QPointer>
+#include <QStringList>
+#include <QThread>
+#include <QtEndian>
+
+#include <cstring>
+
+/** Properties of uevents as printed by udevadm monitor --udev --property */
+static const char* const partitionChange[] = {
+    "ACTION=change",
+    "DEVPATH=/devices/pci0000:00/0000:00:17.0/ata1/host0/target0:0:0/0:0:0:0/block/sda/sda2",
+    "SUBSYSTEM=block",
+    "DEVNAME=/dev/sda2",
+    "DEVTYPE=partition",
+    "PARTN=2",
+    "SEQNUM=5120",
+    "USEC_INITIALIZED=4183721",
+    "ID_FS_TYPE=ext4",
+    "MAJOR=8",
+    "MINOR=2",
+    nullptr
+};
+
+static const char* const nvmeDiskAdd[] = {
+    "ACTION=add",
+    "DEVPATH=/devices/pci0000:00/0000:00:1d.0/0000:3d:00.0/nvme/nvme0/nvme0n1",
+    "SUBSYSTEM=block",
+    "DEVNAME=/dev/nvme0n1",
+    "DEVTYPE=disk",
+    "SEQNUM=3204",
+    "MAJOR=259",
+    "MINOR=0",
+    nullptr
+};
+
+static const char* const ccissPartitionRemove[] = {
+    "ACTION=remove",
+    "DEVPATH=/devices/pci0000:00/0000:00:03.0/cciss0/c0d0/block/cciss!c0d0/cciss!c0d0p1",
+    "SUBSYSTEM=block",
+    "DEVNAME=/dev/cciss/c0d0p1",
+    "DEVTYPE=partition",
+    "SEQNUM=812",
+    nullptr
+};
+
+static const char* const deviceMapperChange[] = {
+    "ACTION=change",
+    "DEVPATH=/devices/virtual/block/dm-0",
+    "SUBSYSTEM=block",
+    "DEVNAME=/dev/dm-0",
+    "DEVTYPE=disk",
+    "DM_NAME=vg0-root",
+    "SEQNUM=5121",
+    nullptr
+};
+
+static const char* const usbAdd[] = {
+    "ACTION=add",
+    "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2",
+    "SUBSYSTEM=usb",
+    "DEVTYPE=usb_device",
+    "SEQNUM=5200",
+    nullptr
+};
+
+/** Builds a message like the udev monitor socket delivers it, struct udev_monitor_netlink_header and properties */
+static QByteArray udevMessage(const char* const* properties)
+{
+    QByteArray body;
+    for (int i = 0; properties[i]; ++i) {
+        body.append(properties[i]);
+        body.append('\0');
+    }
+
+    const quint32 headerSize = 40;
+    QByteArray message(headerSize, 0);
+    message.replace(0, 8, QByteArray("libudev", 8));
+    const quint32 magic = qToBigEndian<quint32>(0xfeedcafe);
+    const quint32 fields[] = { magic, headerSize, headerSize, static_cast<quint32>(body.size()) };
+    std::memcpy(message.data() + 8, fields, sizeof(fields));
+
+    return message + body;
+}
+
+static bool testParse()
+{
+    QMap<QString, QString> properties;
+    if (!Uevent::parse(udevMessage(partitionChange), properties))
+        return false;
+
+    if (properties.size() != 11 || properties.value(QStringLiteral("ACTION")) != QStringLiteral("change")
+            || properties.value(QStringLiteral("DEVNAME")) != QStringLiteral("/dev/sda2")
+            || properties.value(QStringLiteral("ID_FS_TYPE")) != QStringLiteral("ext4")) {
+        qWarning() << "parsed as" << properties;
+        return false;
+    }
+
+    // Kernel uevents on the same socket family, a damaged magic and a truncated message are ignored
+    QMap<QString, QString> ignored;
+    QByteArray wrongMagic = udevMessage(partitionChange);
+    wrongMagic[8] = 0;
+    return !Uevent::parse(QByteArray("change@/devices/virtual/block/dm-0\0ACTION=change\0", 50), ignored)
+            && !Uevent::parse(wrongMagic, ignored)
+            && !Uevent::parse(udevMessage(partitionChange).left(60), ignored)
+            && !Uevent::parse(QByteArray("libudev"), ignored)
+            && ignored.isEmpty();
+}
+
+static QString diskNode(const char* const* properties)
+{
+    QMap<QString, QString> map;
+    Uevent::parse(udevMessage(properties), map);
+    return Uevent::diskNode(map);
+}
+
+static bool testDiskNode()
+{
+    return diskNode(partitionChange) == QStringLiteral("/dev/sda")
+            && diskNode(nvmeDiskAdd) == QStringLiteral("/dev/nvme0n1")
+            && diskNode(ccissPartitionRemove) == QStringLiteral("/dev/cciss/c0d0")
+            && diskNode(deviceMapperChange).isEmpty()
+            && diskNode(usbAdd).isEmpty();
+}
+
+/** Gives access to what DeviceScanner uses */
+class TestOperationStack : public OperationStack
+{
+public:
+    using OperationStack::addDevice;
+    using OperationStack::updateDevice;
+};
+
+static Device* disk(const QString& deviceNode)
+{
+    return new DiskDevice(deviceNode, deviceNode, 255, 63, 100, 512);
+}
+
+static QStringList deviceNodes(const OperationStack& stack)
+{
+    QStringList nodes;
+    for (const auto &device : stack.previewDevices())
+        nodes.append(device->deviceNode());
+    return nodes;
+}
+
+static bool testUpdateDevice()
+{
+    TestOperationStack stack;
+    stack.addDevice(disk(QStringLiteral("/dev/sda")));
+    stack.addDevice(disk(QStringLiteral("/dev/sdc")));
+
+    QStringList events;
+    QObject::connect(&stack, &OperationStack::deviceAdded, [&events] (Device* d) { events.append(QStringLiteral("added ") + d->deviceNode()); });
+    QObject::connect(&stack, &OperationStack::deviceChanged, [&events] (Device* d) { events.append(QStringLiteral("changed ") + d->deviceNode()); });
+    QObject::connect(&stack, &OperationStack::deviceRemoved, [&events] (const QString& node) { events.append(QStringLiteral("removed ") + node); });
+
+    // The replaced device must still be alive while slots run
+    QPointer<Device> oldDevice = stack.previewDevices().first();
+    bool oldDeviceAlive = false;
+    QObject::connect(&stack, &OperationStack::devicesChanged, [&oldDevice, &oldDeviceAlive] { oldDeviceAlive = !oldDevice.isNull(); });
+
+    if (!stack.updateDevice(QStringLiteral("/dev/sdb"), disk(QStringLiteral("/dev/sdb")))
+            || !stack.updateDevice(QStringLiteral("/dev/sda"), disk(QStringLiteral("/dev/sda")))
+            || !oldDeviceAlive || !oldDevice.isNull()
+            || !stack.updateDevice(QStringLiteral("/dev/sdc"), nullptr)
+            || stack.updateDevice(QStringLiteral("/dev/sdd"), nullptr))
+        return false;
+
+    if (deviceNodes(stack) != QStringList({ QStringLiteral("/dev/sda"), QStringLiteral("/dev/sdb") })
+            || events != QStringList({ QStringLiteral("added /dev/sdb"), QStringLiteral("changed /dev/sda"), QStringLiteral("removed /dev/sdc") })) {
+        qWarning() << "devices" << deviceNodes(stack) << "after" << events;
+        return false;
+    }
+
+    // Like a rescan on the scanner thread, the change is only made on the thread of the stack
+    events.clear();
+    QThread* scanner = QThread::create([&stack] { stack.updateDevice(QStringLiteral("/dev/sde"), disk(QStringLiteral("/dev/sde"))); });
+    scanner->start();
+    scanner->wait();
+    delete scanner;
+
+    if (stack.previewDevices().size() != 2 || !events.isEmpty())
+        return false;
+
+    QCoreApplication::processEvents();
+
+    return deviceNodes(stack).contains(QStringLiteral("/dev/sde"))
+            && events == QStringList({ QStringLiteral("added /dev/sde") })
+            && stack.previewDevices().last()->thread() == stack.thread();
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const struct { const char* name; bool (*test)(); } tests[] = {
+        { "parse", testParse },
+        { "disk-node", testDiskNode },
+        { "update-device", testUpdateDevice },
+    };
+
+    for (const auto &test : tests) {
+        if (!test.test()) {
+            qWarning() << "test" << test.name << "failed";
+            return 1;
+        }
+    }
+
+    return 0;
+}